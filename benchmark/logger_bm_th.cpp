@@ -13,6 +13,9 @@ int main(int argc, char** argv) {
     }
 
     logger_initFileLogger("logs/logger.txt", 1024 * 1024 * 30, 3);
+    if (argc > 2) {
+        logger_setCombining(atoi(argv[2])); /* 1 to write the lines of other threads under the lock */
+    }
 
     std::atomic<int> count(0);
     std::vector<std::thread> threads;
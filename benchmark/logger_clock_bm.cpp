@@ -0,0 +1,25 @@
+#include <chrono>
+#include <cstdio>
+#include "logger.h"
+
+static const int kLoggingCount = 1000000;
+
+int main(void) {
+    const enum LogClock clocks[] = {LogClock_REALTIME, LogClock_REALTIME_COARSE, LogClock_TSC};
+    const char* names[] = {"REALTIME", "REALTIME_COARSE", "TSC"};
+
+    logger_initFileLogger("logs/logger.txt", 1024 * 1024 * 30, 3);
+    for (int c = 0; c < 3; c++) {
+        if (!logger_setClock(clocks[c])) {
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoggingCount; i++) {
+            LOG_INFO("%d", i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::printf("%-16s %.1f ns/log\n", names[c],
+                std::chrono::duration<double, std::nano>(end - start).count() / kLoggingCount);
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Latency of logger_log() while the disk is slow.
+ *
+ * write(2), writev(2), pwrite(2), rename(2), fsync(2) and fdatasync(2) are
+ * interposed in this binary, so the logger compiled into it runs against an
+ * injected I/O layer that sleeps before the real system call. No special
+ * file system is needed. Each call is classified by what the I/O layer was
+ * doing meanwhile, and the latency percentiles are printed for each class.
+ * The console sink writes to a file, as the descriptor of stdout is not
+ * slowed.
+ *
+ * Not covered: in uring mode the writes and the linked fsyncs are done by
+ * the kernel without a system call of this process, so only the rotation
+ * and the lines written with write() past the ring (short writes and lines
+ * longer than a buffer) are slowed.
+ *
+ * usage: logger_fault_bm.exe [mode [threads [writeDelayUs [stallEvery [stallMs [renameMs]]]]]]
+ *   mode          file, shared, shard, compressed, combining, sink, uring or console (default: file)
+ *   threads       The number of application threads (default: 4)
+ *   writeDelayUs  A delay added to every write in microseconds (default: 0)
+ *   stallEvery    Stall every N writes, 0 is never (default: 100)
+ *   stallMs       The length of a stall in milliseconds (default: 50)
+ *   renameMs      A delay added to every rename in milliseconds (default: 20)
+ */
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "logger.h"
+
+static const int kLoggingCount = 200000;
+
+static long s_writeDelayUs = 0;
+static long s_stallEvery = 100;
+static long s_stallMs = 50;
+static long s_renameMs = 20;
+
+static std::atomic<long> s_writes(0);
+static std::atomic<long> s_renames(0); /* started */
+static std::atomic<long> s_stalls(0); /* started */
+static std::atomic<int> s_renaming(0); /* in progress */
+static std::atomic<int> s_stalling(0); /* in progress */
+
+static void sleepFor(long us)
+{
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+static void stall()
+{
+    ++s_stalls;
+    ++s_stalling;
+    sleepFor(s_stallMs * 1000);
+    --s_stalling;
+}
+
+static void delayWrite(int fd)
+{
+    if (fd > 2) { /* only files */
+        long count = ++s_writes;
+        if (s_stallEvery > 0 && count % s_stallEvery == 0) {
+            stall();
+        } else {
+            sleepFor(s_writeDelayUs);
+        }
+    }
+}
+
+extern "C" ssize_t write(int fd, const void* buf, size_t n)
+{
+    delayWrite(fd);
+    return syscall(SYS_write, fd, buf, n);
+}
+
+extern "C" ssize_t writev(int fd, const struct iovec* iov, int n)
+{
+    delayWrite(fd);
+    return syscall(SYS_writev, fd, iov, n);
+}
+
+extern "C" ssize_t pwrite(int fd, const void* buf, size_t n, off_t offset)
+{
+    delayWrite(fd);
+    return syscall(SYS_pwrite64, fd, buf, n, offset);
+}
+
+extern "C" int rename(const char* oldpath, const char* newpath) noexcept
+{
+    ++s_renames;
+    ++s_renaming;
+    sleepFor(s_renameMs * 1000);
+    --s_renaming;
+    return (int) syscall(SYS_renameat, AT_FDCWD, oldpath, AT_FDCWD, newpath);
+}
+
+extern "C" int fsync(int fd)
+{
+    stall();
+    return (int) syscall(SYS_fsync, fd);
+}
+
+extern "C" int fdatasync(int fd)
+{
+    stall();
+    return (int) syscall(SYS_fdatasync, fd);
+}
+
+static int addFileSink(LogIoUring ioUring)
+{
+    struct LogFileSink config;
+    std::memset(&config, 0, sizeof(config));
+    config.filename = "logs/fault.txt";
+    config.maxFileSize = 1024 * 1024;
+    config.maxBackupFiles = 3;
+    config.minLevel = LogLevel_TRACE;
+    config.maxLevel = LogLevel_FATAL;
+    config.ioUring = ioUring;
+    return logger_addFileSink(&config) != 0;
+}
+
+enum Phase { kNormal, kRotation, kStall, kPhases };
+static const char* kPhaseNames[] = {"normal", "rotation", "stall"};
+
+struct Sample
+{
+    long ns;
+    Phase phase;
+};
+
+static void printPercentiles(const char* name, std::vector<long>& ns)
+{
+    if (ns.empty()) {
+        std::printf("%-9s %9d\n", name, 0);
+        return;
+    }
+    std::sort(ns.begin(), ns.end());
+    auto at = [&](double q) { return ns[std::min(ns.size() - 1, (size_t) (q * ns.size()))] / 1000.0; };
+    std::printf("%-9s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            name, ns.size(), at(0.5), at(0.9), at(0.99), at(0.999), ns.back() / 1000.0);
+}
+
+int main(int argc, char** argv) {
+    const char* mode = (argc > 1) ? argv[1] : "file";
+    int nThreads = (argc > 2) ? atoi(argv[2]) : 4;
+    s_writeDelayUs = (argc > 3) ? atol(argv[3]) : s_writeDelayUs;
+    s_stallEvery = (argc > 4) ? atol(argv[4]) : s_stallEvery;
+    s_stallMs = (argc > 5) ? atol(argv[5]) : s_stallMs;
+    s_renameMs = (argc > 6) ? atol(argv[6]) : s_renameMs;
+
+    int ok;
+    if (strcmp(mode, "shared") == 0) {
+        ok = logger_initSharedFileLogger("logs/fault.txt", 1024 * 1024, 3);
+    } else if (strcmp(mode, "shard") == 0) {
+        ok = logger_initShardedFileLogger("logs/fault.txt", 1024 * 1024, 3);
+    } else if (strcmp(mode, "compressed") == 0) {
+        ok = logger_initCompressedFileLogger("logs/fault.txt.z", 64 * 1024, 3);
+    } else if (strcmp(mode, "combining") == 0) {
+        ok = logger_initFileLogger("logs/fault.txt", 1024 * 1024, 3);
+        logger_setCombining(1);
+    } else if (strcmp(mode, "sink") == 0) {
+        ok = addFileSink(LogIoUring_OFF);
+    } else if (strcmp(mode, "uring") == 0) {
+        ok = addFileSink(LogIoUring_ON);
+    } else if (strcmp(mode, "console") == 0) {
+        struct LogConsoleSink config;
+        std::memset(&config, 0, sizeof(config));
+        config.output = std::fopen("logs/fault.txt", "w");
+        config.minLevel = LogLevel_TRACE;
+        config.maxLevel = LogLevel_FATAL;
+        ok = config.output != NULL && logger_addConsoleSink(&config) != 0;
+    } else {
+        ok = logger_initFileLogger("logs/fault.txt", 1024 * 1024, 3);
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    std::atomic<int> count(0);
+    std::vector<std::vector<Sample>> samples(nThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            int i;
+            while ((i = count++) < kLoggingCount) {
+                long renames = s_renames, stalls = s_stalls;
+                bool renaming = s_renaming > 0, stalling = s_stalling > 0;
+                auto start = std::chrono::steady_clock::now();
+                LOG_INFO("%d", i);
+                auto end = std::chrono::steady_clock::now();
+                Sample sample;
+                sample.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                if (stalling || s_stalling > 0 || stalls != s_stalls) {
+                    sample.phase = kStall;
+                } else if (renaming || s_renaming > 0 || renames != s_renames) {
+                    sample.phase = kRotation;
+                } else {
+                    sample.phase = kNormal;
+                }
+                samples[t].push_back(sample);
+            }
+        }));
+    }
+    for (std::thread& th : threads) {
+        th.join();
+    }
+
+    std::vector<long> all, phases[kPhases];
+    for (auto& v : samples) {
+        for (const Sample& sample : v) {
+            all.push_back(sample.ns);
+            phases[sample.phase].push_back(sample.ns);
+        }
+    }
+    std::printf("mode=%s threads=%d writeDelay=%ldus stallEvery=%ld stall=%ldms rename=%ldms\n",
+            mode, nThreads, s_writeDelayUs, s_stallEvery, s_stallMs, s_renameMs);
+    std::printf("%-9s %9s %10s %10s %10s %10s %10s   [us]\n", "phase", "calls", "p50", "p90", "p99", "p99.9", "max");
+    for (int p = 0; p < kPhases; p++) {
+        printPercentiles(kPhaseNames[p], phases[p]);
+    }
+    printPercentiles("all", all);
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Throughput and latency of the file logger and of file sinks written with
+ * writev() or through io_uring.
+ *
+ * usage: logger_sink_bm.exe [mode [threads [flushInterval [sync]]]]
+ *   mode           file, writev, uring or sqpoll (default: file)
+ *   threads        The number of application threads (default: 1)
+ *   flushInterval  The flush interval of the sinks in milliseconds (default: 0, each line)
+ *   sync           1 to sync each write (default: 0)
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "logger.h"
+
+static const int kLoggingCount = 1000000;
+
+int main(int argc, char** argv) {
+    const char* mode = (argc > 1) ? argv[1] : "file";
+    int nThreads = (argc > 2) ? atoi(argv[2]) : 1;
+    long flushInterval = (argc > 3) ? atol(argv[3]) : 0;
+    int sync = (argc > 4) ? atoi(argv[4]) : 0;
+    int count = (sync ? kLoggingCount / 100 : kLoggingCount);
+
+    int ok;
+    if (strcmp(mode, "file") == 0) {
+        ok = logger_initFileLogger("logs/sink.txt", 64 * 1024 * 1024, 3);
+    } else {
+        struct LogFileSink config;
+        std::memset(&config, 0, sizeof(config));
+        config.filename = "logs/sink.txt";
+        config.maxFileSize = 64 * 1024 * 1024;
+        config.maxBackupFiles = 3;
+        config.minLevel = LogLevel_TRACE;
+        config.maxLevel = LogLevel_FATAL;
+        config.flushInterval = flushInterval;
+        config.sync = sync;
+        if (strcmp(mode, "uring") == 0) {
+            config.ioUring = LogIoUring_ON;
+        } else if (strcmp(mode, "sqpoll") == 0) {
+            config.ioUring = LogIoUring_SQPOLL;
+        }
+        ok = logger_addFileSink(&config) != 0;
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    std::atomic<int> next(0);
+    std::vector<std::vector<long>> samples(nThreads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < nThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            int i;
+            samples[t].reserve(count / nThreads + 1);
+            while ((i = next++) < count) {
+                auto begin = std::chrono::steady_clock::now();
+                LOG_INFO("%d", i);
+                auto end = std::chrono::steady_clock::now();
+                samples[t].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+            }
+        }));
+    }
+    for (std::thread& th : threads) {
+        th.join();
+    }
+    logger_flush();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<long> ns;
+    for (auto& v : samples) {
+        ns.insert(ns.end(), v.begin(), v.end());
+    }
+    std::sort(ns.begin(), ns.end());
+    auto at = [&](double q) { return ns[std::min(ns.size() - 1, (size_t) (q * ns.size()))] / 1000.0; };
+    std::printf("mode=%s threads=%d flushInterval=%ldms sync=%d\n", mode, nThreads, flushInterval, sync);
+    std::printf("%9s %10s %10s %10s %10s %10s %10s   [us]\n", "calls", "lines/s", "p50", "p90", "p99", "p99.9", "max");
+    std::printf("%9zu %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+            ns.size(), ns.size() / sec, at(0.5), at(0.9), at(0.99), at(0.999), ns.back() / 1000.0);
+    return 0;
+}
@@ -1,25 +1,136 @@
+#if !defined(_WIN32) && !defined(_WIN64) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE
+#endif /* !defined(_WIN32) && !defined(_WIN64) && !defined(_GNU_SOURCE) */
 #include "logger.h"
 #include <assert.h>
 #include <stdarg.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #if defined(_WIN32) || defined(_WIN64)
  #include <winsock2.h>
+ #include <io.h>
 #else
+ #include <errno.h>
  #include <pthread.h>
+ #include <sched.h>
+ #include <sys/file.h>
+ #include <sys/mman.h>
  #include <sys/time.h>
  #include <sys/syscall.h>
  #include <unistd.h>
 #endif /* defined(_WIN32) || defined(_WIN64) */
+#if defined(LOGGER_HAVE_ZLIB) && !defined(_WIN32) && !defined(_WIN64)
+ #define LOGGER_COMPRESSION
+ #include <zlib.h>
+#endif /* defined(LOGGER_HAVE_ZLIB) && !defined(_WIN32) && !defined(_WIN64) */
+#if defined(LOGGER_HAVE_IO_URING) && defined(__linux__)
+ #include <linux/io_uring.h>
+ #if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+  #define LOGGER_IO_URING
+ #endif /* defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS) */
+#endif /* defined(LOGGER_HAVE_IO_URING) && defined(__linux__) */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__)) \
+        && !defined(_WIN32) && !defined(_WIN64)
+ #define LOGGER_TSC
+ #if defined(__x86_64__)
+  #include <cpuid.h>
+ #endif /* defined(__x86_64__) */
+#endif /* defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__)) ... */
+
+#if defined(__SSE2__) || defined(_M_X64)
+ #define LOGGER_SSE2
+ #include <emmintrin.h>
+#endif /* defined(__SSE2__) || defined(_M_X64) */
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+ #define snprintf _snprintf
+ #define vsnprintf _vsnprintf
+#endif /* defined(_MSC_VER) && _MSC_VER < 1900 */
+#if defined(_WIN32) || defined(_WIN64)
+ #define open _open
+ #define write _write
+ #define close(fd) _close(fd) /* not the member of struct LogSink */
+ #define stat _stat
+ #define fstat _fstat
+#endif /* defined(_WIN32) || defined(_WIN64) */
+#if defined(_MSC_VER)
+ #define THREAD_LOCAL __declspec(thread)
+#else
+ #define THREAD_LOCAL __thread
+#endif /* defined(_MSC_VER) */
+#ifndef va_copy
+ #ifdef __va_copy
+  #define va_copy(dst, src) __va_copy(dst, src)
+ #else
+  #define va_copy(dst, src) ((dst) = (src))
+ #endif /* __va_copy */
+#endif /* va_copy */
 
 enum
 {
     /* Logger type */
     kConsoleLogger = 1 << 0,
     kFileLogger = 1 << 1,
+    kShmLogger = 1 << 2,
+    kShardLogger = 1 << 3,
+    kCompressedLogger = 1 << 4,
+    kSinkLogger = 1 << 5,
 
     kMaxFileNameLen = 256,
+    kMaxBackupFileNameLen = kMaxFileNameLen + 32, /* <shard or index filename>.255 */
+    kOutputBufferSize = 8192,
+    kDefaultShardPoolSize = 64, /* threads with a shard allocated at initialization */
+    kMaxLineLen = 4096,
+    kTimestampLen = 24, /* yy-mm-dd hh:mm:ss.uuuuuu */
     kDefaultMaxFileSize = 1048576L, /* 1 MB */
+    kDefaultShmSize = 4194304L, /* 4 MB */
+    kShmChunkSize = 65536,
+    kCompressedBlockSize = 65536, /* uncompressed bytes per frame */
+    kFrameHeaderSize = 12, /* magic, compressed size and uncompressed size */
+    kMaxPushedLevels = 16, /* thread levels pushed at a time */
+    kMaxContextLen = 512, /* rendered context of a thread */
+    kMaxContextDepth = 16, /* context entries pushed at a time */
+    kMaxSinks = 8,
+    kMaxSinkLines = 256, /* lines delivered to a sink at a time */
+    kMaxLoggers = 16, /* named loggers including the root logger */
+    kMaxLoggerNameLen = 32,
+    kMaxHexDumpLen = 16384, /* a message with bytes in columns */
+    kHexRowBytes = 16,
+    kMaxHexRowLen = 96, /* offset, bytes in hex and bytes as ASCII */
+    kHexMarkerLen = 32, /* ... (<number of bytes> bytes) */
+    kCombiningSpins = 64, /* tries to take the lock before waiting for it */
+    kDefaultScopeSize = 65536,
+    kMinScopeSize = 8192,
+    kScopeChunkLen = 16384, /* committed lines written at a time */
+    kMaxMetrics = 64,
+    kMaxMetricNameLen = 48,
+    kMetricBuckets = 496, /* 16 values and 8 buckets for each power of 2 from 16 */
+    kMetricCheckInterval = 256, /* additions of a thread between checks of the time */
+    kSpinsBeforeYield = 64, /* busy waits before giving the CPU to another thread */
+};
+
+/* Ring buffer of formatted log lines */
+struct Ring
+{
+    char* buffer;
+    size_t size;
+    size_t head; /* next write position */
+    int wrapped;
+    int aligned; /* whether the oldest byte starts a line */
+};
+
+/* A file written through its own buffer, so that writing and reopening it do not allocate */
+struct Output
+{
+    int fd; /* -1 if closed */
+    size_t len;
+    char buffer[kOutputBufferSize];
 };
 
 /* Console logger */
@@ -33,56 +144,562 @@ s_clog;
 /* File logger */
 static struct
 {
-    FILE* output;
+    struct Output output; /* unbuffered in shared mode */
     char filename[kMaxFileNameLen];
     long maxFileSize;
     unsigned char maxBackupFiles;
     long currentFileSize;
     long flushedTime;
+    int shared; /* whether other processes write to the same file */
+    struct Output index; /* sparse time index */
+    long indexInterval; /* bytes between index entries, 0 is off */
+    long indexedSize; /* file size at the last index entry */
+#if !defined(_WIN32) && !defined(_WIN64)
+    int lockfd;
+    dev_t dev;
+    ino_t ino;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
 }
 s_flog;
 
+/* Flight recorder */
+static struct
+{
+    struct Ring ring;
+    enum LogLevel level;
+}
+s_recorder;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Header of a shared memory file. The ring buffer data follows it. */
+struct ShmHeader
+{
+    char magic[8];
+    pthread_mutex_t mutex; /* process-shared */
+    unsigned long size;
+    unsigned long readPos; /* total bytes read */
+    unsigned long writePos; /* total bytes written */
+    unsigned long dropped; /* messages dropped since the last read */
+};
+
+static const char kShmMagic[8] = "CLOGSHM";
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+/* Shared memory ring buffer */
+struct Shm
+{
+    struct ShmHeader* header;
+    char* data;
+    size_t mapSize;
+};
+
+/* Shared memory logger */
+static struct Shm s_shm;
+/* Shared memory collector */
+static struct Shm s_shmCollector;
+
+#if defined(_WIN32) || defined(_WIN64)
+typedef CRITICAL_SECTION Mutex;
+#else
+typedef pthread_mutex_t Mutex;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+/* A file written by only one thread of the sharded file logger */
+struct Shard
+{
+    Mutex mutex; /* taken by the owner thread and logger_flush() */
+    struct Output output;
+    char filename[kMaxFileNameLen + 24];
+    long currentFileSize;
+    long flushedTime;
+    int generation;
+    struct Shard* next;
+};
+
+/* Sharded file logger */
+static struct
+{
+    char filename[kMaxFileNameLen];
+    long maxFileSize;
+    unsigned char maxBackupFiles;
+    volatile int generation; /* incremented on every initialization */
+    Mutex mutex; /* guards the lists of shards */
+    struct Shard* shards;
+    struct Shard* freeShards; /* allocated at initialization */
+    int poolSize; /* shards to allocate at initialization, the default if 0 */
+    int allocated;
+    volatile unsigned long dropped; /* lines of threads without a shard */
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_key_t key; /* closes the shard of an exiting thread */
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+s_shardlog;
+
+#if defined(LOGGER_COMPRESSION)
+/* Compressed file logger */
+static struct
+{
+    char filename[kMaxFileNameLen];
+    long maxFileSize;
+    unsigned char maxBackupFiles;
+    struct Output output; /* written only by the compressor thread */
+    long currentFileSize; /* compressed bytes */
+    z_stream stream;
+    unsigned char* frame;
+    size_t frameSize;
+    char* block; /* filled by logger_log() */
+    size_t blockLen;
+    char* pending; /* being compressed */
+    size_t pendingLen;
+    long handedTime; /* when the block was last handed off */
+    int running;
+    int initialized;
+    pthread_t thread;
+    pthread_cond_t ready; /* a block is pending */
+    pthread_cond_t done; /* the pending block has been written */
+}
+s_zlog;
+
+static const char kFrameMagic[4] = {'C', 'L', 'Z', '1'};
+#endif /* defined(LOGGER_COMPRESSION) */
+
+/* Messages and bytes logged from a call site */
+struct Site
+{
+    const char* volatile file; /* NULL if the slot is free */
+    int line;
+    volatile int claimed; /* whether file and line are set */
+    volatile unsigned long messages;
+    volatile unsigned long bytes;
+    unsigned long dumpedMessages; /* at the previous dump */
+    unsigned long dumpedBytes;
+};
+
+/* A site counted by a dump */
+struct SiteCount
+{
+    const struct Site* site;
+    unsigned long messages;
+    unsigned long bytes;
+    unsigned long newMessages; /* since the previous dump */
+    unsigned long newBytes;
+};
+
+/* Call site profile */
+static struct
+{
+    struct Site* sites; /* open addressing keyed by file and line */
+    size_t size; /* a power of 2 */
+    size_t maxSites;
+    volatile unsigned long nsites;
+    struct SiteCount* top; /* the top sites of a dump */
+    int topN;
+    volatile unsigned long dropped; /* messages from sites that did not fit */
+    volatile long dumpInterval; /* msec, 0 is periodic dump off */
+    volatile long dumpedTime;
+    Mutex mutex; /* taken by dumps */
+}
+s_profile;
+
+/* A counter of LOG_COUNT() or a histogram of LOG_HIST() */
+struct Metric
+{
+    char name[kMaxMetricNameLen];
+    const char* file; /* of the first call */
+    int line;
+    int histogram;
+};
+
+/* What a thread has added to a metric in an interval */
+struct MetricValues
+{
+    unsigned long count;
+    long min;
+    long max;
+    unsigned long* buckets; /* NULL for a counter */
+};
+
+/* The metrics of a thread, of which one half is added to while the other is emitted */
+struct MetricThread
+{
+    struct MetricThread* next;
+    volatile unsigned long sequence; /* odd while the thread adds */
+    volatile int exited;
+    int additions; /* until the next check of the time */
+    struct MetricValues* values[kMaxMetrics]; /* the 2 halves, NULL until the thread adds */
+};
+
+/* Aggregated metrics */
+static struct
+{
+    volatile long interval; /* msec, 0 is off */
+    enum LogLevel level;
+    volatile unsigned long epoch; /* the half added to is epoch % 2 */
+    volatile long emittedTime;
+    struct Metric metrics[kMaxMetrics];
+    volatile int count;
+    struct MetricThread* threads;
+    unsigned long buckets[kMetricBuckets]; /* of all threads */
+    Mutex mutex; /* taken by registrations and emissions */
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_key_t key; /* marks the metrics of a thread when it exits */
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+s_metrics;
+
+/* A sink added by logger_addSink(), which collects lines to deliver them in vectors */
+struct Sink
+{
+    struct LogSink sink;
+    enum LogLevel level;
+    enum LogLevel maxLevel;
+    int id;
+    int autoFlush; /* whether logger_autoFlush() sets the interval */
+    long flushInterval; /* msec, 0 delivers each line and a negative value only full vectors */
+    long flushedTime;
+    unsigned long loggers; /* bits of the named loggers attached to, any logger if 0 */
+    void (*wait)(void* context); /* waits for the writes in flight, may be NULL */
+    char* buffer; /* follows the struct */
+    size_t size;
+    size_t len;
+    int nlines;
+    struct iovec lines[kMaxSinkLines]; /* point into the buffer */
+};
+
+/* A file written by a sink added by logger_addFileSink() */
+struct FileSink
+{
+    char filename[kMaxFileNameLen];
+    long maxFileSize;
+    unsigned char maxBackupFiles;
+    int sync;
+    int fd; /* -1 if closed */
+    long currentFileSize;
+#if defined(LOGGER_IO_URING)
+    struct Uring* uring; /* NULL if written with writev() */
+#endif /* defined(LOGGER_IO_URING) */
+};
+
+#if !defined(_WIN32) && !defined(_WIN64)
+enum
+{
+    kDefaultConsoleQueueSize = 64 * 1024,
+    kConsoleChunkSize = 8192 /* written at a time */
+};
+
+/* A console written by a thread of its own, added by logger_addConsoleSink() */
+struct ConsoleSink
+{
+    int fd;
+    char* buffer; /* the queue, which follows the struct */
+    size_t size;
+    unsigned long head; /* bytes queued */
+    unsigned long tail; /* bytes taken by the writer thread */
+    char* chunk; /* being written, which follows the queue */
+    int writing;
+    enum LogOverflow overflow;
+    long timeout; /* msec */
+    int timedOut; /* dropping without waiting until the writer makes progress */
+    int waiters; /* threads waiting for space or for the writer without the lock of the logger */
+    unsigned long dropped; /* lines */
+    int running;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t ready; /* lines are queued */
+    pthread_cond_t space; /* the writer thread has taken lines */
+};
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+#if defined(LOGGER_IO_URING)
+enum
+{
+    kUringBuffers = 8, /* writes in flight */
+    kUringFsync = kUringBuffers /* the user data of fsync */
+};
+
+/* A write in flight, or a free buffer */
+struct UringWrite
+{
+    struct iovec data; /* points into the registered buffer */
+    unsigned long sequence; /* of the submission */
+    size_t written; /* by a short write, whose rest waits for the other writes */
+    int busy;
+};
+
+/* The rings of io_uring shared with the kernel and the buffers registered to it */
+struct Uring
+{
+    int fd;
+    int fixed; /* whether the buffers are registered */
+    int sqpoll; /* whether a kernel thread polls the submission queue */
+    int pending; /* completions to reap */
+    unsigned long submitted; /* writes */
+    int shortWrites; /* whose rest is not written yet */
+    int draining; /* writing the rest of the short writes */
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing; /* may be the same mapping as sqRing */
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqFlags;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    char* memory; /* of the buffers */
+    size_t bufferSize;
+    struct iovec buffers[kUringBuffers];
+    struct UringWrite writes[kUringBuffers];
+};
+#endif /* defined(LOGGER_IO_URING) */
+
+/* Named loggers, of which 0 is the root logger */
+static struct
+{
+    char names[kMaxLoggers][kMaxLoggerNameLen];
+    volatile int levels[kMaxLoggers]; /* the log level if negative */
+    volatile int count; /* of the named loggers after the root logger */
+}
+s_loggers;
+
+/* Custom sinks */
+static struct
+{
+    struct Sink* sinks[kMaxSinks]; /* NULL if the slot is free */
+    int lastID;
+    volatile int blocking; /* console sinks with LogOverflow_BLOCK */
+}
+s_sinks;
+
+/* Lines published for the thread holding the lock, on the stack of the thread waiting for them */
+struct Combined
+{
+    struct Combined* next; /* published earlier */
+    enum LogLevel level;
+    const char* buf;
+    size_t len;
+    int lines;
+    long currentTime;
+    int logger;
+    volatile int done;
+};
+
+/* Flat combining of the writes under the lock */
+static struct
+{
+    volatile int enabled;
+    struct Combined* volatile pending; /* the last published */
+}
+s_combining;
+
+static THREAD_LOCAL struct Shard* t_shard;
+static volatile unsigned long s_sequence;
+
+/* Wall clock time of a log line */
+struct LogTime
+{
+    time_t sec;
+    long nsec;
+};
+
+/* A message captured by a scope, which is followed by its text */
+struct ScopeRecord
+{
+    struct LogTime time;
+    const char* file; /* NULL if the text is formatted lines */
+    int line; /* or the number of the formatted lines */
+    enum LogLevel level;
+    size_t len; /* of the text */
+};
+
+/* Messages below the log level captured by a thread until they are committed or discarded */
+struct Scope
+{
+    int active;
+    unsigned long dropped; /* the oldest records dropped for room */
+    size_t len;
+    size_t size;
+    char buffer[1]; /* of the size */
+};
+
+/* Scopes of the threads */
+static struct
+{
+    volatile size_t size;
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_key_t key; /* frees the scope of a thread at its exit */
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+s_scopes = {kDefaultScopeSize};
+
+static THREAD_LOCAL struct Scope* t_scope;
+static THREAD_LOCAL struct MetricThread* t_metricThread;
+
+#if defined(LOGGER_TSC)
+/* A point where the timestamp counter was read together with the wall clock */
+struct TscAnchor
+{
+    unsigned long long tsc;
+    long long ns; /* since the epoch */
+    double nsPerTick;
+};
+
+/* Timestamp counter clock */
+static struct
+{
+    struct TscAnchor anchor;
+    volatile unsigned sequence; /* odd while the anchor is written, which the readers retry on */
+    volatile int recalibrating;
+    unsigned long long interval; /* ticks between recalibrations */
+}
+s_tsc;
+#endif /* defined(LOGGER_TSC) */
+
+static THREAD_LOCAL time_t t_calendarTime = -1;
+static THREAD_LOCAL char t_calendar[18]; /* yy-mm-dd hh:mm:ss of t_calendarTime */
+
+static volatile enum LogClock s_clock = LogClock_REALTIME;
 static volatile int s_logger;
 static volatile enum LogLevel s_logLevel = LogLevel_INFO;
+static THREAD_LOCAL enum LogLevel t_logLevel = LogLevel_FATAL; /* lowers s_logLevel for the thread */
+static THREAD_LOCAL int t_logger; /* a named logger */
+
+/* The lowest level enabled for a thread, valid while the generation is current */
+struct LevelCache
+{
+    unsigned long generation;
+    int lowest; /* the level + 1, or 0 until it is computed */
+};
+
+static volatile unsigned long s_levelGeneration; /* incremented when a level for all threads changes */
+
+static THREAD_LOCAL struct LevelCache t_levelCache;
+static THREAD_LOCAL enum LogLevel t_pushedLevels[kMaxPushedLevels];
+static THREAD_LOCAL int t_pushedCount;
+static THREAD_LOCAL char t_context[kMaxContextLen]; /* "[key=value ...] ", rendered on push and pop */
+static THREAD_LOCAL size_t t_contextLen;
+static THREAD_LOCAL size_t t_contextEnds[kMaxContextDepth]; /* t_contextLen before each push */
+static THREAD_LOCAL int t_contextDepth;
+static volatile int s_hexColumns = 0;
+static volatile size_t s_hexMaxBytes = 0; /* 0 is no maximum */
 static volatile long s_flushInterval = 0; /* msec, 0 is auto flush off */
 static volatile int s_initialized = 0; /* false */
+static Mutex s_mutex;
+
+static void initMutex(Mutex* mutex)
+{
 #if defined(_WIN32) || defined(_WIN64)
-static CRITICAL_SECTION s_mutex;
+    InitializeCriticalSection(mutex);
 #else
-static pthread_mutex_t s_mutex;
+    pthread_mutex_init(mutex, NULL);
 #endif /* defined(_WIN32) || defined(_WIN64) */
+}
 
-static void init(void)
+static void lockMutex(Mutex* mutex)
 {
-    if (s_initialized) {
-        return;
-    }
 #if defined(_WIN32) || defined(_WIN64)
-    InitializeCriticalSection(&s_mutex);
+    EnterCriticalSection(mutex);
 #else
-    pthread_mutex_init(&s_mutex, NULL);
+    pthread_mutex_lock(mutex);
 #endif /* defined(_WIN32) || defined(_WIN64) */
-    s_initialized = 1; /* true */
 }
 
-static void lock(void)
+static int tryLockMutex(Mutex* mutex)
 {
 #if defined(_WIN32) || defined(_WIN64)
-    EnterCriticalSection(&s_mutex);
+    return TryEnterCriticalSection(mutex) != 0;
 #else
-    pthread_mutex_lock(&s_mutex);
+    return pthread_mutex_trylock(mutex) == 0;
 #endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-static void unlock(void)
+static void unlockMutex(Mutex* mutex)
 {
 #if defined(_WIN32) || defined(_WIN64)
-    LeaveCriticalSection(&s_mutex);
+    LeaveCriticalSection(mutex);
 #else
-    pthread_mutex_unlock(&s_mutex);
+    pthread_mutex_unlock(mutex);
 #endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
+static void closeShard(void* shard);
+static unsigned long addCount(volatile unsigned long* count, unsigned long n);
+static void memoryBarrier(void);
+static void spinWait(int spins);
+static void exitMetrics(void* thread);
+static void writeLoggedLine(enum LogLevel level, const char* buf, size_t len, int lines, long currentTime);
+#if defined(LOGGER_COMPRESSION)
+static void flushCompressed(void);
+#endif /* defined(LOGGER_COMPRESSION) */
+
+static void flushOutput(struct Output* output);
+static void flushSink(struct Sink* sink);
+static void syncSink(struct Sink* sink);
+#if !defined(_WIN32) && !defined(_WIN64)
+static int holdConsoleSink(struct Sink* sink, struct ConsoleSink** consoles, int n);
+static void syncConsoleSinks(struct ConsoleSink** consoles, int n);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+/* Write what is left in the buffers at exit, without the locks like stdio does */
+static void flushOutputsAtExit(void)
+{
+    struct Shard* shard;
+    int i;
+
+    flushOutput(&s_flog.output);
+    for (shard = s_shardlog.shards; shard != NULL; shard = shard->next) {
+        flushOutput(&shard->output);
+    }
+    for (i = 0; i < kMaxSinks; i++) {
+        if (s_sinks.sinks[i] != NULL) {
+            syncSink(s_sinks.sinks[i]);
+        }
+    }
+}
+
+static void init(void)
+{
+    if (s_initialized) {
+        return;
+    }
+    initMutex(&s_mutex);
+    initMutex(&s_shardlog.mutex);
+    initMutex(&s_profile.mutex);
+    initMutex(&s_metrics.mutex);
+    s_flog.output.fd = -1;
+    s_flog.index.fd = -1;
+#if defined(LOGGER_COMPRESSION)
+    s_zlog.output.fd = -1;
+#endif /* defined(LOGGER_COMPRESSION) */
+    atexit(flushOutputsAtExit);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_key_create(&s_shardlog.key, closeShard);
+    pthread_key_create(&s_scopes.key, free);
+    pthread_key_create(&s_metrics.key, exitMetrics);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    s_initialized = 1; /* true */
+}
+
+static void lock(void)
+{
+    lockMutex(&s_mutex);
+}
+
+static int tryLock(void)
+{
+    return tryLockMutex(&s_mutex);
+}
+
+static void unlock(void)
+{
+    unlockMutex(&s_mutex);
+}
+
 #if defined(_WIN32) || defined(_WIN64)
 static int gettimeofday(struct timeval* tv, void* tz)
 {
@@ -110,239 +727,4057 @@ static struct tm* localtime_r(const time_t* timep, struct tm* result)
 }
 #endif /* defined(_WIN32) || defined(_WIN64) */
 
-static long getCurrentThreadID(void)
+#if defined(LOGGER_TSC)
+static unsigned long long readTsc(void)
 {
-#if defined(_WIN32) || defined(_WIN64)
-    return GetCurrentThreadId();
-#elif __linux__
-    return syscall(SYS_gettid);
-#elif defined(__APPLE__) && defined(__MACH__)
-    return syscall(SYS_thread_selfid);
+#if defined(__x86_64__)
+    unsigned int lo, hi;
+
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long) hi << 32) | lo;
 #else
-    return (long) pthread_self();
-#endif /* defined(_WIN32) || defined(_WIN64) */
+    unsigned long long value;
+
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#endif /* defined(__x86_64__) */
 }
 
-int logger_initConsoleLogger(FILE* output)
+/* Whether the counter ticks at a constant rate on every core */
+static int isTscInvariant(void)
 {
-    output = (output != NULL) ? output : stdout;
-    if (output != stdout && output != stderr) {
-        assert(0 && "output must be stdout or stderr");
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
         return 0;
     }
+    return (edx & (1 << 8)) != 0;
+#else
+    return 1; /* the generic timer of arm64 */
+#endif /* defined(__x86_64__) */
+}
 
-    init();
-    lock();
-    s_clog.output = output;
-    s_logger |= kConsoleLogger;
-    unlock();
-    return 1;
+static long long getClockNanoseconds(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
 }
 
-static long getFileSize(const char* filename)
+/* Publish an anchor to the readers. Only one thread writes at a time. */
+static void writeTscAnchor(const struct TscAnchor* anchor)
 {
-    FILE* fp;
-    long size;
+    __atomic_store_n(&s_tsc.sequence, s_tsc.sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s_tsc.anchor = *anchor;
+    __atomic_store_n(&s_tsc.sequence, s_tsc.sequence + 1, __ATOMIC_RELEASE);
+}
 
-    if ((fp = fopen(filename, "rb")) == NULL) {
-        return 0;
+/* Copy the anchor, retrying while it is written */
+static void readTscAnchor(struct TscAnchor* anchor)
+{
+    unsigned sequence;
+    int spins = 0;
+
+    for (;;) {
+        if ((sequence = __atomic_load_n(&s_tsc.sequence, __ATOMIC_ACQUIRE)) % 2 == 0) {
+            *anchor = s_tsc.anchor;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&s_tsc.sequence, __ATOMIC_RELAXED) == sequence) {
+                return;
+            }
+        }
+        spinWait(spins++);
     }
-    fseek(fp, 0, SEEK_END);
-    size = ftell(fp);
-    fclose(fp);
-    return size;
 }
 
-int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+/* Measure the rate of the counter against the monotonic clock for about 10 ms */
+static int calibrateTsc(void)
 {
-    int ok = 0; /* false */
+    long long start, end;
+    unsigned long long tscStart, tscEnd;
+    struct TscAnchor anchor;
+    int spins = 0;
 
-    if (filename == NULL) {
-        assert(0 && "filename must not be NULL");
+    start = getClockNanoseconds(CLOCK_MONOTONIC);
+    tscStart = readTsc();
+    do {
+        end = getClockNanoseconds(CLOCK_MONOTONIC);
+        tscEnd = readTsc();
+    } while (end - start < 10000000LL);
+    if (tscEnd <= tscStart) {
         return 0;
     }
-
-    init();
-    lock();
-    if (s_flog.output != NULL) { /* reinit */
-        fclose(s_flog.output);
-    }
-    s_flog.output = fopen(filename, "a");
-    if (s_flog.output == NULL) {
-        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", filename);
-        goto cleanup;
+    anchor.nsPerTick = (double) (end - start) / (double) (tscEnd - tscStart);
+    anchor.ns = getClockNanoseconds(CLOCK_REALTIME);
+    anchor.tsc = readTsc();
+    while (!__sync_bool_compare_and_swap(&s_tsc.recalibrating, 0, 1)) {
+        spinWait(spins++); /* a logging thread is recalibrating */
     }
-    s_flog.currentFileSize = getFileSize(filename);
-    strncpy(s_flog.filename, filename, kMaxFileNameLen - 1);
-    s_flog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
-    s_flog.maxBackupFiles = maxBackupFiles;
-    s_logger |= kFileLogger;
-    ok = 1; /* true */
-cleanup:
-    unlock();
-    return ok;
+    s_tsc.interval = (unsigned long long) (1000000000.0 / anchor.nsPerTick); /* 1 sec */
+    writeTscAnchor(&anchor);
+    s_tsc.recalibrating = 0; /* false */
+    return 1;
 }
 
-void logger_setLevel(enum LogLevel level)
+/*
+ * Anchor the counter to the wall clock again, so that clock adjustments and
+ * the error of the rate do not accumulate. Only one thread does it at a time,
+ * and it reads the anchor after it has won.
+ */
+static void recalibrateTsc(void)
 {
-    s_logLevel = level;
-}
+    struct TscAnchor anchor;
+    double nsPerTick;
 
-enum LogLevel logger_getLevel(void)
-{
-    return s_logLevel;
+    if (!__sync_bool_compare_and_swap(&s_tsc.recalibrating, 0, 1)) {
+        return;
+    }
+    anchor.ns = getClockNanoseconds(CLOCK_REALTIME);
+    anchor.tsc = readTsc();
+    nsPerTick = (double) (anchor.ns - s_tsc.anchor.ns) / (double) (anchor.tsc - s_tsc.anchor.tsc);
+    /* ignore the rate across a step of the wall clock */
+    anchor.nsPerTick = (nsPerTick > s_tsc.anchor.nsPerTick * 0.99 && nsPerTick < s_tsc.anchor.nsPerTick * 1.01)
+        ? nsPerTick : s_tsc.anchor.nsPerTick;
+    writeTscAnchor(&anchor);
+    s_tsc.recalibrating = 0; /* false */
 }
 
-int logger_isEnabled(enum LogLevel level)
+static void getTscTime(struct LogTime* time)
 {
-    return s_logLevel <= level;
+    struct TscAnchor anchor;
+    long long delta;
+    long long ns;
+
+    readTscAnchor(&anchor);
+    delta = (long long) (readTsc() - anchor.tsc);
+    if (delta < 0) {
+        delta = 0; /* read on a core slightly behind */
+    } else if ((unsigned long long) delta > s_tsc.interval) {
+        recalibrateTsc();
+    }
+    ns = anchor.ns + (long long) ((double) delta * anchor.nsPerTick);
+    time->sec = (time_t) (ns / 1000000000LL);
+    time->nsec = (long) (ns % 1000000000LL);
 }
+#endif /* defined(LOGGER_TSC) */
 
-void logger_autoFlush(long interval)
+static void getTime(struct LogTime* time)
 {
-    s_flushInterval = interval > 0 ? interval : 0;
+#if defined(_WIN32) || defined(_WIN64)
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    time->sec = now.tv_sec;
+    time->nsec = now.tv_usec * 1000L;
+#else
+    struct timespec now;
+
+    switch (s_clock) {
+#if defined(LOGGER_TSC)
+        case LogClock_TSC:
+            getTscTime(time);
+            return;
+#endif /* defined(LOGGER_TSC) */
+#if defined(CLOCK_REALTIME_COARSE)
+        case LogClock_REALTIME_COARSE:
+            clock_gettime(CLOCK_REALTIME_COARSE, &now);
+            break;
+#endif /* defined(CLOCK_REALTIME_COARSE) */
+        default:
+            clock_gettime(CLOCK_REALTIME, &now);
+            break;
+    }
+    time->sec = now.tv_sec;
+    time->nsec = now.tv_nsec;
+#endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-static int hasFlag(int flags, int flag)
+int logger_setClock(enum LogClock clock)
 {
-    return (flags & flag) == flag;
+    int ok = 1; /* true */
+
+    init();
+    lock();
+    switch (clock) {
+        case LogClock_REALTIME:
+            s_clock = clock;
+            break;
+        case LogClock_REALTIME_COARSE:
+#if defined(_WIN32) || defined(_WIN64) || !defined(CLOCK_REALTIME_COARSE)
+            s_clock = LogClock_REALTIME; /* the same resolution */
+#else
+            s_clock = clock;
+#endif /* defined(_WIN32) || defined(_WIN64) || !defined(CLOCK_REALTIME_COARSE) */
+            break;
+        case LogClock_TSC:
+#if defined(LOGGER_TSC)
+            if (isTscInvariant() && calibrateTsc()) {
+                s_clock = clock;
+                break;
+            }
+#endif /* defined(LOGGER_TSC) */
+            fprintf(stderr, "ERROR: logger: Timestamp counter clock is not supported\n");
+            s_clock = LogClock_REALTIME;
+            ok = 0; /* false */
+            break;
+        default:
+            assert(0 && "unknown clock");
+            ok = 0; /* false */
+            break;
+    }
+    unlock();
+    return ok;
+}
+
+/* Read the clock of scope timers, which is monotonic and cheap */
+static unsigned long long readTimer(int tsc)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    LARGE_INTEGER counter;
+
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long) counter.QuadPart;
+#else
+    struct timespec now;
+
+#if defined(LOGGER_TSC)
+    if (tsc) {
+        return readTsc();
+    }
+#endif /* defined(LOGGER_TSC) */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long) now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+/* Convert ticks of the clock of scope timers to nanoseconds */
+static double getTimerNanoseconds(unsigned long long ticks, int tsc)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    return (double) ticks * 1e9 / (double) frequency.QuadPart;
+#else
+#if defined(LOGGER_TSC)
+    if (tsc) {
+        struct TscAnchor anchor;
+
+        readTscAnchor(&anchor);
+        return (double) ticks * anchor.nsPerTick;
+    }
+#endif /* defined(LOGGER_TSC) */
+    return (double) ticks;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+struct LogScopeTimer logger_timerBegin(enum LogLevel level, const char* name, long threshold,
+        const char* file, int line)
+{
+    struct LogScopeTimer timer;
+
+    memset(&timer, 0, sizeof(timer));
+    if (logger_isEnabled(level)) {
+        timer.tsc = (s_clock == LogClock_TSC);
+        timer.level = level;
+        timer.threshold = (threshold > 0) ? threshold : 0;
+        timer.name = name;
+        timer.file = file;
+        timer.line = line;
+        timer.start = readTimer(timer.tsc); /* last, not to time the above */
+    }
+    return timer;
+}
+
+void logger_timerEnd(struct LogScopeTimer* timer)
+{
+    double ns;
+
+    if (timer->start == 0) {
+        return;
+    }
+    ns = getTimerNanoseconds(readTimer(timer->tsc) - timer->start, timer->tsc);
+    if (ns >= timer->threshold * 1000.0) {
+        logger_log(timer->level, timer->file, timer->line, "%s: %lu.%03lu us", timer->name,
+                (unsigned long) (ns / 1000), (unsigned long) ns % 1000);
+    }
+}
+
+static long getCurrentThreadID(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return GetCurrentThreadId();
+#elif __linux__
+    return syscall(SYS_gettid);
+#elif defined(__APPLE__) && defined(__MACH__)
+    return syscall(SYS_thread_selfid);
+#else
+    return (long) pthread_self();
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+int logger_initConsoleLogger(FILE* output)
+{
+    output = (output != NULL) ? output : stdout;
+    if (output != stdout && output != stderr) {
+        assert(0 && "output must be stdout or stderr");
+        return 0;
+    }
+
+    init();
+    lock();
+    s_clog.output = output;
+    s_logger |= kConsoleLogger;
+    unlock();
+    return 1;
+}
+
+/* Open the file for appending and get its size and identity */
+static int openOutput(struct Output* output, const char* filename, struct stat* st)
+{
+    output->len = 0;
+    if ((output->fd = open(filename, O_WRONLY | O_APPEND | O_CREAT, 0644)) < 0
+            || fstat(output->fd, st) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", filename);
+        if (output->fd >= 0) {
+            close(output->fd);
+            output->fd = -1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int writeAll(int fd, const char* data, size_t len)
+{
+    long n;
+
+    while (len > 0) {
+        if ((n = (long) write(fd, data, (unsigned int) len)) < 0) {
+#if !defined(_WIN32) && !defined(_WIN64)
+            if (errno == EINTR) {
+                continue;
+            }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+            return 0;
+        }
+        data += n;
+        len -= (size_t) n;
+    }
+    return 1;
+}
+
+static void flushOutput(struct Output* output)
+{
+    if (output->fd >= 0 && output->len > 0) {
+        writeAll(output->fd, output->buffer, output->len);
+    }
+    output->len = 0;
+}
+
+static long writeOutput(struct Output* output, const char* data, size_t len)
+{
+    if (output->fd < 0) {
+        return 0;
+    }
+    if (output->len + len > sizeof(output->buffer)) {
+        flushOutput(output);
+    }
+    if (len >= sizeof(output->buffer)) {
+        return writeAll(output->fd, data, len) ? (long) len : 0;
+    }
+    memcpy(&output->buffer[output->len], data, len);
+    output->len += len;
+    return (long) len;
+}
+
+static void closeOutput(struct Output* output)
+{
+    if (output->fd >= 0) {
+        flushOutput(output);
+        close(output->fd);
+        output->fd = -1;
+    }
+}
+
+static int openFileOutput(void)
+{
+    struct stat st;
+
+    if (!openOutput(&s_flog.output, s_flog.filename, &st)) {
+        return 0;
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    s_flog.dev = st.st_dev;
+    s_flog.ino = st.st_ino;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    s_flog.currentFileSize = (long) st.st_size;
+    return 1;
+}
+
+static void closeFileOutput(void)
+{
+    closeOutput(&s_flog.output);
+    closeOutput(&s_flog.index);
+}
+
+static int isFileOutputOpen(void)
+{
+    return s_flog.output.fd >= 0;
+}
+
+static int initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles, int shared)
+{
+    int ok = 0; /* false */
+#if !defined(_WIN32) && !defined(_WIN64)
+    char lockname[kMaxFileNameLen + 5];
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (shared) {
+        fprintf(stderr, "ERROR: logger: Shared file logger is not supported: `%s`\n", filename);
+        return 0;
+    }
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+    init();
+    lock();
+    closeFileOutput(); /* reinit */
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (s_flog.shared) {
+        close(s_flog.lockfd);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    s_logger &= ~kFileLogger;
+    strncpy(s_flog.filename, filename, kMaxFileNameLen - 1);
+    s_flog.shared = shared;
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (shared) {
+        /* serializes rotation between processes */
+        sprintf(lockname, "%.255s.lock", filename);
+        if ((s_flog.lockfd = open(lockname, O_RDWR | O_CREAT, 0644)) < 0) {
+            fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", lockname);
+            s_flog.shared = 0; /* false */
+            goto cleanup;
+        }
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    if (!openFileOutput()) {
+        goto cleanup;
+    }
+    s_flog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
+    s_flog.maxBackupFiles = maxBackupFiles;
+    s_logger |= kFileLogger;
+    ok = 1; /* true */
+cleanup:
+    unlock();
+    return ok;
+}
+
+int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+{
+    return initFileLogger(filename, maxFileSize, maxBackupFiles, 0);
+}
+
+int logger_initSharedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+{
+    return initFileLogger(filename, maxFileSize, maxBackupFiles, 1);
+}
+
+void logger_setFileIndex(long interval)
+{
+    init();
+    lock();
+    s_flog.indexInterval = interval > 0 ? interval : 0;
+    if (s_flog.indexInterval == 0) {
+        closeOutput(&s_flog.index);
+    }
+    unlock();
+}
+
+/* Make each thread compute the lowest level enabled for it again, after the level is changed */
+static void clearLevelCaches(void)
+{
+    addCount(&s_levelGeneration, 1); /* with a barrier after the change */
+}
+
+void logger_setLevel(enum LogLevel level)
+{
+    s_logLevel = level;
+    clearLevelCaches();
+}
+
+enum LogLevel logger_getLevel(void)
+{
+    return s_logLevel;
+}
+
+void logger_setThreadLevel(enum LogLevel level)
+{
+    t_logLevel = level;
+    t_levelCache.lowest = 0;
+}
+
+enum LogLevel logger_getThreadLevel(void)
+{
+    return t_logLevel;
+}
+
+int logger_pushThreadLevel(enum LogLevel level)
+{
+    if (t_pushedCount == kMaxPushedLevels) {
+        assert(0 && "too many thread levels pushed");
+        return 0;
+    }
+    t_pushedLevels[t_pushedCount++] = t_logLevel;
+    t_logLevel = level;
+    t_levelCache.lowest = 0;
+    return 1;
+}
+
+void logger_popThreadLevel(void)
+{
+    if (t_pushedCount == 0) {
+        assert(0 && "no thread level pushed");
+        return;
+    }
+    t_logLevel = t_pushedLevels[--t_pushedCount];
+    t_levelCache.lowest = 0;
+}
+
+int logger_ctxPush(const char* key, const char* value)
+{
+    size_t keylen, valuelen;
+    size_t len = t_contextLen;
+
+    if (key == NULL || value == NULL) {
+        assert(0 && "key and value must not be NULL");
+        return 0;
+    }
+    if (t_contextDepth == kMaxContextDepth) {
+        assert(0 && "too many context entries pushed");
+        return 0;
+    }
+    keylen = strlen(key);
+    valuelen = strlen(value);
+    /* replace "] " with " key=value] " or start with "[key=value] " */
+    if (len + keylen + valuelen + 4 > sizeof(t_context)) {
+        fprintf(stderr, "ERROR: logger: Context is too long: `%s=%s`\n", key, value);
+        return 0;
+    }
+    if (len == 0) {
+        t_context[len++] = '[';
+    } else {
+        len -= 2;
+        t_context[len++] = ' ';
+    }
+    memcpy(&t_context[len], key, keylen);
+    len += keylen;
+    t_context[len++] = '=';
+    memcpy(&t_context[len], value, valuelen);
+    len += valuelen;
+    t_context[len++] = ']';
+    t_context[len++] = ' ';
+    t_contextEnds[t_contextDepth++] = t_contextLen;
+    t_contextLen = len;
+    return 1;
+}
+
+void logger_ctxPop(void)
+{
+    if (t_contextDepth == 0) {
+        assert(0 && "no context entry pushed");
+        return;
+    }
+    t_contextLen = t_contextEnds[--t_contextDepth];
+    if (t_contextLen > 0) {
+        t_context[t_contextLen - 2] = ']';
+        t_context[t_contextLen - 1] = ' ';
+    }
+}
+
+int logger_getLogger(const char* name)
+{
+    int id;
+
+    if (name == NULL) {
+        assert(0 && "name must not be NULL");
+        return -1;
+    }
+    if (strcmp(name, "root") == 0) {
+        return 0;
+    }
+    if (strlen(name) >= kMaxLoggerNameLen) {
+        fprintf(stderr, "ERROR: logger: Too long logger name: `%s`\n", name);
+        return -1;
+    }
+    init();
+    lock();
+    for (id = 1; id <= s_loggers.count && strcmp(s_loggers.names[id], name) != 0; id++) {
+    }
+    if (id == kMaxLoggers) {
+        fprintf(stderr, "ERROR: logger: Too many loggers: `%s`\n", name);
+        id = -1;
+    } else if (id > s_loggers.count) {
+        strcpy(s_loggers.names[id], name);
+        s_loggers.levels[id] = -1;
+        s_loggers.count = id;
+    }
+    unlock();
+    return id;
+}
+
+int logger_useLogger(int id)
+{
+    int previous = t_logger;
+
+    if (id < 0 || id >= kMaxLoggers) {
+        assert(0 && "invalid logger ID");
+        return previous;
+    }
+    t_logger = id;
+    t_levelCache.lowest = 0;
+    return previous;
+}
+
+void logger_setLoggerLevel(int id, enum LogLevel level)
+{
+    if (id < 0 || id >= kMaxLoggers) {
+        assert(0 && "invalid logger ID");
+        return;
+    }
+    if (id == 0) {
+        s_logLevel = level;
+    } else {
+        s_loggers.levels[id] = (int) level;
+    }
+    clearLevelCaches();
+}
+
+int logger_attachSink(int id, int sinkID)
+{
+    int ok = 0; /* false */
+    int i;
+
+    if (id < 0 || id >= kMaxLoggers) {
+        assert(0 && "invalid logger ID");
+        return 0;
+    }
+    init();
+    lock();
+    for (i = 0; i < kMaxSinks; i++) {
+        if (s_sinks.sinks[i] != NULL && s_sinks.sinks[i]->id == sinkID) {
+            s_sinks.sinks[i]->loggers |= 1UL << id;
+            ok = 1; /* true */
+        }
+    }
+    unlock();
+    return ok;
+}
+
+/* Whether the level is at or above the lower of the level of the logger and the thread level */
+static int isLogged(enum LogLevel level)
+{
+    int loggerLevel = (t_logger == 0) ? -1 : s_loggers.levels[t_logger];
+
+    return ((loggerLevel < 0) ? (int) s_logLevel : loggerLevel) <= (int) level || t_logLevel <= level;
+}
+
+static int isRecorded(enum LogLevel level)
+{
+    return s_recorder.ring.buffer != NULL && s_recorder.level <= level;
+}
+
+static int isScoped(void)
+{
+    return t_scope != NULL && t_scope->active;
+}
+
+static int getLowestLevel(void)
+{
+    int loggerLevel = (t_logger == 0) ? -1 : s_loggers.levels[t_logger];
+    int lowest = (loggerLevel < 0) ? (int) s_logLevel : loggerLevel;
+
+    if (isScoped()) {
+        return LogLevel_TRACE;
+    }
+    lowest = ((int) t_logLevel < lowest) ? (int) t_logLevel : lowest;
+    if (s_recorder.ring.buffer != NULL && (int) s_recorder.level < lowest) {
+        lowest = (int) s_recorder.level;
+    }
+    return lowest;
+}
+
+/*
+ * Compute the lowest level enabled for the current thread. The generation
+ * is read first, so that a level changed meanwhile makes it stale.
+ */
+static void updateLevelCache(void)
+{
+    t_levelCache.generation = s_levelGeneration;
+    memoryBarrier();
+    t_levelCache.lowest = getLowestLevel() + 1;
+}
+
+int logger_isEnabled(enum LogLevel level)
+{
+    if (t_levelCache.generation == s_levelGeneration) {
+        if ((int) level + 1 < t_levelCache.lowest) {
+            return 0; /* false, below the lowest level enabled for the thread */
+        }
+        if (t_levelCache.lowest == 0) {
+            updateLevelCache();
+        }
+    } else {
+        updateLevelCache();
+    }
+    return isLogged(level) || isRecorded(level) || isScoped();
+}
+
+void logger_autoFlush(long interval)
+{
+    s_flushInterval = interval > 0 ? interval : 0;
+}
+
+static int hasFlag(int flags, int flag)
+{
+    return (flags & flag) == flag;
+}
+
+void logger_flush()
+{
+    struct Shard* shard;
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct ConsoleSink* consoles[kMaxSinks];
+    int nconsoles = 0;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    int i;
+
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    if (hasFlag(s_logger, kConsoleLogger)) {
+        fflush(s_clog.output);
+    }
+    if (hasFlag(s_logger, kFileLogger)) {
+        lock();
+        flushOutput(&s_flog.output);
+        unlock();
+    }
+    if (hasFlag(s_logger, kShardLogger)) {
+        lockMutex(&s_shardlog.mutex);
+        for (shard = s_shardlog.shards; shard != NULL; shard = shard->next) {
+            lockMutex(&shard->mutex);
+            flushOutput(&shard->output);
+            unlockMutex(&shard->mutex);
+        }
+        unlockMutex(&s_shardlog.mutex);
+    }
+#if defined(LOGGER_COMPRESSION)
+    if (hasFlag(s_logger, kCompressedLogger)) {
+        lock();
+        flushCompressed();
+        unlock();
+    }
+#endif /* defined(LOGGER_COMPRESSION) */
+    if (hasFlag(s_logger, kSinkLogger)) {
+        lock();
+        for (i = 0; i < kMaxSinks; i++) {
+            if (s_sinks.sinks[i] == NULL) {
+                continue;
+            }
+#if !defined(_WIN32) && !defined(_WIN64)
+            if (holdConsoleSink(s_sinks.sinks[i], consoles, nconsoles)) {
+                flushSink(s_sinks.sinks[i]); /* its writer is waited for without the lock */
+                nconsoles++;
+                continue;
+            }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+            syncSink(s_sinks.sinks[i]);
+        }
+        unlock();
+#if !defined(_WIN32) && !defined(_WIN64)
+        syncConsoleSinks(consoles, nconsoles);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    }
+}
+
+static char getLevelChar(enum LogLevel level)
+{
+    switch (level) {
+        case LogLevel_TRACE: return 'T';
+        case LogLevel_DEBUG: return 'D';
+        case LogLevel_INFO:  return 'I';
+        case LogLevel_WARN:  return 'W';
+        case LogLevel_ERROR: return 'E';
+        case LogLevel_FATAL: return 'F';
+        default: return ' ';
+    }
+}
+
+/* Format the time with microseconds, or nanoseconds with the timestamp counter clock */
+static void getTimestamp(const struct LogTime* time, char* timestamp, size_t len)
+{
+    time_t sec = time->sec; /* a necessary variable to avoid a runtime error on Windows */
+    struct tm calendar;
+    long fraction = time->nsec;
+    int digits = (s_clock == LogClock_TSC) ? 9 : 6;
+    int i;
+
+    /* the calendar conversion is done once a second per thread */
+    if (sec != t_calendarTime) {
+        localtime_r(&sec, &calendar);
+        strftime(t_calendar, sizeof(t_calendar), "%y-%m-%d %H:%M:%S", &calendar);
+        t_calendarTime = sec;
+    }
+    assert(len > (size_t) (18 + digits));
+    memcpy(timestamp, t_calendar, 17);
+    timestamp[17] = '.';
+    if (digits == 6) {
+        fraction /= 1000;
+    }
+    for (i = 17 + digits; i > 17; i--) {
+        timestamp[i] = (char) ('0' + fraction % 10);
+        fraction /= 10;
+    }
+    timestamp[18 + digits] = '\0';
+}
+
+static void getBackupFileName(char* backupname, const char* basename, unsigned char index)
+{
+    if (index == 0) {
+        sprintf(backupname, "%.*s", kMaxBackupFileNameLen - 5, basename);
+    } else {
+        sprintf(backupname, "%.*s.%d", kMaxBackupFileNameLen - 5, basename, index);
+    }
+}
+
+static void getIndexFileName(char* indexname, const char* filename)
+{
+    sprintf(indexname, "%s.idx", filename);
+}
+
+static int isFileExist(const char* filename)
+{
+    struct stat st;
+
+    return stat(filename, &st) == 0;
+}
+
+static void renameBackupFiles(const char* filename, unsigned char maxBackupFiles)
+{
+    int i;
+    char src[kMaxBackupFileNameLen], dst[kMaxBackupFileNameLen];
+
+    for (i = (int) maxBackupFiles; i > 0; i--) {
+        getBackupFileName(src, filename, i - 1);
+        getBackupFileName(dst, filename, i);
+        if (isFileExist(dst)) {
+            if (remove(dst) != 0) {
+                fprintf(stderr, "ERROR: logger: Failed to remove file: `%s`\n", dst);
+            }
+        }
+        if (isFileExist(src)) {
+            if (rename(src, dst) != 0) {
+                fprintf(stderr, "ERROR: logger: Failed to rename file: `%s` -> `%s`\n", src, dst);
+            }
+        }
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/*
+ * Only the first process to find the file full renames the files.
+ * The others see that the file has been replaced and just reopen it.
+ */
+static int rotateSharedLogFiles(void)
+{
+    struct stat st;
+    int ok;
+
+    flock(s_flog.lockfd, LOCK_EX);
+    closeFileOutput();
+    if (stat(s_flog.filename, &st) == 0
+            && st.st_dev == s_flog.dev && st.st_ino == s_flog.ino
+            && st.st_size >= s_flog.maxFileSize) {
+        renameBackupFiles(s_flog.filename, s_flog.maxBackupFiles);
+    }
+    ok = openFileOutput();
+    flock(s_flog.lockfd, LOCK_UN);
+    return ok;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+static int rotateLogFiles(void)
+{
+    char indexname[kMaxFileNameLen + 4];
+
+    if (s_flog.currentFileSize < s_flog.maxFileSize) {
+        return isFileOutputOpen();
+    }
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (s_flog.shared) {
+        return rotateSharedLogFiles();
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    closeFileOutput();
+    renameBackupFiles(s_flog.filename, s_flog.maxBackupFiles);
+    if (s_flog.indexInterval > 0) {
+        getIndexFileName(indexname, s_flog.filename);
+        renameBackupFiles(indexname, s_flog.maxBackupFiles);
+    }
+    return openFileOutput();
+}
+
+/* Write to the file logger and update the file size */
+static long writeFileLogger(void* unused, const char* data, size_t len)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    off_t end;
+
+    if (s_flog.shared) {
+        /* a single append keeps the line whole among processes */
+        if (write(s_flog.output.fd, data, len) < 0) {
+            return 0;
+        }
+        /* the file offset includes what other processes have appended */
+        if ((end = lseek(s_flog.output.fd, 0, SEEK_CUR)) >= 0) {
+            s_flog.currentFileSize = (long) end;
+        }
+        return (long) len;
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    len = (size_t) writeOutput(&s_flog.output, data, len);
+    s_flog.currentFileSize += (long) len;
+    return (long) len;
+}
+
+/*
+ * Add an index entry mapping the timestamp of the line to its offset if the
+ * file has grown by the index interval since the last entry.
+ */
+static void indexFileLogger(const char* line, size_t len)
+{
+    char indexname[kMaxFileNameLen + 4];
+    char entry[64];
+    struct stat st;
+
+    if (s_flog.indexInterval <= 0 || s_flog.shared || len < 2 + kTimestampLen) {
+        return;
+    }
+    if (s_flog.index.fd < 0) {
+        getIndexFileName(indexname, s_flog.filename);
+        if (!openOutput(&s_flog.index, indexname, &st)) {
+            s_flog.indexInterval = 0; /* off */
+            return;
+        }
+        s_flog.indexedSize = -s_flog.indexInterval; /* index the first line */
+    }
+    if (s_flog.currentFileSize - s_flog.indexedSize < s_flog.indexInterval) {
+        return;
+    }
+    writeOutput(&s_flog.index, entry, sprintf(entry, "%.24s %ld\n", &line[2], s_flog.currentFileSize));
+    flushOutput(&s_flog.index);
+    s_flog.indexedSize = s_flog.currentFileSize;
+}
+
+/* Return whether the auto flush interval has passed since the last flush */
+static int isFlushTime(long currentTime, long* flushedTime)
+{
+    if (s_flushInterval > 0) {
+        if (currentTime - *flushedTime > s_flushInterval) {
+            *flushedTime = currentTime;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Flush the stream if the auto flush interval has passed */
+static void autoFlush(FILE* fp, long currentTime, long* flushedTime)
+{
+    if (isFlushTime(currentTime, flushedTime)) {
+        fflush(fp);
+    }
+}
+
+static void autoFlushOutput(struct Output* output, long currentTime, long* flushedTime)
+{
+    if (isFlushTime(currentTime, flushedTime)) {
+        flushOutput(output);
+    }
+}
+
+static const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+static const char kHexPairs[] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+static const char kLowerHexDigits[] = "0123456789abcdef";
+static const char kUpperHexDigits[] = "0123456789ABCDEF";
+
+/* Write the decimal digits backward from the end of the buffer and return the start */
+static char* formatDecimal(char* end, unsigned long long value)
+{
+    const char* pair;
+
+    while (value >= 100) {
+        pair = &kDigitPairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        pair = &kDigitPairs[value * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+    } else {
+        *--end = (char) ('0' + value);
+    }
+    return end;
+}
+
+static char* formatHex(char* end, unsigned long long value, const char* digits)
+{
+    do {
+        *--end = digits[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    return end;
+}
+
+/* Write the bytes as lowercase hex digits, which need 2 * len bytes, and return the end of them */
+static char* encodeHex(char* out, const unsigned char* data, size_t len)
+{
+    const char* pair;
+#if defined(LOGGER_SSE2)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+    __m128i bytes, hi, lo;
+
+    /* 16 bytes at a time: '0' + nibble, and 'a' - 10 + nibble for nibbles over 9 */
+    for (; len >= 16; len -= 16, data += 16, out += 32) {
+        bytes = _mm_loadu_si128((const __m128i*) data);
+        hi = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+        lo = _mm_and_si128(bytes, mask);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero), _mm_and_si128(_mm_cmpgt_epi8(hi, nine), gap));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero), _mm_and_si128(_mm_cmpgt_epi8(lo, nine), gap));
+        _mm_storeu_si128((__m128i*) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*) (out + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif /* defined(LOGGER_SSE2) */
+    for (; len > 0; len--) {
+        pair = &kHexPairs[*data++ * 2];
+        *out++ = pair[0];
+        *out++ = pair[1];
+    }
+    return out;
+}
+
+/* Write a row of up to 16 bytes in the columns, which needs kMaxHexRowLen bytes, and return the end of it */
+static char* formatHexRow(char* out, const unsigned char* data, size_t n, size_t offset, int columns)
+{
+    char digits[24];
+    char* digitsEnd = &digits[sizeof(digits)];
+    const char* body;
+    size_t i;
+
+    if (columns & LogHex_OFFSET) {
+        body = formatHex(digitsEnd, offset, kLowerHexDigits);
+        for (i = digitsEnd - body; i < 4; i++) {
+            *out++ = '0';
+        }
+        memcpy(out, body, digitsEnd - body);
+        out += digitsEnd - body;
+        *out++ = ' ';
+        *out++ = ' ';
+    }
+    for (i = 0; i < kHexRowBytes; i++) {
+        if (i < n) {
+            encodeHex(out, &data[i], 1);
+        } else {
+            out[0] = out[1] = ' ';
+        }
+        out[2] = out[3] = ' ';
+        out += (i == kHexRowBytes / 2 - 1) ? 4 : 3; /* a gap after 8 bytes */
+    }
+    if (columns & LogHex_ASCII) {
+        *out++ = ' ';
+        *out++ = '|';
+        for (i = 0; i < n; i++) {
+            *out++ = (data[i] >= 0x20 && data[i] < 0x7f) ? (char) data[i] : '.';
+        }
+        *out++ = '|';
+    } else {
+        while (out[-1] == ' ') {
+            out--;
+        }
+    }
+    return out;
+}
+
+#if defined(__SIZEOF_INT128__)
+static const unsigned long long kPowersOf10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL,
+};
+
+/*
+ * Write the digits of a finite double in %f notation without the sign, or
+ * return NULL if it is out of the supported range. The value is rounded
+ * exactly (to nearest, ties to even) like glibc.
+ */
+static char* formatFixed(char* end, double value, int precision)
+{
+    unsigned long long bits, mantissa, intpart, fracpart;
+    unsigned __int128 scaled, rest, half;
+    int exponent, shift, i;
+
+    if (precision >= (int) (sizeof(kPowersOf10) / sizeof(kPowersOf10[0]))) {
+        return NULL;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    exponent = (int) ((bits >> 52) & 0x7ff);
+    mantissa = bits & ((1ULL << 52) - 1);
+    if (exponent == 0x7ff) { /* inf or nan */
+        return NULL;
+    }
+    if (exponent == 0) { /* subnormal */
+        exponent = 1;
+    } else {
+        mantissa |= 1ULL << 52;
+    }
+    exponent -= 1075; /* value = mantissa * 2^exponent */
+    if (exponent > 10) { /* 2^63 or larger */
+        return NULL;
+    }
+    if (exponent >= 0) {
+        intpart = mantissa << exponent;
+        fracpart = 0;
+    } else {
+        shift = -exponent;
+        scaled = (unsigned __int128) mantissa * kPowersOf10[precision];
+        if (shift > 120) { /* less than half a unit of the last digit */
+            scaled = 0;
+        } else {
+            rest = scaled & ((((unsigned __int128) 1) << shift) - 1);
+            half = ((unsigned __int128) 1) << (shift - 1);
+            scaled >>= shift;
+            if (rest > half || (rest == half && (scaled & 1))) {
+                scaled++;
+            }
+        }
+        intpart = (unsigned long long) (scaled / kPowersOf10[precision]);
+        fracpart = (unsigned long long) (scaled % kPowersOf10[precision]);
+    }
+    if (precision > 0) {
+        for (i = 0; i < precision; i++) {
+            *--end = (char) ('0' + fracpart % 10);
+            fracpart /= 10;
+        }
+        *--end = '.';
+    }
+    return formatDecimal(end, intpart);
+}
+#endif /* defined(__SIZEOF_INT128__) */
+
+enum
+{
+    /* Format flags */
+    kLeftJustify = 1 << 0,
+    kZeroPad = 1 << 1,
+};
+
+/* Append a converted field padded to the width, truncating at the end of the buffer */
+static char* appendField(char* out, const char* end, const char* prefix, size_t prefixlen,
+        const char* body, size_t bodylen, size_t width, int flags)
+{
+    size_t len = prefixlen + bodylen;
+    size_t pad = (width > len) ? width - len : 0;
+    size_t n;
+
+    if (pad > 0 && !(flags & (kLeftJustify | kZeroPad))) {
+        n = ((size_t) (end - out) < pad) ? (size_t) (end - out) : pad;
+        memset(out, ' ', n);
+        out += n;
+    }
+    n = ((size_t) (end - out) < prefixlen) ? (size_t) (end - out) : prefixlen;
+    memcpy(out, prefix, n);
+    out += n;
+    if (pad > 0 && (flags & kZeroPad) && !(flags & kLeftJustify)) {
+        n = ((size_t) (end - out) < pad) ? (size_t) (end - out) : pad;
+        memset(out, '0', n);
+        out += n;
+    }
+    n = ((size_t) (end - out) < bodylen) ? (size_t) (end - out) : bodylen;
+    memcpy(out, body, n);
+    out += n;
+    if (pad > 0 && (flags & kLeftJustify)) {
+        n = ((size_t) (end - out) < pad) ? (size_t) (end - out) : pad;
+        memset(out, ' ', n);
+        out += n;
+    }
+    return out;
+}
+
+/*
+ * Format the common printf conversions (%d %i %u %x %X %c %s %p %f %% with
+ * the '-' and '0' flags, a width, a precision for %s and %f, and the l, ll
+ * and z length modifiers) without the overhead of vsnprintf.
+ * Return the number of bytes written (truncated to the size) or -1 if the
+ * format needs vsnprintf.
+ */
+static int formatMessage(char* buf, size_t size, const char* fmt, va_list arg)
+{
+    char* out = buf;
+    const char* end = buf + size;
+    const char* p = fmt;
+    const char* literal;
+    char digits[64];
+    char* digitsEnd = &digits[sizeof(digits)];
+    const char* body;
+    size_t bodylen;
+    char sign;
+    int flags, length;
+    size_t width, n;
+    int precision;
+    long long svalue;
+    unsigned long long uvalue;
+    const void* ptr;
+    char c;
+
+    for (;;) {
+        literal = p;
+        while (*p != '\0' && *p != '%') {
+            p++;
+        }
+        n = ((size_t) (end - out) < (size_t) (p - literal)) ? (size_t) (end - out) : (size_t) (p - literal);
+        memcpy(out, literal, n);
+        out += n;
+        if (*p == '\0') {
+            break;
+        }
+        p++; /* '%' */
+
+        flags = 0;
+        for (;; p++) {
+            if (*p == '-') {
+                flags |= kLeftJustify;
+            } else if (*p == '0') {
+                flags |= kZeroPad;
+            } else {
+                break;
+            }
+        }
+        width = 0;
+        while (*p >= '0' && *p <= '9') {
+            width = width * 10 + (*p++ - '0');
+            if (width > kMaxLineLen) {
+                return -1;
+            }
+        }
+        precision = -1;
+        if (*p == '.') {
+            p++;
+            precision = 0;
+            while (*p >= '0' && *p <= '9') {
+                precision = precision * 10 + (*p++ - '0');
+                if (precision > kMaxLineLen) {
+                    return -1;
+                }
+            }
+        }
+        length = 0;
+        if (*p == 'l') {
+            length = (p[1] == 'l') ? 2 : 1;
+            p += length;
+        } else if (*p == 'z') {
+            length = 3;
+            p++;
+        }
+
+        sign = '\0';
+        switch (c = *p++) {
+            case 'd':
+            case 'i':
+                if (precision >= 0) {
+                    return -1;
+                }
+                switch (length) {
+                    case 1: svalue = va_arg(arg, long); break;
+                    case 2: svalue = va_arg(arg, long long); break;
+                    case 3: svalue = (sizeof(size_t) == sizeof(long))
+                                ? (long long) (long) va_arg(arg, size_t)
+                                : (long long) (int) va_arg(arg, size_t); break;
+                    default: svalue = va_arg(arg, int); break;
+                }
+                if (svalue < 0) {
+                    sign = '-';
+                    uvalue = 0ULL - (unsigned long long) svalue;
+                } else {
+                    uvalue = (unsigned long long) svalue;
+                }
+                body = formatDecimal(digitsEnd, uvalue);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                if (precision >= 0) {
+                    return -1;
+                }
+                switch (length) {
+                    case 1: uvalue = va_arg(arg, unsigned long); break;
+                    case 2: uvalue = va_arg(arg, unsigned long long); break;
+                    case 3: uvalue = va_arg(arg, size_t); break;
+                    default: uvalue = va_arg(arg, unsigned int); break;
+                }
+                if (c == 'u') {
+                    body = formatDecimal(digitsEnd, uvalue);
+                } else {
+                    body = formatHex(digitsEnd, uvalue, (c == 'x') ? kLowerHexDigits : kUpperHexDigits);
+                }
+                break;
+            case 'c':
+                if (length != 0 || precision >= 0 || (flags & kZeroPad)) {
+                    return -1;
+                }
+                digits[0] = (char) va_arg(arg, int);
+                out = appendField(out, end, "", 0, digits, 1, width, flags);
+                continue;
+            case 's':
+                if (length != 0 || (flags & kZeroPad)) {
+                    return -1;
+                }
+                if ((body = va_arg(arg, const char*)) == NULL) { /* printed differently by platforms */
+                    return -1;
+                }
+                if (precision >= 0) {
+                    for (bodylen = 0; bodylen < (size_t) precision && body[bodylen] != '\0'; bodylen++) {}
+                } else {
+                    bodylen = strlen(body);
+                }
+                out = appendField(out, end, "", 0, body, bodylen, width, flags);
+                continue;
+#if !defined(_WIN32) && !defined(_WIN64)
+            case 'p':
+                if (length != 0 || precision >= 0 || (flags & kZeroPad)) {
+                    return -1;
+                }
+                if ((ptr = va_arg(arg, const void*)) == NULL) { /* printed differently by platforms */
+                    return -1;
+                }
+                body = formatHex(digitsEnd, (unsigned long long) (size_t) ptr, kLowerHexDigits);
+                out = appendField(out, end, "0x", 2, body, digitsEnd - body, width, flags);
+                continue;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+#if defined(__SIZEOF_INT128__)
+            case 'f':
+                if (length > 1) {
+                    return -1;
+                }
+                {
+                    double value = va_arg(arg, double);
+                    if ((body = formatFixed(digitsEnd, value, (precision >= 0) ? precision : 6)) == NULL) {
+                        return -1;
+                    }
+                    if (value < 0 || (value == 0 && 1 / value < 0)) {
+                        sign = '-';
+                    }
+                }
+                break;
+#endif /* defined(__SIZEOF_INT128__) */
+            case '%':
+                if (flags != 0 || width != 0 || precision >= 0 || length != 0) {
+                    return -1;
+                }
+                if (out < end) {
+                    *out++ = '%';
+                }
+                continue;
+            default:
+                return -1;
+        }
+        out = appendField(out, end, &sign, (sign != '\0') ? 1 : 0,
+                body, digitsEnd - body, width, flags);
+    }
+    return (int) (out - buf);
+}
+
+static size_t clampLength(int n, size_t avail)
+{
+    if (avail == 0) {
+        return 0;
+    }
+    return (n < 0 || (size_t) n >= avail) ? avail - 1 : (size_t) n;
+}
+
+/* Format the line header up to `file:line` and return the end of it */
+static char* formatPrefix(char* buf, const char* end, char levelc, const char* timestamp, long threadID,
+        const char* file, int line)
+{
+    char digits[24];
+    char* digitsEnd = &digits[sizeof(digits)];
+    char* out = buf;
+    const char* body;
+
+    *out++ = levelc;
+    *out++ = ' ';
+    out = appendField(out, end, "", 0, timestamp, strlen(timestamp), 0, 0);
+    out = appendField(out, end, " ", 1, "", 0, 0, 0);
+    if (threadID < 0) {
+        body = formatDecimal(digitsEnd, 0ULL - (unsigned long long) threadID);
+        out = appendField(out, end, "-", 1, body, digitsEnd - body, 0, 0);
+    } else {
+        body = formatDecimal(digitsEnd, (unsigned long long) threadID);
+        out = appendField(out, end, "", 0, body, digitsEnd - body, 0, 0);
+    }
+    out = appendField(out, end, " ", 1, file, strlen(file), 0, 0);
+    body = formatDecimal(digitsEnd, (unsigned long long) line);
+    return appendField(out, end, ":", 1, body, digitsEnd - body, 0, 0);
+}
+
+/* Format the line header with the context of the thread and return the end of it */
+static char* formatHeader(char* buf, const char* end, char levelc, const char* timestamp, long threadID,
+        const char* file, int line)
+{
+    char* out = formatPrefix(buf, end, levelc, timestamp, threadID, file, line);
+
+    return appendField(out, end, ": ", 2, t_context, t_contextLen, 0, 0);
+}
+
+/* Format the message truncated before the end, which must be followed by a byte, and return the end of it */
+static char* formatText(char* out, const char* end, const char* fmt, va_list arg)
+{
+    va_list copy;
+    int n;
+
+    va_copy(copy, arg);
+    n = formatMessage(out, end - out, fmt, copy);
+    va_end(copy);
+    if (n >= 0) {
+        return out + n;
+    }
+    /* vsnprintf needs room for NUL, which then is overwritten by the following byte */
+    return out + clampLength(vsnprintf(out, end - out + 1, fmt, arg), end - out + 1);
+}
+
+/* Format a log line into the buffer. The line is truncated to fit and always ends with LF. */
+static size_t formatLine(char* buf, size_t size, char levelc, const char* timestamp, long threadID,
+        const char* file, int line, const char* fmt, va_list arg)
+{
+    const char* end = buf + size - 1; /* reserve a byte for LF */
+    char* out;
+
+    out = formatHeader(buf, end, levelc, timestamp, threadID, file, line);
+    out = formatText(out, end, fmt, arg);
+    *out++ = '\n';
+    return out - buf;
+}
+
+static int openShard(struct Shard* shard)
+{
+    struct stat st;
+
+    shard->generation = s_shardlog.generation;
+    sprintf(shard->filename, "%s.%ld", s_shardlog.filename, getCurrentThreadID());
+    if (!openOutput(&shard->output, shard->filename, &st)) {
+        return 0;
+    }
+    shard->currentFileSize = (long) st.st_size;
+    return 1;
+}
+
+static struct Shard* newShard(void)
+{
+    struct Shard* shard;
+
+    if ((shard = (struct Shard*) calloc(1, sizeof(struct Shard))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return NULL;
+    }
+    initMutex(&shard->mutex);
+    shard->output.fd = -1;
+    return shard;
+}
+
+/* Return the shard of the current thread, taking it from the pool on first use */
+static struct Shard* getShard(void)
+{
+    struct Shard* shard = t_shard;
+
+    if (shard != NULL) {
+        return shard;
+    }
+    lockMutex(&s_shardlog.mutex);
+    if ((shard = s_shardlog.freeShards) != NULL) {
+        s_shardlog.freeShards = shard->next;
+    }
+    unlockMutex(&s_shardlog.mutex);
+    if (shard == NULL) { /* more threads than the pool, which does not grow while logging */
+        return NULL;
+    }
+    shard->generation = -1; /* not opened yet */
+    lockMutex(&s_shardlog.mutex);
+    shard->next = s_shardlog.shards;
+    s_shardlog.shards = shard;
+    unlockMutex(&s_shardlog.mutex);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_setspecific(s_shardlog.key, shard);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    t_shard = shard;
+    return shard;
+}
+
+static void closeShard(void* arg)
+{
+    struct Shard* shard = (struct Shard*) arg;
+    struct Shard** p;
+
+    lockMutex(&shard->mutex);
+    closeOutput(&shard->output);
+    unlockMutex(&shard->mutex);
+    lockMutex(&s_shardlog.mutex);
+    for (p = &s_shardlog.shards; *p != NULL; p = &(*p)->next) {
+        if (*p == shard) {
+            *p = shard->next;
+            break;
+        }
+    }
+    shard->next = s_shardlog.freeShards; /* reused by the next thread */
+    s_shardlog.freeShards = shard;
+    unlockMutex(&s_shardlog.mutex);
+}
+
+/* Add to a counter shared between threads and return the previous value */
+static unsigned long addCount(volatile unsigned long* count, unsigned long n)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return (unsigned long) InterlockedExchangeAdd((volatile LONG*) count, (LONG) n);
+#else
+    return __sync_fetch_and_add(count, n);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+static void memoryBarrier(void)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+/* Wait a little in a spin loop, and give the CPU away after a while so that a preempted thread can go on */
+static void spinWait(int spins)
+{
+    if (spins < kSpinsBeforeYield) {
+#if defined(_WIN32) || defined(_WIN64)
+        YieldProcessor();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __asm__ __volatile__("pause");
+#elif defined(__GNUC__) && defined(__aarch64__)
+        __asm__ __volatile__("yield");
+#endif /* defined(_WIN32) || defined(_WIN64) */
+        return;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+static unsigned long nextSequence(void)
+{
+    return addCount(&s_sequence, 1);
+}
+
+/* Write a line prefixed with a sequence number to the shard of the current thread */
+static void writeShard(const char* buf, size_t len, long currentTime)
+{
+    struct Shard* shard;
+    char digits[24];
+    char* digitsEnd = &digits[sizeof(digits)];
+    char* prefix;
+
+    if ((shard = getShard()) == NULL) {
+        if (addCount(&s_shardlog.dropped, 1) == 0) {
+            fprintf(stderr, "ERROR: logger: More threads than shards, lines are dropped\n");
+        }
+        return;
+    }
+    lockMutex(&shard->mutex);
+    if (shard->generation != s_shardlog.generation
+            || shard->currentFileSize >= s_shardlog.maxFileSize) {
+        closeOutput(&shard->output);
+        if (shard->generation == s_shardlog.generation) {
+            renameBackupFiles(shard->filename, s_shardlog.maxBackupFiles);
+        }
+        openShard(shard);
+    }
+    if (shard->output.fd >= 0) {
+        *--digitsEnd = ' ';
+        prefix = formatDecimal(digitsEnd, nextSequence());
+        shard->currentFileSize += writeOutput(&shard->output, prefix, &digits[sizeof(digits)] - prefix);
+        shard->currentFileSize += writeOutput(&shard->output, buf, len);
+        autoFlushOutput(&shard->output, currentTime, &shard->flushedTime);
+    }
+    unlockMutex(&shard->mutex);
+}
+
+static long writeShardData(void* unused, const char* data, size_t len)
+{
+    writeShard(data, len, 0);
+    return (long) len;
+}
+
+void logger_setShardPoolSize(int threads)
+{
+    init();
+    lockMutex(&s_shardlog.mutex);
+    s_shardlog.poolSize = (threads > 0) ? threads : 0;
+    unlockMutex(&s_shardlog.mutex);
+}
+
+int logger_initShardedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+{
+    struct Shard* shard;
+    int poolSize;
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+
+    init();
+    lock();
+    lockMutex(&s_shardlog.mutex);
+    poolSize = (s_shardlog.poolSize > 0) ? s_shardlog.poolSize : kDefaultShardPoolSize;
+    for (; s_shardlog.allocated < poolSize && (shard = newShard()) != NULL; s_shardlog.allocated++) {
+        shard->next = s_shardlog.freeShards;
+        s_shardlog.freeShards = shard;
+    }
+    unlockMutex(&s_shardlog.mutex);
+    strncpy(s_shardlog.filename, filename, kMaxFileNameLen - 1);
+    s_shardlog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
+    s_shardlog.maxBackupFiles = maxBackupFiles;
+    s_shardlog.generation++; /* threads reopen their shards */
+    s_logger |= kShardLogger;
+    unlock();
+    return 1;
+}
+
+#if defined(LOGGER_COMPRESSION)
+static int openCompressedOutput(void)
+{
+    struct stat st;
+
+    if (!openOutput(&s_zlog.output, s_zlog.filename, &st)) {
+        return 0;
+    }
+    s_zlog.currentFileSize = (long) st.st_size;
+    return 1;
+}
+
+static void putUint32(unsigned char* p, unsigned long value)
+{
+    p[0] = (unsigned char) (value >> 24);
+    p[1] = (unsigned char) (value >> 16);
+    p[2] = (unsigned char) (value >> 8);
+    p[3] = (unsigned char) value;
+}
+
+/*
+ * Compress a block into an independent frame and append it to the file.
+ * The stream is reset instead of reinitialized so that it does not allocate.
+ */
+static void writeFrame(const char* data, size_t len)
+{
+    unsigned char* frame = s_zlog.frame;
+    z_stream* stream = &s_zlog.stream;
+    unsigned long compressedLen;
+
+    deflateReset(stream);
+    stream->next_in = (Bytef*) data;
+    stream->avail_in = (uInt) len;
+    stream->next_out = &frame[kFrameHeaderSize];
+    stream->avail_out = (uInt) (s_zlog.frameSize - kFrameHeaderSize);
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        fprintf(stderr, "ERROR: logger: Failed to compress %lu bytes\n", (unsigned long) len);
+        return;
+    }
+    compressedLen = (unsigned long) stream->total_out;
+    memcpy(frame, kFrameMagic, sizeof(kFrameMagic));
+    putUint32(&frame[4], compressedLen);
+    putUint32(&frame[8], (unsigned long) len);
+    if (s_zlog.output.fd < 0 || s_zlog.currentFileSize >= s_zlog.maxFileSize) {
+        if (s_zlog.output.fd >= 0) {
+            closeOutput(&s_zlog.output);
+            renameBackupFiles(s_zlog.filename, s_zlog.maxBackupFiles);
+        }
+        if (!openCompressedOutput()) {
+            return;
+        }
+    }
+    /* a crash loses at most the block in memory */
+    s_zlog.currentFileSize += writeOutput(&s_zlog.output, (const char*) frame, kFrameHeaderSize + compressedLen);
+    flushOutput(&s_zlog.output);
+}
+
+static void* runCompressor(void* unused)
+{
+    const char* data;
+    size_t len;
+
+    lock();
+    for (;;) {
+        while (s_zlog.pendingLen == 0 && s_zlog.running) {
+            pthread_cond_wait(&s_zlog.ready, &s_mutex);
+        }
+        if (s_zlog.pendingLen == 0) {
+            break; /* stopped and drained */
+        }
+        data = s_zlog.pending;
+        len = s_zlog.pendingLen;
+        unlock();
+        writeFrame(data, len);
+        lock();
+        s_zlog.pendingLen = 0;
+        pthread_cond_broadcast(&s_zlog.done);
+    }
+    unlock();
+    return NULL;
+}
+
+/* Hand the filled block off to the compressor thread. The lock must be held. */
+static void handOffBlock(void)
+{
+    char* block;
+
+    if (s_zlog.blockLen == 0) {
+        return;
+    }
+    while (s_zlog.pendingLen != 0) {
+        pthread_cond_wait(&s_zlog.done, &s_mutex);
+    }
+    block = s_zlog.pending;
+    s_zlog.pending = s_zlog.block;
+    s_zlog.pendingLen = s_zlog.blockLen;
+    s_zlog.block = block;
+    s_zlog.blockLen = 0;
+    pthread_cond_signal(&s_zlog.ready);
+}
+
+/* Copy data into the block. The lock must be held. */
+static void writeCompressed(const char* data, size_t len, long currentTime)
+{
+    size_t n;
+
+    if (s_zlog.blockLen + len > kCompressedBlockSize) {
+        handOffBlock(); /* keep the line in one frame */
+    }
+    while (len > 0) {
+        n = kCompressedBlockSize - s_zlog.blockLen;
+        n = (len < n) ? len : n;
+        memcpy(&s_zlog.block[s_zlog.blockLen], data, n);
+        s_zlog.blockLen += n;
+        data += n;
+        len -= n;
+        if (s_zlog.blockLen == kCompressedBlockSize) {
+            handOffBlock();
+        }
+    }
+    if (s_flushInterval > 0 && currentTime - s_zlog.handedTime > s_flushInterval) {
+        if (s_zlog.pendingLen == 0) {
+            handOffBlock(); /* without waiting */
+        }
+        s_zlog.handedTime = currentTime;
+    }
+}
+
+static long writeCompressedData(void* unused, const char* data, size_t len)
+{
+    writeCompressed(data, len, 0);
+    return (long) len;
+}
+
+/* Wait until everything written so far is in the file. The lock must be held. */
+static void flushCompressed(void)
+{
+    handOffBlock();
+    while (s_zlog.pendingLen != 0) {
+        pthread_cond_wait(&s_zlog.done, &s_mutex);
+    }
+}
+
+/* Drain and stop the compressor thread. The lock must be held. */
+static void stopCompressor(void)
+{
+    if (!s_zlog.running) {
+        return;
+    }
+    flushCompressed();
+    s_zlog.running = 0; /* false */
+    pthread_cond_signal(&s_zlog.ready);
+    unlock();
+    pthread_join(s_zlog.thread, NULL);
+    lock();
+    closeOutput(&s_zlog.output);
+}
+
+static void exitCompressor(void)
+{
+    lock();
+    stopCompressor();
+    s_logger &= ~kCompressedLogger;
+    unlock();
+}
+#endif /* defined(LOGGER_COMPRESSION) */
+
+int logger_initCompressedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles)
+{
+#if defined(LOGGER_COMPRESSION)
+    int ok = 0; /* false */
+#endif /* defined(LOGGER_COMPRESSION) */
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+#if !defined(LOGGER_COMPRESSION)
+    fprintf(stderr, "ERROR: logger: Compressed file logger is not supported: `%s`\n", filename);
+    return 0;
+#else
+    init();
+    lock();
+    stopCompressor(); /* reinit */
+    s_logger &= ~kCompressedLogger;
+    if (!s_zlog.initialized) {
+        /* everything the compressor thread needs is allocated here */
+        if (deflateInit(&s_zlog.stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            fprintf(stderr, "ERROR: logger: Out of memory\n");
+            goto cleanup;
+        }
+        s_zlog.frameSize = kFrameHeaderSize + deflateBound(&s_zlog.stream, kCompressedBlockSize);
+        s_zlog.frame = (unsigned char*) malloc(s_zlog.frameSize);
+        s_zlog.block = (char*) malloc(kCompressedBlockSize);
+        s_zlog.pending = (char*) malloc(kCompressedBlockSize);
+        if (s_zlog.frame == NULL || s_zlog.block == NULL || s_zlog.pending == NULL) {
+            fprintf(stderr, "ERROR: logger: Out of memory\n");
+            deflateEnd(&s_zlog.stream);
+            free(s_zlog.frame);
+            free(s_zlog.block);
+            free(s_zlog.pending);
+            s_zlog.frame = NULL;
+            s_zlog.block = s_zlog.pending = NULL;
+            goto cleanup;
+        }
+        pthread_cond_init(&s_zlog.ready, NULL);
+        pthread_cond_init(&s_zlog.done, NULL);
+        atexit(exitCompressor);
+        s_zlog.initialized = 1; /* true */
+    }
+    strncpy(s_zlog.filename, filename, kMaxFileNameLen - 1);
+    s_zlog.maxFileSize = (maxFileSize > 0) ? maxFileSize : kDefaultMaxFileSize;
+    s_zlog.maxBackupFiles = maxBackupFiles;
+    if (!openCompressedOutput()) {
+        goto cleanup;
+    }
+    s_zlog.running = 1; /* true */
+    if (pthread_create(&s_zlog.thread, NULL, runCompressor, NULL) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to start the compressor thread\n");
+        s_zlog.running = 0; /* false */
+        closeOutput(&s_zlog.output);
+        goto cleanup;
+    }
+    s_logger |= kCompressedLogger;
+    ok = 1; /* true */
+cleanup:
+    unlock();
+    return ok;
+#endif /* !defined(LOGGER_COMPRESSION) */
+}
+
+static int initRing(struct Ring* ring, size_t size)
+{
+    free(ring->buffer);
+    memset(ring, 0, sizeof(*ring));
+    if (size == 0) {
+        return 1;
+    }
+    if ((ring->buffer = (char*) malloc(size)) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return 0;
+    }
+    ring->size = size;
+    return 1;
+}
+
+static void writeRing(struct Ring* ring, const char* data, size_t len)
+{
+    size_t n;
+
+    if (ring->buffer == NULL || len > ring->size) {
+        return;
+    }
+    if (!ring->wrapped && ring->head + len == ring->size) {
+        ring->aligned = 1; /* true, the oldest byte is the first one written */
+    } else {
+        ring->aligned = ring->buffer[(ring->head + len + ring->size - 1) % ring->size] == '\n';
+    }
+    n = ring->size - ring->head;
+    if (len < n) {
+        memcpy(&ring->buffer[ring->head], data, len);
+        ring->head += len;
+    } else {
+        memcpy(&ring->buffer[ring->head], data, n);
+        memcpy(ring->buffer, &data[n], len - n);
+        ring->head = len - n;
+        ring->wrapped = 1; /* true */
+    }
+}
+
+static long writeFile(void* fp, const char* data, size_t len)
+{
+    return (long) fwrite(data, 1, len, (FILE*) fp);
+}
+
+/* Take the buffered lines from oldest to newest in up to 2 segments and empty the ring */
+static int takeRing(struct Ring* ring, struct iovec* segments)
+{
+    const char* begin;
+    const char* end;
+    const char* rest;
+    const char* lf;
+    int n = 0;
+
+    if (ring->buffer == NULL) {
+        return 0;
+    }
+    rest = ring->buffer;
+    if (ring->wrapped) {
+        begin = &ring->buffer[ring->head];
+        end = &ring->buffer[ring->size];
+        if (!ring->aligned) { /* skip the partially overwritten line */
+            if ((lf = (const char*) memchr(begin, '\n', end - begin)) != NULL) {
+                begin = lf + 1;
+            } else {
+                lf = (const char*) memchr(ring->buffer, '\n', ring->head);
+                begin = end = &ring->buffer[ring->size];
+                rest = (lf != NULL) ? lf + 1 : &ring->buffer[ring->head];
+            }
+        }
+        segments[n].iov_base = (void*) begin;
+        segments[n].iov_len = end - begin;
+        n++;
+    }
+    segments[n].iov_base = (void*) rest;
+    segments[n].iov_len = &ring->buffer[ring->head] - rest;
+    n++;
+    ring->head = 0;
+    ring->wrapped = 0; /* false */
+    return n;
+}
+
+/* Write the buffered lines from oldest to newest and empty the ring */
+static long dumpRing(struct Ring* ring, long (*write)(void*, const char*, size_t), void* arg)
+{
+    struct iovec segments[2];
+    long totalsize = 0;
+    int n, i;
+
+    n = takeRing(ring, segments);
+    for (i = 0; i < n; i++) {
+        totalsize += write(arg, (const char*) segments[i].iov_base, segments[i].iov_len);
+    }
+    return totalsize;
+}
+
+/* Write the ring to the file logger, with one append to a shared file so that no line of another process lands in between */
+static void dumpRingToFileLogger(struct Ring* ring)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct iovec segments[2];
+    off_t end;
+    int n;
+
+    if (s_flog.shared) {
+        if ((n = takeRing(ring, segments)) > 0 && writev(s_flog.output.fd, segments, n) >= 0
+                && (end = lseek(s_flog.output.fd, 0, SEEK_CUR)) >= 0) {
+            s_flog.currentFileSize = (long) end;
+        }
+        return;
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    dumpRing(ring, writeFileLogger, NULL);
+}
+
+int logger_initFlightRecorder(size_t size, enum LogLevel level)
+{
+    int ok;
+
+    init();
+    lock();
+    ok = initRing(&s_recorder.ring, size);
+    s_recorder.level = level;
+    unlock();
+    clearLevelCaches();
+    return ok;
+}
+
+static long writeShmData(void* shm, const char* data, size_t len);
+static long writeSinkData(void* unused, const char* data, size_t len);
+
+static void dumpFlightRecorder(void)
+{
+    if (s_recorder.ring.buffer == NULL) {
+        return;
+    }
+    if (hasFlag(s_logger, kFileLogger)) {
+        if (rotateLogFiles()) {
+            dumpRingToFileLogger(&s_recorder.ring);
+        }
+    } else if (hasFlag(s_logger, kConsoleLogger)) {
+        dumpRing(&s_recorder.ring, writeFile, s_clog.output);
+    } else if (hasFlag(s_logger, kShmLogger)) {
+        dumpRing(&s_recorder.ring, writeShmData, &s_shm);
+    } else if (hasFlag(s_logger, kShardLogger)) {
+        dumpRing(&s_recorder.ring, writeShardData, NULL);
+#if defined(LOGGER_COMPRESSION)
+    } else if (hasFlag(s_logger, kCompressedLogger)) {
+        dumpRing(&s_recorder.ring, writeCompressedData, NULL);
+#endif /* defined(LOGGER_COMPRESSION) */
+    } else if (hasFlag(s_logger, kSinkLogger)) {
+        dumpRing(&s_recorder.ring, writeSinkData, NULL);
+    }
+}
+
+void logger_dumpFlightRecorder(void)
+{
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    lock();
+    dumpFlightRecorder();
+    unlock();
+}
+
+static long getCurrentTime(void)
+{
+    struct LogTime now;
+
+    getTime(&now);
+    return (long) now.sec * 1000 + now.nsec / 1000000;
+}
+
+int logger_initSiteProfile(size_t maxSites, int topN, long dumpInterval)
+{
+    size_t size = 1;
+    int ok = 1; /* true */
+
+    init();
+    lockMutex(&s_profile.mutex);
+    free(s_profile.sites);
+    free(s_profile.top);
+    s_profile.sites = NULL;
+    s_profile.top = NULL;
+    s_profile.dropped = 0;
+    s_profile.nsites = 0;
+    if (maxSites > 0) {
+        while (size < maxSites * 2) { /* keep probe sequences short */
+            size *= 2;
+        }
+        s_profile.topN = topN > 0 ? topN : 1;
+        s_profile.top = (struct SiteCount*) malloc(s_profile.topN * sizeof(struct SiteCount));
+        s_profile.sites = (struct Site*) calloc(size, sizeof(struct Site));
+        if (s_profile.sites == NULL || s_profile.top == NULL) {
+            fprintf(stderr, "ERROR: logger: Out of memory\n");
+            free(s_profile.sites);
+            free(s_profile.top);
+            s_profile.sites = NULL;
+            s_profile.top = NULL;
+            ok = 0; /* false */
+        }
+        s_profile.size = size;
+        s_profile.maxSites = maxSites;
+        s_profile.dumpInterval = dumpInterval > 0 ? dumpInterval : 0;
+        s_profile.dumpedTime = getCurrentTime();
+    }
+    unlockMutex(&s_profile.mutex);
+    return ok;
+}
+
+static int claimSite(struct Site* site, const char* file)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return InterlockedCompareExchangePointer((PVOID volatile*) &site->file, (PVOID) file, NULL) == NULL;
+#else
+    return __sync_bool_compare_and_swap(&site->file, (const char*) NULL, file);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+static void publishSite(struct Site* site)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    site->claimed = 1; /* true */
+}
+
+/* Find the slot of a call site without a lock, claiming a free one. Return NULL if the table is full. */
+static struct Site* findSite(const char* file, int line)
+{
+    size_t mask = s_profile.size - 1;
+    size_t i = (((size_t) file >> 3) ^ ((size_t) line * 2654435761UL)) & mask;
+    size_t n;
+    struct Site* site;
+    int spins;
+
+    for (n = 0; n <= mask; n++, i = (i + 1) & mask) {
+        site = &s_profile.sites[i];
+        if (site->file == NULL) {
+            if (s_profile.nsites >= s_profile.maxSites) {
+                return NULL; /* may be exceeded by threads claiming at the same time */
+            }
+            if (claimSite(site, file)) {
+                addCount(&s_profile.nsites, 1);
+                site->line = line;
+                publishSite(site);
+                return site;
+            }
+        }
+        for (spins = 0; !site->claimed; spins++) {
+            spinWait(spins); /* another thread is setting the line of the slot it has just claimed */
+        }
+        if (site->file == file && site->line == line) {
+            return site;
+        }
+    }
+    return NULL;
+}
+
+/* Print the top sites by bytes with their rates since the previous dump */
+static void dumpSiteProfile(FILE* output, long currentTime)
+{
+    struct SiteCount* top = s_profile.top;
+    struct SiteCount count;
+    struct Site* site;
+    double seconds = (currentTime - s_profile.dumpedTime) / 1000.0;
+    size_t nsites = 0;
+    size_t i;
+    int ntop = 0;
+    int j;
+
+    if (seconds <= 0.0) {
+        seconds = 0.001;
+    }
+    for (i = 0; i < s_profile.size; i++) {
+        site = &s_profile.sites[i];
+        if (!site->claimed) {
+            continue;
+        }
+        nsites++;
+        count.site = site;
+        count.messages = site->messages;
+        count.bytes = site->bytes;
+        count.newMessages = count.messages - site->dumpedMessages;
+        count.newBytes = count.bytes - site->dumpedBytes;
+        site->dumpedMessages = count.messages;
+        site->dumpedBytes = count.bytes;
+        if (ntop == s_profile.topN && top[ntop - 1].bytes >= count.bytes) {
+            continue;
+        }
+        /* insert in descending order of bytes */
+        j = (ntop < s_profile.topN) ? ntop++ : ntop - 1;
+        for (; j > 0 && top[j - 1].bytes < count.bytes; j--) {
+            top[j] = top[j - 1];
+        }
+        top[j] = count;
+    }
+    fprintf(output, "site profile: %lu sites, %lu dropped messages, %.1f s since the previous dump\n",
+            (unsigned long) nsites, s_profile.dropped, seconds);
+    fprintf(output, "%12s %14s %12s %14s  %s\n", "messages", "bytes", "messages/s", "bytes/s", "site");
+    for (j = 0; j < ntop; j++) {
+        fprintf(output, "%12lu %14lu %12.1f %14.1f  %s:%d\n", top[j].messages, top[j].bytes,
+                top[j].newMessages / seconds, top[j].newBytes / seconds, top[j].site->file, top[j].site->line);
+    }
+    fflush(output);
+    s_profile.dumpedTime = currentTime;
+}
+
+void logger_dumpSiteProfile(FILE* output)
+{
+    init();
+    lockMutex(&s_profile.mutex);
+    if (s_profile.sites != NULL) {
+        dumpSiteProfile(output != NULL ? output : stderr, getCurrentTime());
+    }
+    unlockMutex(&s_profile.mutex);
+}
+
+/* Count a line logged from a call site, and dump the profile if it is time to */
+static void profileSite(enum LogLevel level, const char* file, int line, size_t len, long currentTime)
+{
+    struct Site* site;
+
+    if (s_profile.sites == NULL || !isLogged(level)) {
+        return; /* not profiling or kept by the flight recorder */
+    }
+    if ((site = findSite(file, line)) != NULL) {
+        addCount(&site->messages, 1);
+        addCount(&site->bytes, (unsigned long) len);
+    } else {
+        addCount(&s_profile.dropped, 1);
+    }
+    if (s_profile.dumpInterval > 0 && currentTime - s_profile.dumpedTime >= s_profile.dumpInterval) {
+        lockMutex(&s_profile.mutex);
+        if (s_profile.sites != NULL && currentTime - s_profile.dumpedTime >= s_profile.dumpInterval) {
+            dumpSiteProfile(stderr, currentTime);
+        }
+        unlockMutex(&s_profile.mutex);
+    }
+}
+
+/* Return the histogram bucket of a value */
+static int getMetricBucket(long value)
+{
+    unsigned long v = (value > 0) ? (unsigned long) value : 0;
+    int e;
+
+    if (v < 16) {
+        return (int) v;
+    }
+#if defined(__GNUC__)
+    e = (int) (sizeof(v) * 8 - 1) - __builtin_clzl(v);
+#else
+    for (e = 4; (v >> e) > 1; e++) {
+    }
+#endif /* defined(__GNUC__) */
+    return 16 + (e - 4) * 8 + (int) ((v >> (e - 3)) & 7);
+}
+
+/* Return the value in the middle of a histogram bucket */
+static unsigned long getMetricBucketValue(int bucket)
+{
+    int e = (bucket - 16) / 8 + 4;
+
+    if (bucket < 16) {
+        return (unsigned long) bucket;
+    }
+    return (1UL << e) + (unsigned long) ((bucket - 16) % 8) * (1UL << (e - 3)) + (1UL << (e - 3)) / 2;
+}
+
+/* Return the value below which the fraction of the counted values are, within the minimum and the maximum */
+static long getMetricPercentile(const unsigned long* buckets, unsigned long count, double fraction,
+        long min, long max)
+{
+    unsigned long rank = (unsigned long) (fraction * count);
+    unsigned long seen = 0;
+    unsigned long value;
+    int i;
+
+    for (i = 0; i < kMetricBuckets - 1; i++) {
+        if ((seen += buckets[i]) > rank) {
+            break;
+        }
+    }
+    value = getMetricBucketValue(i);
+    if (max < 0 || value > (unsigned long) max) {
+        return max;
+    }
+    return ((long) value < min) ? min : (long) value;
+}
+
+static void exitMetrics(void* thread)
+{
+    t_metricThread = NULL; /* a later destructor that adds gets metrics of its own */
+    memoryBarrier();
+    ((struct MetricThread*) thread)->exited = 1; /* true, freed by the next emission */
+}
+
+static struct MetricThread* newMetricThread(void)
+{
+    struct MetricThread* thread;
+
+    if ((thread = (struct MetricThread*) calloc(1, sizeof(struct MetricThread))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return NULL;
+    }
+    thread->additions = kMetricCheckInterval;
+    lockMutex(&s_metrics.mutex);
+    thread->next = s_metrics.threads;
+    s_metrics.threads = thread;
+    unlockMutex(&s_metrics.mutex);
+#if !defined(_WIN32) && !defined(_WIN64)
+    pthread_setspecific(s_metrics.key, thread);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    t_metricThread = thread;
+    return thread;
+}
+
+/* Allocate both halves of the values of a metric for a thread */
+static struct MetricValues* newMetricValues(struct MetricThread* thread, int id)
+{
+    struct MetricValues* values;
+    size_t buckets = s_metrics.metrics[id].histogram ? kMetricBuckets : 0;
+    int h;
+
+    values = (struct MetricValues*) calloc(1, 2 * (sizeof(struct MetricValues) + buckets * sizeof(unsigned long)));
+    if (values == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return NULL;
+    }
+    for (h = 0; h < 2; h++) {
+        values[h].min = LONG_MAX;
+        values[h].max = LONG_MIN;
+        values[h].buckets = (buckets > 0) ? (unsigned long*) &values[2] + h * buckets : NULL;
+    }
+    memoryBarrier(); /* initialized before the emitter can see them */
+    thread->values[id] = values;
+    return values;
+}
+
+/* Find or register a metric by its name, returning its index or -1 if there is no room */
+static int registerMetric(const char* name, int histogram, const char* file, int line)
+{
+    struct Metric* metric;
+    int i;
+
+    lockMutex(&s_metrics.mutex);
+    for (i = 0; i < s_metrics.count && strcmp(s_metrics.metrics[i].name, name) != 0; i++) {
+    }
+    if (i == s_metrics.count) {
+        if (i == kMaxMetrics || strlen(name) >= kMaxMetricNameLen) {
+            fprintf(stderr, "ERROR: logger: Too many metrics or too long a name: `%s`\n", name);
+            i = -1;
+        } else {
+            metric = &s_metrics.metrics[i];
+            strcpy(metric->name, name);
+            metric->file = file;
+            metric->line = line;
+            metric->histogram = histogram;
+            s_metrics.count++;
+        }
+    }
+    unlockMutex(&s_metrics.mutex);
+    return i;
+}
+
+/* Add the values of a half to the totals and clear them */
+static void takeMetricValues(struct MetricValues* values, unsigned long* count, long* min, long* max)
+{
+    int i;
+
+    if (values->count == 0) {
+        return;
+    }
+    *count += values->count;
+    *min = (values->min < *min) ? values->min : *min;
+    *max = (values->max > *max) ? values->max : *max;
+    if (values->buckets != NULL) {
+        for (i = 0; i < kMetricBuckets; i++) {
+            s_metrics.buckets[i] += values->buckets[i];
+        }
+        memset(values->buckets, 0, kMetricBuckets * sizeof(unsigned long));
+    }
+    values->count = 0;
+    values->min = LONG_MAX;
+    values->max = LONG_MIN;
+}
+
+static void writeMetricLines(const char* buf, size_t len, int lines, long currentTime)
+{
+    if (isLogged(s_metrics.level)) {
+        writeLoggedLine(s_metrics.level, buf, len, lines, currentTime);
+    }
+}
+
+/* Write a line for each metric added to since the previous emission, which is done with the mutex */
+static void emitMetrics(long currentTime)
+{
+    struct MetricThread* thread;
+    struct MetricThread** p;
+    struct MetricValues* values;
+    struct Metric* metric;
+    struct LogTime now;
+    char chunk[kMaxMetrics * 256];
+    char text[256];
+    char timestamp[32];
+    double seconds = (currentTime - s_metrics.emittedTime) / 1000.0;
+    unsigned long half = s_metrics.epoch & 1;
+    unsigned long sequence;
+    unsigned long count;
+    long min, max;
+    size_t len = 0;
+    char* out;
+    int lines = 0;
+    int spins;
+    int i, h, n;
+
+    if (seconds <= 0.0) {
+        seconds = 0.001;
+    }
+    s_metrics.emittedTime = currentTime; /* before writing, which checks it */
+    addCount(&s_metrics.epoch, 1); /* the threads add to the other half from now */
+    for (thread = s_metrics.threads; thread != NULL; thread = thread->next) {
+        if ((sequence = thread->sequence) & 1) {
+            for (spins = 0; thread->sequence == sequence; spins++) {
+                spinWait(spins); /* until the thread has added to the half */
+            }
+        }
+    }
+    memoryBarrier();
+
+    getTime(&now);
+    getTimestamp(&now, timestamp, sizeof(timestamp));
+    for (i = 0; i < s_metrics.count; i++) {
+        metric = &s_metrics.metrics[i];
+        count = 0;
+        min = LONG_MAX;
+        max = LONG_MIN;
+        memset(s_metrics.buckets, 0, sizeof(s_metrics.buckets));
+        for (thread = s_metrics.threads; thread != NULL; thread = thread->next) {
+            if ((values = thread->values[i]) == NULL) {
+                continue;
+            }
+            for (h = 0; h < 2; h++) {
+                if (h == (int) half || thread->exited) {
+                    takeMetricValues(&values[h], &count, &min, &max);
+                }
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+        n = sprintf(text, "%s: count=%lu rate=%.1f/s", metric->name, count, count / seconds);
+        if (metric->histogram) {
+            sprintf(&text[n], " min=%ld p50=%ld p99=%ld max=%ld", min,
+                    getMetricPercentile(s_metrics.buckets, count, 0.50, min, max),
+                    getMetricPercentile(s_metrics.buckets, count, 0.99, min, max), max);
+        }
+        out = formatPrefix(&chunk[len], chunk + sizeof(chunk) - 1, getLevelChar(s_metrics.level), timestamp,
+                getCurrentThreadID(), metric->file, metric->line);
+        out = appendField(out, chunk + sizeof(chunk) - 1, ": ", 2, text, strlen(text), 0, 0);
+        *out++ = '\n';
+        len = out - chunk;
+        lines++;
+        if (sizeof(chunk) - len < 512) {
+            writeMetricLines(chunk, len, lines, currentTime);
+            len = 0;
+            lines = 0;
+        }
+    }
+    if (len > 0) {
+        writeMetricLines(chunk, len, lines, currentTime);
+    }
+
+    for (p = &s_metrics.threads; *p != NULL;) {
+        if ((thread = *p)->exited) {
+            *p = thread->next;
+            for (i = 0; i < kMaxMetrics; i++) {
+                free(thread->values[i]);
+            }
+            free(thread);
+        } else {
+            p = &thread->next;
+        }
+    }
+}
+
+static void emitMetricsIfDue(long currentTime)
+{
+    if (s_metrics.interval > 0 && currentTime - s_metrics.emittedTime >= s_metrics.interval
+            && tryLockMutex(&s_metrics.mutex)) {
+        if (s_metrics.interval > 0 && currentTime - s_metrics.emittedTime >= s_metrics.interval) {
+            emitMetrics(currentTime);
+        }
+        unlockMutex(&s_metrics.mutex);
+    }
+}
+
+void logger_initMetrics(long interval, enum LogLevel level)
+{
+    init();
+    lockMutex(&s_metrics.mutex);
+    s_metrics.level = level;
+    s_metrics.emittedTime = getCurrentTime();
+    s_metrics.interval = interval > 0 ? interval : 0;
+    unlockMutex(&s_metrics.mutex);
+}
+
+void logger_emitMetrics(void)
+{
+    init();
+    lockMutex(&s_metrics.mutex);
+    if (s_metrics.interval > 0) {
+        emitMetrics(getCurrentTime());
+    }
+    unlockMutex(&s_metrics.mutex);
+}
+
+void logger_addMetric(int* id, const char* name, int histogram, long value, const char* file, int line)
+{
+    struct MetricThread* thread = t_metricThread;
+    struct MetricValues* values;
+    int i = *id - 1;
+
+    if (s_metrics.interval <= 0) {
+        return;
+    }
+    if (i < 0) {
+        if (*id < 0 || (i = registerMetric(name, histogram, file, line)) < 0) {
+            *id = -1; /* no room */
+            return;
+        }
+        *id = i + 1;
+    }
+    if (thread == NULL && (thread = newMetricThread()) == NULL) {
+        return;
+    }
+    if ((values = thread->values[i]) == NULL && (values = newMetricValues(thread, i)) == NULL) {
+        return;
+    }
+    addCount(&thread->sequence, 1); /* odd, with a barrier before the epoch is read */
+    values = &values[s_metrics.epoch & 1];
+    values->count++;
+    values->min = (value < values->min) ? value : values->min;
+    values->max = (value > values->max) ? value : values->max;
+    if (values->buckets != NULL) {
+        values->buckets[getMetricBucket(value)]++;
+    }
+    addCount(&thread->sequence, 1); /* even */
+    if (--thread->additions <= 0) {
+        thread->additions = kMetricCheckInterval;
+        emitMetricsIfDue(getCurrentTime());
+    }
+}
+
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void lockShm(struct ShmHeader* header)
+{
+#ifdef __linux__
+    if (pthread_mutex_lock(&header->mutex) == EOWNERDEAD) {
+        pthread_mutex_consistent(&header->mutex); /* the owner died */
+    }
+#else
+    pthread_mutex_lock(&header->mutex);
+#endif /* __linux__ */
+}
+
+static int initShmHeader(struct ShmHeader* header, size_t size)
+{
+    pthread_mutexattr_t attr;
+
+    memset(header, 0, sizeof(*header));
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif /* __linux__ */
+    if (pthread_mutex_init(&header->mutex, &attr) != 0) {
+        pthread_mutexattr_destroy(&attr);
+        return 0;
+    }
+    pthread_mutexattr_destroy(&attr);
+    header->size = size;
+    memcpy(header->magic, kShmMagic, sizeof(header->magic));
+    return 1;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+static void detachShm(struct Shm* shm)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (shm->header != NULL) {
+        munmap(shm->header, shm->mapSize);
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    memset(shm, 0, sizeof(*shm));
+}
+
+/* Map the shared memory file, creating and initializing it if it is new */
+static int attachShm(struct Shm* shm, const char* filename, size_t size)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    fprintf(stderr, "ERROR: logger: Shared memory logger is not supported: `%s`\n", filename);
+    return 0;
+#else
+    int fd;
+    struct stat st;
+    void* addr;
+    struct ShmHeader* header;
+    int ok = 0; /* false */
+
+    detachShm(shm);
+    if ((fd = open(filename, O_RDWR | O_CREAT, 0644)) < 0) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", filename);
+        return 0;
+    }
+    flock(fd, LOCK_EX); /* serialize the initialization between processes */
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to stat file: `%s`\n", filename);
+        goto cleanup;
+    }
+    if (st.st_size == 0) {
+        st.st_size = sizeof(struct ShmHeader) + ((size > 0) ? size : kDefaultShmSize);
+        if (ftruncate(fd, st.st_size) != 0) {
+            fprintf(stderr, "ERROR: logger: Failed to resize file: `%s`\n", filename);
+            goto cleanup;
+        }
+    }
+    if ((size_t) st.st_size <= sizeof(struct ShmHeader)) {
+        fprintf(stderr, "ERROR: logger: Invalid shared memory file: `%s`\n", filename);
+        goto cleanup;
+    }
+    addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "ERROR: logger: Failed to map file: `%s`\n", filename);
+        goto cleanup;
+    }
+    header = (struct ShmHeader*) addr;
+    if (header->magic[0] == '\0') { /* created but not initialized yet */
+        if (!initShmHeader(header, st.st_size - sizeof(struct ShmHeader))) {
+            fprintf(stderr, "ERROR: logger: Failed to initialize file: `%s`\n", filename);
+            munmap(addr, st.st_size);
+            goto cleanup;
+        }
+    }
+    if (memcmp(header->magic, kShmMagic, sizeof(header->magic)) != 0
+            || header->size > st.st_size - sizeof(struct ShmHeader)) {
+        fprintf(stderr, "ERROR: logger: Invalid shared memory file: `%s`\n", filename);
+        munmap(addr, st.st_size);
+        goto cleanup;
+    }
+    shm->header = header;
+    shm->data = (char*) addr + sizeof(struct ShmHeader);
+    shm->mapSize = st.st_size;
+    ok = 1; /* true */
+cleanup:
+    flock(fd, LOCK_UN); /* the mapping keeps the open file alive */
+    close(fd);
+    return ok;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+/* Append a whole line to the ring, or drop it if the ring is full */
+static void writeShm(struct Shm* shm, const char* data, size_t len)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct ShmHeader* header = shm->header;
+    unsigned long pos, n;
+
+    if (header == NULL) {
+        return;
+    }
+    lockShm(header);
+    if (header->size - (header->writePos - header->readPos) < len) {
+        header->dropped++;
+    } else {
+        pos = header->writePos % header->size;
+        n = header->size - pos;
+        if (len <= n) {
+            memcpy(&shm->data[pos], data, len);
+        } else {
+            memcpy(&shm->data[pos], data, n);
+            memcpy(shm->data, &data[n], len - n);
+        }
+        header->writePos += len;
+    }
+    pthread_mutex_unlock(&header->mutex);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+static long writeShmData(void* shm, const char* data, size_t len)
+{
+    writeShm((struct Shm*) shm, data, len);
+    return (long) len;
+}
+
+/* Take whole lines out of the ring */
+static size_t readShm(struct Shm* shm, char* buf, size_t size, unsigned long* dropped)
+{
+    size_t len = 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct ShmHeader* header = shm->header;
+    unsigned long pos, n;
+    char* lf;
+
+    lockShm(header);
+    len = header->writePos - header->readPos;
+    len = (len < size) ? len : size;
+    pos = header->readPos % header->size;
+    n = header->size - pos;
+    if (len <= n) {
+        memcpy(buf, &shm->data[pos], len);
+    } else {
+        memcpy(buf, &shm->data[pos], n);
+        memcpy(&buf[n], shm->data, len - n);
+    }
+    /* lines are written whole, so only a truncated read ends in the middle of one */
+    if (len > 0 && buf[len - 1] != '\n') {
+        for (lf = &buf[len - 1]; lf > buf && *lf != '\n'; lf--) {}
+        len = (*lf == '\n') ? (size_t) (lf - buf + 1) : 0;
+    }
+    header->readPos += len;
+    *dropped = header->dropped;
+    header->dropped = 0;
+    pthread_mutex_unlock(&header->mutex);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    return len;
+}
+
+int logger_initShmLogger(const char* filename, size_t size)
+{
+    int ok = 0; /* false */
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+
+    init();
+    lock();
+    if (attachShm(&s_shm, filename, size)) {
+        s_logger |= kShmLogger;
+        ok = 1; /* true */
+    }
+    unlock();
+    return ok;
+}
+
+long logger_collectShmLogger(const char* filename, size_t size)
+{
+    char buf[kShmChunkSize];
+    size_t len;
+    unsigned long dropped;
+
+    if (filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return -1;
+    }
+    if (!hasFlag(s_logger, kFileLogger) || !s_initialized) {
+        assert(0 && "file logger is not initialized");
+        return -1;
+    }
+
+    if (s_shmCollector.header == NULL) {
+        lock();
+        if (s_shmCollector.header == NULL && !attachShm(&s_shmCollector, filename, size)) {
+            unlock();
+            return -1;
+        }
+        unlock();
+    }
+    len = readShm(&s_shmCollector, buf, sizeof(buf), &dropped);
+    if (len > 0) {
+        lock();
+        if (rotateLogFiles()) {
+            indexFileLogger(buf, len);
+            writeFileLogger(NULL, buf, len);
+        }
+        unlock();
+    }
+    if (dropped > 0) {
+        logger_log(LogLevel_WARN, __FILENAME__, __LINE__,
+                "logger: %lu messages dropped by shared memory loggers", dropped);
+    }
+    return (long) len;
+}
+
+/* Add a sink that delivers the lines of the level range, and return its ID or 0 on error */
+static int addSink(const struct LogSink* sink, enum LogLevel level, enum LogLevel maxLevel, size_t size,
+        int autoFlush, long flushInterval, void (*wait)(void*))
+{
+    struct Sink* newSink;
+    int id = 0;
+    int i;
+
+    init();
+    lock();
+    for (i = 0; i < kMaxSinks && s_sinks.sinks[i] != NULL; i++) {
+    }
+    if (i == kMaxSinks) {
+        fprintf(stderr, "ERROR: logger: Too many sinks\n");
+    } else if ((newSink = (struct Sink*) calloc(1, sizeof(struct Sink) + size)) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+    } else {
+        newSink->sink = *sink;
+        newSink->level = level;
+        newSink->maxLevel = maxLevel;
+        newSink->autoFlush = autoFlush;
+        newSink->flushInterval = flushInterval;
+        newSink->wait = wait;
+        newSink->buffer = (char*) (newSink + 1);
+        newSink->size = size;
+        newSink->id = id = ++s_sinks.lastID;
+        s_sinks.sinks[i] = newSink;
+        s_logger |= kSinkLogger;
+    }
+    unlock();
+    return id;
+}
+
+int logger_addSink(const struct LogSink* sink, enum LogLevel minLevel, enum LogLevel maxLevel)
+{
+    if (sink == NULL || sink->writeBatch == NULL) {
+        assert(0 && "writeBatch must not be NULL");
+        return 0;
+    }
+    return addSink(sink, minLevel, maxLevel, kOutputBufferSize, 1, 0, NULL);
+}
+
+static int openFileSink(struct FileSink* file)
+{
+    struct stat st;
+
+    if ((file->fd = open(file->filename, O_WRONLY | O_APPEND | O_CREAT, 0644)) < 0
+            || fstat(file->fd, &st) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", file->filename);
+        if (file->fd >= 0) {
+            close(file->fd);
+            file->fd = -1;
+        }
+        return 0;
+    }
+    file->currentFileSize = (long) st.st_size;
+    return 1;
+}
+
+#if defined(LOGGER_IO_URING)
+static int uringSetup(unsigned entries, struct io_uring_params* params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(struct Uring* ring, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, ring->fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(struct Uring* ring, unsigned opcode, void* arg, unsigned n)
+{
+    return (int) syscall(__NR_io_uring_register, ring->fd, opcode, arg, n);
+}
+
+static void* mapUring(struct Uring* ring, size_t size, long offset)
+{
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, offset);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+static void closeUring(struct Uring* ring)
+{
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != NULL) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd); /* cancels what is in flight, so drain it before */
+    }
+    free(ring->memory);
+    free(ring);
+}
+
+/* Set up a ring with a write and an fsync for each buffer, or return NULL if the kernel has no io_uring */
+static struct Uring* openUring(size_t bufferSize, int sqpoll)
+{
+    struct io_uring_params params;
+    struct Uring* ring;
+    int i;
+
+    if ((ring = (struct Uring*) calloc(1, sizeof(struct Uring))) == NULL) {
+        return NULL;
+    }
+    memset(&params, 0, sizeof(params));
+    if (sqpoll) {
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 1000; /* msec */
+    }
+    if ((ring->fd = uringSetup(2 * kUringBuffers, &params)) < 0 && sqpoll) {
+        /* not permitted to this process, so submit with system calls */
+        memset(&params, 0, sizeof(params));
+        ring->fd = uringSetup(2 * kUringBuffers, &params);
+    }
+    if (ring->fd < 0) {
+        closeUring(ring);
+        return NULL;
+    }
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+        closeUring(ring); /* cannot append at the file position before 5.6 */
+        return NULL;
+    }
+    ring->sqpoll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+#if defined(IORING_FEAT_SINGLE_MMAP)
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+#endif /* defined(IORING_FEAT_SINGLE_MMAP) */
+    if ((ring->sqRing = mapUring(ring, ring->sqRingSize, IORING_OFF_SQ_RING)) == NULL) {
+        closeUring(ring);
+        return NULL;
+    }
+#if defined(IORING_FEAT_SINGLE_MMAP)
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    }
+#endif /* defined(IORING_FEAT_SINGLE_MMAP) */
+    if ((ring->cqRing == NULL && (ring->cqRing = mapUring(ring, ring->cqRingSize, IORING_OFF_CQ_RING)) == NULL)
+            || (ring->sqes = (struct io_uring_sqe*) mapUring(ring, ring->sqesSize, IORING_OFF_SQES)) == NULL
+            || (ring->memory = (char*) malloc(kUringBuffers * bufferSize)) == NULL) {
+        closeUring(ring);
+        return NULL;
+    }
+    ring->sqHead = (unsigned*) ((char*) ring->sqRing + params.sq_off.head);
+    ring->sqTail = (unsigned*) ((char*) ring->sqRing + params.sq_off.tail);
+    ring->sqMask = (unsigned*) ((char*) ring->sqRing + params.sq_off.ring_mask);
+    ring->sqFlags = (unsigned*) ((char*) ring->sqRing + params.sq_off.flags);
+    ring->sqArray = (unsigned*) ((char*) ring->sqRing + params.sq_off.array);
+    ring->cqHead = (unsigned*) ((char*) ring->cqRing + params.cq_off.head);
+    ring->cqTail = (unsigned*) ((char*) ring->cqRing + params.cq_off.tail);
+    ring->cqMask = (unsigned*) ((char*) ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) ((char*) ring->cqRing + params.cq_off.cqes);
+    ring->bufferSize = bufferSize;
+    for (i = 0; i < kUringBuffers; i++) {
+        ring->buffers[i].iov_base = &ring->memory[i * bufferSize];
+        ring->buffers[i].iov_len = bufferSize;
+        ring->writes[i].data.iov_base = ring->buffers[i].iov_base;
+    }
+    /* pinned once instead of on each write, unless RLIMIT_MEMLOCK is too low */
+    ring->fixed = uringRegister(ring, IORING_REGISTER_BUFFERS, ring->buffers, kUringBuffers) == 0;
+    return ring;
+}
+
+/* Append to the file until all is written */
+static void appendAll(struct FileSink* file, const char* buf, size_t len)
+{
+    if (!writeAll(file->fd, buf, len)) {
+        fprintf(stderr, "ERROR: logger: Failed to write file: `%s`\n", file->filename);
+    }
+}
+
+static void appendShortWrites(struct FileSink* file);
+
+/* Reap the completions, waiting for at least one if `wait` is true and some are pending */
+static void reapUring(struct FileSink* file, int wait)
+{
+    struct Uring* ring = file->uring;
+    struct io_uring_cqe* cqe;
+    struct UringWrite* w;
+    unsigned head, tail;
+
+    if (wait && ring->pending > 0) {
+        uringEnter(ring, 0, 1, IORING_ENTER_GETEVENTS);
+    }
+    head = *ring->cqHead;
+    tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        cqe = &ring->cqes[head & *ring->cqMask];
+        if (cqe->user_data != kUringFsync) {
+            w = &ring->writes[cqe->user_data];
+            if (cqe->res >= 0 && (size_t) cqe->res < w->data.iov_len) {
+                w->written = (size_t) cqe->res; /* busy until the rest is written */
+                ring->shortWrites++;
+            } else {
+                if (cqe->res < 0) {
+                    fprintf(stderr, "ERROR: logger: Failed to write file: `%s`\n", file->filename);
+                }
+                w->busy = 0; /* false */
+            }
+        }
+        ring->pending--;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    if (ring->shortWrites > 0 && !ring->draining) {
+        appendShortWrites(file);
+    }
+}
+
+static void drainUring(void* context)
+{
+    struct FileSink* file = (struct FileSink*) context;
+
+    while (file->uring->pending > 0) {
+        reapUring(file, 1);
+    }
+}
+
+/*
+ * Write the rest of the short writes in the order they were submitted, after
+ * the writes in flight have completed, so that no later write lands between
+ * the parts of a line. The writes submitted before may have landed already.
+ */
+static void appendShortWrites(struct FileSink* file)
+{
+    struct Uring* ring = file->uring;
+    struct UringWrite* w;
+    int i;
+
+    ring->draining = 1; /* true */
+    drainUring(file);
+    while (ring->shortWrites > 0) {
+        w = NULL;
+        for (i = 0; i < kUringBuffers; i++) {
+            if (ring->writes[i].busy && (w == NULL || ring->writes[i].sequence < w->sequence)) {
+                w = &ring->writes[i];
+            }
+        }
+        appendAll(file, (const char*) w->data.iov_base + w->written, w->data.iov_len - w->written);
+        w->busy = 0; /* false */
+        ring->shortWrites--;
+    }
+    ring->draining = 0; /* false */
+}
+
+/* Queue the write of a buffer at the end of the file, linked to an fsync if the file is synced */
+static void submitUring(struct FileSink* file, int index)
+{
+    struct Uring* ring = file->uring;
+    struct UringWrite* w = &ring->writes[index];
+    struct io_uring_sqe* sqe;
+    unsigned tail = *ring->sqTail;
+    unsigned mask = *ring->sqMask;
+
+    /* the queue cannot overflow, as each buffer has at most 2 entries until it completes */
+    sqe = &ring->sqes[tail & mask];
+    memset(sqe, 0, sizeof(*sqe));
+    if (ring->fixed) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->addr = (unsigned long) w->data.iov_base;
+        sqe->len = (unsigned) w->data.iov_len;
+        sqe->buf_index = (unsigned short) index;
+    } else {
+        sqe->opcode = IORING_OP_WRITEV;
+        sqe->addr = (unsigned long) &w->data;
+        sqe->len = 1;
+    }
+    sqe->fd = file->fd;
+    sqe->off = (unsigned long) -1; /* at the file position, which O_APPEND keeps at the end */
+    sqe->user_data = (unsigned long) index;
+    ring->sqArray[tail & mask] = tail & mask;
+    tail++;
+    ring->pending++;
+    if (file->sync) {
+        sqe->flags |= IOSQE_IO_LINK; /* fsync after the write completes */
+        sqe = &ring->sqes[tail & mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = file->fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->user_data = kUringFsync;
+        ring->sqArray[tail & mask] = tail & mask;
+        tail++;
+        ring->pending++;
+    }
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    if (ring->sqpoll) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(ring->sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+            uringEnter(ring, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+    } else {
+        /* also what an interrupted call left */
+        uringEnter(ring, tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE), 0, 0);
+    }
+}
+
+/* Copy the lines to a free buffer and submit it without waiting for the write */
+static void writeUringFile(struct FileSink* file, const struct iovec* lines, int n, size_t len)
+{
+    struct Uring* ring = file->uring;
+    struct UringWrite* w;
+    int i;
+
+    if (len > ring->bufferSize) { /* a line longer than the buffers */
+        drainUring(file);
+        for (i = 0; i < n; i++) {
+            appendAll(file, (const char*) lines[i].iov_base, lines[i].iov_len);
+            file->currentFileSize += (long) lines[i].iov_len;
+        }
+        return;
+    }
+    reapUring(file, 0);
+    for (;;) {
+        for (i = 0; i < kUringBuffers && ring->writes[i].busy; i++) {
+        }
+        if (i < kUringBuffers) {
+            break;
+        }
+        reapUring(file, 1); /* all the buffers are in flight */
+    }
+    w = &ring->writes[i];
+    w->data.iov_len = 0;
+    for (i = 0; i < n; i++) {
+        memcpy((char*) w->data.iov_base + w->data.iov_len, lines[i].iov_base, lines[i].iov_len);
+        w->data.iov_len += lines[i].iov_len;
+    }
+    w->sequence = ring->submitted++;
+    w->busy = 1; /* true */
+    submitUring(file, (int) (w - ring->writes));
+    file->currentFileSize += (long) len;
+}
+#endif /* defined(LOGGER_IO_URING) */
+
+/* Write the lines with one system call where possible, checking the file size for rotation once */
+static void writeFileSink(void* context, const struct iovec* lines, int n)
+{
+    struct FileSink* file = (struct FileSink*) context;
+    size_t len = 0;
+    long written = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        len += lines[i].iov_len;
+    }
+    if (file->fd >= 0 && file->currentFileSize >= file->maxFileSize) {
+#if defined(LOGGER_IO_URING)
+        if (file->uring != NULL) {
+            drainUring(file);
+        }
+#endif /* defined(LOGGER_IO_URING) */
+        close(file->fd);
+        file->fd = -1;
+        renameBackupFiles(file->filename, file->maxBackupFiles);
+    }
+    if (file->fd < 0 && !openFileSink(file)) {
+        return;
+    }
+#if defined(LOGGER_IO_URING)
+    if (file->uring != NULL) {
+        writeUringFile(file, lines, n, len);
+        return;
+    }
+#endif /* defined(LOGGER_IO_URING) */
+#if !defined(_WIN32) && !defined(_WIN64)
+    if ((written = (long) writev(file->fd, lines, n)) < 0) {
+        written = 0;
+    }
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    /* write the rest of a short write */
+    for (i = 0; i < n; i++) {
+        if ((size_t) written >= lines[i].iov_len) {
+            written -= (long) lines[i].iov_len;
+        } else {
+            writeAll(file->fd, (const char*) lines[i].iov_base + written, lines[i].iov_len - (size_t) written);
+            written = 0;
+        }
+    }
+    file->currentFileSize += (long) len;
+    if (file->sync) {
+#if defined(_WIN32) || defined(_WIN64)
+        _commit(file->fd);
+#else
+        fsync(file->fd);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    }
+}
+
+#if defined(LOGGER_IO_URING)
+/* Free the buffers that have been written, without waiting */
+static void flushFileSink(void* context)
+{
+    struct FileSink* file = (struct FileSink*) context;
+
+    if (file->uring != NULL) {
+        reapUring(file, 0);
+    }
+}
+
+static void waitFileSink(void* context)
+{
+    struct FileSink* file = (struct FileSink*) context;
+
+    if (file->uring != NULL) {
+        drainUring(file);
+    }
+}
+#endif /* defined(LOGGER_IO_URING) */
+
+static void closeFileSink(void* context)
+{
+    struct FileSink* file = (struct FileSink*) context;
+
+#if defined(LOGGER_IO_URING)
+    if (file->uring != NULL) {
+        drainUring(file);
+        closeUring(file->uring);
+    }
+#endif /* defined(LOGGER_IO_URING) */
+    if (file->fd >= 0) {
+        close(file->fd);
+    }
+    free(file);
+}
+
+int logger_addFileSink(const struct LogFileSink* config)
+{
+    struct FileSink* file;
+    struct LogSink sink;
+    size_t size;
+    int id;
+
+    if (config == NULL || config->filename == NULL) {
+        assert(0 && "filename must not be NULL");
+        return 0;
+    }
+    if (strlen(config->filename) >= kMaxFileNameLen) {
+        fprintf(stderr, "ERROR: logger: Too long file name: `%s`\n", config->filename);
+        return 0;
+    }
+    if ((file = (struct FileSink*) calloc(1, sizeof(struct FileSink))) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return 0;
+    }
+    strcpy(file->filename, config->filename);
+    file->maxFileSize = (config->maxFileSize > 0) ? config->maxFileSize : kDefaultMaxFileSize;
+    file->maxBackupFiles = config->maxBackupFiles;
+    file->sync = config->sync;
+    size = (config->bufferSize > 0) ? config->bufferSize : kOutputBufferSize;
+#if defined(LOGGER_IO_URING)
+    if (config->ioUring != LogIoUring_OFF) {
+        /* written with writev() if the kernel has no io_uring */
+        file->uring = openUring(size, config->ioUring == LogIoUring_SQPOLL);
+    }
+#endif /* defined(LOGGER_IO_URING) */
+    if (!openFileSink(file)) {
+        closeFileSink(file);
+        return 0;
+    }
+    sink.writeBatch = writeFileSink;
+#if defined(LOGGER_IO_URING)
+    sink.flush = flushFileSink;
+#else
+    sink.flush = NULL;
+#endif /* defined(LOGGER_IO_URING) */
+    sink.close = closeFileSink;
+    sink.context = file;
+#if defined(LOGGER_IO_URING)
+    id = addSink(&sink, config->minLevel, config->maxLevel, size, 0, config->flushInterval, waitFileSink);
+#else
+    id = addSink(&sink, config->minLevel, config->maxLevel, size, 0, config->flushInterval, NULL);
+#endif /* defined(LOGGER_IO_URING) */
+    if (id == 0) {
+        closeFileSink(file);
+    }
+    return id;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Run the writer thread of a console sink, which is the only one to block on the console */
+static void* runConsoleSink(void* context)
+{
+    struct ConsoleSink* console = (struct ConsoleSink*) context;
+    size_t len, n, pos;
+
+    pthread_mutex_lock(&console->mutex);
+    for (;;) {
+        while (console->head == console->tail && console->running) {
+            pthread_cond_wait(&console->ready, &console->mutex);
+        }
+        if (console->head == console->tail) {
+            break; /* stopped and drained */
+        }
+        /* copy out a chunk, so that the queue can take lines or drop the oldest meanwhile */
+        len = (size_t) (console->head - console->tail);
+        len = (len < kConsoleChunkSize) ? len : kConsoleChunkSize;
+        pos = (size_t) (console->tail % console->size);
+        n = console->size - pos;
+        if (len <= n) {
+            memcpy(console->chunk, &console->buffer[pos], len);
+        } else {
+            memcpy(console->chunk, &console->buffer[pos], n);
+            memcpy(&console->chunk[n], console->buffer, len - n);
+        }
+        if (console->head - console->tail > len) { /* end the chunk with a whole line */
+            for (n = len; n > 0 && console->chunk[n - 1] != '\n'; n--) {
+            }
+            len = (n > 0) ? n : len;
+        }
+        console->tail += len;
+        console->writing = 1; /* true */
+        console->timedOut = 0; /* false */
+        pthread_cond_broadcast(&console->space);
+        pthread_mutex_unlock(&console->mutex);
+        writeAll(console->fd, console->chunk, len);
+        pthread_mutex_lock(&console->mutex);
+        console->writing = 0; /* false */
+        pthread_cond_broadcast(&console->space);
+    }
+    pthread_mutex_unlock(&console->mutex);
+    return NULL;
+}
+
+/* Discard the oldest lines in the queue until the line fits, and return whether it does */
+static int dropOldestLines(struct ConsoleSink* console, size_t len)
+{
+    size_t pos;
+
+    while (console->head != console->tail && console->size - (size_t) (console->head - console->tail) < len) {
+        pos = (size_t) (console->tail % console->size);
+        while (console->head != console->tail) {
+            console->tail++;
+            if (console->buffer[pos] == '\n') {
+                break;
+            }
+            pos = (pos + 1 == console->size) ? 0 : pos + 1;
+        }
+        console->dropped++;
+    }
+    return console->size - (size_t) (console->head - console->tail) >= len;
+}
+
+/* Wait until the line fits into the queue or the timeout expires, and return whether it fits */
+static int waitConsoleSpace(struct ConsoleSink* console, size_t len)
+{
+    struct timespec deadline;
+
+    if (console->timedOut) {
+        return 0; /* drop without waiting until the writer makes progress */
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += console->timeout / 1000;
+    deadline.tv_nsec += (console->timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (console->size - (size_t) (console->head - console->tail) < len) {
+        if (!console->running) {
+            return 0; /* being closed */
+        }
+        if (pthread_cond_timedwait(&console->space, &console->mutex, &deadline) == ETIMEDOUT) {
+            console->timedOut = 1; /* true */
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Queue the lines for the writer thread, applying the overflow policy when the queue is full */
+static void writeConsoleSink(void* context, const struct iovec* lines, int n)
+{
+    struct ConsoleSink* console = (struct ConsoleSink*) context;
+    const char* line;
+    size_t len, m, pos;
+    int fits;
+    int i;
+
+    pthread_mutex_lock(&console->mutex);
+    for (i = 0; i < n; i++) {
+        line = (const char*) lines[i].iov_base;
+        len = lines[i].iov_len;
+        fits = console->size - (size_t) (console->head - console->tail) >= len;
+        if (!fits && len <= console->size) {
+            switch (console->overflow) {
+                case LogOverflow_DROP_OLDEST: fits = dropOldestLines(console, len); break;
+                case LogOverflow_BLOCK: break; /* waited for in waitConsoleSinks() */
+                default: break;
+            }
+        }
+        if (!fits) {
+            console->dropped++;
+            continue;
+        }
+        pos = (size_t) (console->head % console->size);
+        m = console->size - pos;
+        if (len <= m) {
+            memcpy(&console->buffer[pos], line, len);
+        } else {
+            memcpy(&console->buffer[pos], line, m);
+            memcpy(console->buffer, &line[m], len - m);
+        }
+        console->head += len;
+    }
+    pthread_cond_signal(&console->ready);
+    pthread_mutex_unlock(&console->mutex);
+}
+
+/*
+ * Wait until the lines fit into the queues of the console sinks that block
+ * them. The lock of the logger, which is held, is released while waiting, so
+ * that only the threads logging to those sinks wait.
+ */
+static void waitConsoleSinks(enum LogLevel level, size_t len, int lines)
+{
+    struct Sink* sink;
+    struct ConsoleSink* console;
+    int i;
+
+    for (i = 0; i < kMaxSinks; i++) {
+        if ((sink = s_sinks.sinks[i]) == NULL || sink->sink.writeBatch != writeConsoleSink
+                || sink->level > level || (lines == 1 && level > sink->maxLevel)
+                || (sink->loggers != 0 && !(sink->loggers >> t_logger & 1))) {
+            continue;
+        }
+        console = (struct ConsoleSink*) sink->sink.context;
+        if (console->overflow != LogOverflow_BLOCK || len > console->size) {
+            continue;
+        }
+        pthread_mutex_lock(&console->mutex);
+        if (console->size - (size_t) (console->head - console->tail) >= len || console->timedOut) {
+            pthread_mutex_unlock(&console->mutex);
+            continue;
+        }
+        console->waiters++;
+        unlock();
+        waitConsoleSpace(console, len);
+        console->waiters--;
+        pthread_cond_broadcast(&console->space); /* to closeConsoleSink() */
+        pthread_mutex_unlock(&console->mutex);
+        lock();
+        i = -1; /* the sinks may have changed or filled meanwhile */
+    }
+}
+
+/* Wait until the writer thread has written the queue */
+static void waitConsoleSink(void* context)
+{
+    struct ConsoleSink* console = (struct ConsoleSink*) context;
+
+    pthread_mutex_lock(&console->mutex);
+    while (console->head != console->tail || console->writing) {
+        pthread_cond_wait(&console->space, &console->mutex);
+    }
+    pthread_mutex_unlock(&console->mutex);
+}
+
+/* Keep a console sink for syncConsoleSinks(), with the lock of the logger held */
+static int holdConsoleSink(struct Sink* sink, struct ConsoleSink** consoles, int n)
+{
+    struct ConsoleSink* console;
+
+    if (sink->sink.writeBatch != writeConsoleSink) {
+        return 0;
+    }
+    console = (struct ConsoleSink*) sink->sink.context;
+    pthread_mutex_lock(&console->mutex);
+    console->waiters++; /* not freed until released */
+    pthread_mutex_unlock(&console->mutex);
+    consoles[n] = console;
+    return 1;
+}
+
+/* Wait for the writers of the console sinks without the lock of the logger, and release them */
+static void syncConsoleSinks(struct ConsoleSink** consoles, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        waitConsoleSink(consoles[i]);
+        pthread_mutex_lock(&consoles[i]->mutex);
+        consoles[i]->waiters--;
+        pthread_cond_broadcast(&consoles[i]->space); /* to closeConsoleSink() */
+        pthread_mutex_unlock(&consoles[i]->mutex);
+    }
+}
+
+/* Stop the writer thread after it has written the queue. It is called without the lock of the logger. */
+static void closeConsoleSink(void* context)
+{
+    struct ConsoleSink* console = (struct ConsoleSink*) context;
+
+    pthread_mutex_lock(&console->mutex);
+    console->running = 0; /* false */
+    pthread_cond_signal(&console->ready);
+    pthread_cond_broadcast(&console->space);
+    while (console->waiters > 0) {
+        pthread_cond_wait(&console->space, &console->mutex);
+    }
+    pthread_mutex_unlock(&console->mutex);
+    if (console->overflow == LogOverflow_BLOCK) {
+        lock();
+        s_sinks.blocking--;
+        unlock();
+    }
+    pthread_join(console->thread, NULL);
+    pthread_mutex_destroy(&console->mutex);
+    pthread_cond_destroy(&console->ready);
+    pthread_cond_destroy(&console->space);
+    free(console);
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+int logger_addConsoleSink(const struct LogConsoleSink* config)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct ConsoleSink* console;
+    struct LogSink sink;
+    size_t size;
+    int id;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+    if (config == NULL) {
+        assert(0 && "config must not be NULL");
+        return 0;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    fprintf(stderr, "ERROR: logger: Console sink is not supported\n");
+    return 0;
+#else
+    size = (config->queueSize > 0) ? config->queueSize : kDefaultConsoleQueueSize;
+    /* the queue and the chunk of the writer thread follow the struct */
+    if ((console = (struct ConsoleSink*) calloc(1, sizeof(struct ConsoleSink) + size + kConsoleChunkSize)) == NULL) {
+        fprintf(stderr, "ERROR: logger: Out of memory\n");
+        return 0;
+    }
+    fflush(config->output != NULL ? config->output : stdout); /* what stdio holds goes first */
+    console->fd = fileno(config->output != NULL ? config->output : stdout);
+    console->buffer = (char*) (console + 1);
+    console->size = size;
+    console->chunk = console->buffer + size;
+    console->overflow = config->overflow;
+    console->timeout = (config->blockTimeout > 0) ? config->blockTimeout : 0;
+    pthread_mutex_init(&console->mutex, NULL);
+    pthread_cond_init(&console->ready, NULL);
+    pthread_cond_init(&console->space, NULL);
+    console->running = 1; /* true */
+    if (pthread_create(&console->thread, NULL, runConsoleSink, console) != 0) {
+        fprintf(stderr, "ERROR: logger: Failed to start the console thread\n");
+        pthread_mutex_destroy(&console->mutex);
+        pthread_cond_destroy(&console->ready);
+        pthread_cond_destroy(&console->space);
+        free(console);
+        return 0;
+    }
+    sink.writeBatch = writeConsoleSink;
+    sink.flush = NULL;
+    sink.close = closeConsoleSink;
+    sink.context = console;
+    /* each line is queued at once, which costs a copy and never a write */
+    if (console->overflow == LogOverflow_BLOCK) {
+        lock();
+        s_sinks.blocking++;
+        unlock();
+    }
+    id = addSink(&sink, config->minLevel, config->maxLevel, kOutputBufferSize, 0, 0, waitConsoleSink);
+    if (id == 0) {
+        closeConsoleSink(console);
+    }
+    return id;
+#endif /* defined(_WIN32) || defined(_WIN64) */
+}
+
+unsigned long logger_getDroppedLines(int id)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct Sink* sink;
+    unsigned long dropped = 0;
+    int i;
+
+    init();
+    lock();
+    for (i = 0; i < kMaxSinks; i++) {
+        if ((sink = s_sinks.sinks[i]) != NULL && sink->id == id && sink->sink.writeBatch == writeConsoleSink) {
+            dropped = ((struct ConsoleSink*) sink->sink.context)->dropped;
+        }
+    }
+    unlock();
+    return dropped;
+#else
+    return 0;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void logger_removeSink(int id)
+{
+    struct Sink* sink;
+    struct Sink* removed = NULL;
+    int nsinks = 0;
+    int i;
+
+    init();
+    lock();
+    for (i = 0; i < kMaxSinks; i++) {
+        if ((sink = s_sinks.sinks[i]) != NULL && sink->id == id) {
+            flushSink(sink);
+            removed = sink;
+            s_sinks.sinks[i] = NULL;
+        } else if (sink != NULL) {
+            nsinks++;
+        }
+    }
+    if (nsinks == 0) {
+        s_logger &= ~kSinkLogger;
+    }
+    unlock();
+    /* closed without the lock, as a console sink waits for its writer thread */
+    if (removed != NULL) {
+        if (removed->sink.close != NULL) {
+            (removed->sink.close)(removed->sink.context);
+        }
+        free(removed);
+    }
+}
+
+/* Hand the collected lines to the sink in one call */
+static void deliverSink(struct Sink* sink)
+{
+    if (sink->nlines > 0) {
+        sink->sink.writeBatch(sink->sink.context, sink->lines, sink->nlines);
+    }
+    sink->len = 0;
+    sink->nlines = 0;
+}
+
+static void flushSink(struct Sink* sink)
+{
+    deliverSink(sink);
+    if (sink->sink.flush != NULL) {
+        sink->sink.flush(sink->sink.context);
+    }
+}
+
+/* Flush the sink and wait until its writes reach the file */
+static void syncSink(struct Sink* sink)
+{
+    flushSink(sink);
+    if (sink->wait != NULL) {
+        sink->wait(sink->sink.context);
+    }
+}
+
+static void collectSinkLine(struct Sink* sink, const char* line, size_t len)
+{
+    struct iovec vec;
+
+    if (sink->len + len > sink->size || sink->nlines == kMaxSinkLines) {
+        deliverSink(sink);
+    }
+    if (len > sink->size) {
+        vec.iov_base = (void*) line;
+        vec.iov_len = len;
+        sink->sink.writeBatch(sink->sink.context, &vec, 1);
+        return;
+    }
+    memcpy(&sink->buffer[sink->len], line, len);
+    sink->lines[sink->nlines].iov_base = &sink->buffer[sink->len];
+    sink->lines[sink->nlines].iov_len = len;
+    sink->len += len;
+    sink->nlines++;
 }
 
-void logger_flush()
+static enum LogLevel getLineLevel(const char* line)
 {
-    if (s_logger == 0 || !s_initialized) {
-        assert(0 && "logger is not initialized");
-        return;
+    switch (line[0]) {
+        case 'T': return LogLevel_TRACE;
+        case 'D': return LogLevel_DEBUG;
+        case 'I': return LogLevel_INFO;
+        case 'W': return LogLevel_WARN;
+        case 'E': return LogLevel_ERROR;
+        default: return LogLevel_FATAL;
+    }
+}
+
+/* Collect lines for the sinks of their levels. The level of each line is read from it unless there is one line. */
+static void writeSinks(enum LogLevel level, const char* data, size_t len, int lines)
+{
+    const char* end = data + len;
+    const char* lf;
+    struct Sink* sink;
+    int i;
+
+    for (; data < end; data = lf + 1) {
+        if (lines == 1 || (lf = (const char*) memchr(data, '\n', end - data)) == NULL) {
+            lf = end - 1;
+        }
+        if (lines != 1) {
+            level = getLineLevel(data);
+        }
+        for (i = 0; i < kMaxSinks; i++) {
+            if ((sink = s_sinks.sinks[i]) != NULL && sink->level <= level && level <= sink->maxLevel
+                    && (sink->loggers == 0 || (sink->loggers >> t_logger & 1))) {
+                collectSinkLine(sink, data, lf + 1 - data);
+            }
+        }
+    }
+}
+
+static long writeSinkData(void* unused, const char* data, size_t len)
+{
+    writeSinks(LogLevel_TRACE, data, len, 0);
+    return (long) len;
+}
+
+static int isSinkFlushTime(struct Sink* sink, long currentTime)
+{
+    if (sink->autoFlush) {
+        return isFlushTime(currentTime, &sink->flushedTime);
+    }
+    if (sink->flushInterval == 0) {
+        return sink->nlines > 0;
+    }
+    if (sink->flushInterval > 0 && currentTime - sink->flushedTime > sink->flushInterval) {
+        sink->flushedTime = currentTime;
+        return 1;
+    }
+    return 0;
+}
+
+static void autoFlushSinks(long currentTime)
+{
+    struct Sink* sink;
+    int i;
+
+    for (i = 0; i < kMaxSinks; i++) {
+        if ((sink = s_sinks.sinks[i]) != NULL && isSinkFlushTime(sink, currentTime)) {
+            flushSink(sink);
+        }
+    }
+}
+
+/* Call the write function for each line of the data */
+static void writeEachLine(void (*write)(const char*, size_t, long), const char* data, size_t len,
+        long currentTime)
+{
+    const char* end = data + len;
+    const char* lf;
+
+    for (; data < end; data = lf + 1) {
+        if ((lf = (const char*) memchr(data, '\n', end - data)) == NULL) {
+            lf = end - 1;
+        }
+        write(data, lf + 1 - data, currentTime);
     }
+}
 
+/* Write formatted lines to the loggers sharing the lock, which is held, except flushing the sinks */
+static void writeOutputs(enum LogLevel level, const char* buf, size_t len, int lines, long currentTime)
+{
+    if (level >= LogLevel_ERROR) {
+        dumpFlightRecorder();
+    }
+    if (hasFlag(s_logger, kShmLogger)) {
+        writeShm(&s_shm, buf, len);
+    }
     if (hasFlag(s_logger, kConsoleLogger)) {
-        fflush(s_clog.output);
+        writeFile(s_clog.output, buf, len);
+        autoFlush(s_clog.output, currentTime, &s_clog.flushedTime);
     }
     if (hasFlag(s_logger, kFileLogger)) {
-        fflush(s_flog.output);
+        if (rotateLogFiles()) {
+            indexFileLogger(buf, len);
+            writeFileLogger(NULL, buf, len);
+            autoFlushOutput(&s_flog.output, currentTime, &s_flog.flushedTime);
+        }
+    }
+#if defined(LOGGER_COMPRESSION)
+    if (hasFlag(s_logger, kCompressedLogger)) {
+        if (lines > 1) {
+            writeEachLine(writeCompressed, buf, len, currentTime); /* each line in one frame */
+        } else {
+            writeCompressed(buf, len, currentTime);
+        }
+    }
+#endif /* defined(LOGGER_COMPRESSION) */
+    if (hasFlag(s_logger, kSinkLogger)) {
+        writeSinks(level, buf, len, lines);
     }
 }
 
-static char getLevelChar(enum LogLevel level)
+static void publishCombined(struct Combined* combined)
 {
-    switch (level) {
-        case LogLevel_TRACE: return 'T';
-        case LogLevel_DEBUG: return 'D';
-        case LogLevel_INFO:  return 'I';
-        case LogLevel_WARN:  return 'W';
-        case LogLevel_ERROR: return 'E';
-        case LogLevel_FATAL: return 'F';
-        default: return ' ';
-    }
+    struct Combined* pending;
+
+    do {
+        combined->next = pending = s_combining.pending;
+#if defined(_WIN32) || defined(_WIN64)
+    } while (InterlockedCompareExchangePointer((PVOID volatile*) &s_combining.pending, combined, pending) != pending);
+#else
+    } while (!__sync_bool_compare_and_swap(&s_combining.pending, pending, combined));
+#endif /* defined(_WIN32) || defined(_WIN64) */
 }
 
-static void getTimestamp(const struct timeval* time, char* timestamp, size_t len)
+/* Take the published lines in the order they were published */
+static struct Combined* takeCombined(void)
 {
-    time_t sec = time->tv_sec; /* a necessary variable to avoid a runtime error on Windows */
-    struct tm calendar;
+    struct Combined* pending;
+    struct Combined* first = NULL;
+    struct Combined* next;
 
-    localtime_r(&sec, &calendar);
-    strftime(timestamp, len, "%y-%m-%d %H:%M:%S", &calendar);
-    sprintf(&timestamp[17], ".%06ld", (long) time->tv_usec);
+#if defined(_WIN32) || defined(_WIN64)
+    pending = (struct Combined*) InterlockedExchangePointer((PVOID volatile*) &s_combining.pending, NULL);
+#else
+    pending = __sync_lock_test_and_set(&s_combining.pending, (struct Combined*) NULL);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    for (; pending != NULL; pending = next) {
+        next = pending->next;
+        pending->next = first;
+        first = pending;
+    }
+    return first;
 }
 
-static char* getBackupFileName(const char* basename, unsigned char index)
+/* Write the lines published by all threads, which is done by the thread holding the lock */
+static void writeCombined(void)
 {
-    int len = strlen(basename) + 4; /* <basename>.255 */
-    char* backupname = (char*) malloc(sizeof(char) * len);
-    if (backupname == NULL) {
-        fprintf(stderr, "ERROR: logger: Out of memory\n");
-        return NULL;
+    struct Combined* combined;
+    struct Combined* next;
+    long currentTime = 0;
+    int logger = t_logger;
+
+    for (combined = takeCombined(); combined != NULL; combined = next) {
+        t_logger = combined->logger; /* for the sinks attached to it */
+        writeOutputs(combined->level, combined->buf, combined->len, combined->lines, combined->currentTime);
+        if (currentTime < combined->currentTime) {
+            currentTime = combined->currentTime;
+        }
+        next = combined->next;
+        memoryBarrier();
+        combined->done = 1; /* the waiting thread returns and its stack is gone */
     }
-    if (index == 0) {
-        sprintf(backupname, "%.255s", basename);
-    } else {
-        sprintf(backupname, "%.255s.%d", basename, index);
+    t_logger = logger;
+    if (hasFlag(s_logger, kSinkLogger)) {
+        autoFlushSinks(currentTime); /* a writev() for the lines of all threads */
     }
-    return backupname;
 }
 
-static int isFileExist(const char* filename)
+/* Publish the lines and wait until they are written by this or another thread */
+static void writeCombining(enum LogLevel level, const char* buf, size_t len, int lines, long currentTime)
+{
+    struct Combined combined;
+    int spins;
+
+    combined.level = level;
+    combined.buf = buf;
+    combined.len = len;
+    combined.lines = lines;
+    combined.currentTime = currentTime;
+    combined.logger = t_logger;
+    combined.done = 0;
+    publishCombined(&combined);
+    for (spins = 0; !combined.done; spins++) {
+        if (tryLock()) {
+            writeCombined();
+            unlock();
+        } else if (spins >= kCombiningSpins) {
+            lock();
+            if (!combined.done) {
+                writeCombined();
+            }
+            unlock();
+        } else {
+            spinWait(spins); /* pause, as the combiner may be on the other hyperthread */
+        }
+    }
+    memoryBarrier();
+}
+
+void logger_setCombining(int enabled)
+{
+    s_combining.enabled = enabled;
+}
+
+/* Drop the oldest records until a record of the size fits, returning 0 if it never does */
+static int makeScopeRoom(struct Scope* scope, size_t size)
 {
-    FILE* fp;
+    struct ScopeRecord record;
+    size_t offset = 0;
 
-    if ((fp = fopen(filename, "r")) == NULL) {
+    if (size > scope->size) {
         return 0;
-    } else {
-        fclose(fp);
+    }
+    if (scope->size - scope->len >= size) {
         return 1;
     }
+    /* a quarter of the buffer at least, not to move the records for each message */
+    while (offset < scope->len && (scope->size - scope->len + offset < size || offset < scope->size / 4)) {
+        memcpy(&record, &scope->buffer[offset], sizeof(record));
+        offset += sizeof(record) + record.len;
+        scope->dropped++;
+    }
+    memmove(scope->buffer, &scope->buffer[offset], scope->len - offset);
+    scope->len -= offset;
+    return 1;
 }
 
-static int rotateLogFiles(void)
+/* Make room for a record with the length of text and return the place of the text, or NULL if it is dropped */
+static char* getScopeText(struct Scope* scope, size_t len)
 {
-    int i;
-    char *src, *dst;
+    if (!makeScopeRoom(scope, sizeof(struct ScopeRecord) + len)) {
+        scope->dropped++;
+        return NULL;
+    }
+    return &scope->buffer[scope->len + sizeof(struct ScopeRecord)];
+}
 
-    if (s_flog.currentFileSize < s_flog.maxFileSize) {
-        return s_flog.output != NULL;
-    }
-    fclose(s_flog.output);
-    for (i = (int) s_flog.maxBackupFiles; i > 0; i--) {
-        src = getBackupFileName(s_flog.filename, i - 1);
-        dst = getBackupFileName(s_flog.filename, i);
-        if (src != NULL && dst != NULL) {
-            if (isFileExist(dst)) {
-                if (remove(dst) != 0) {
-                    fprintf(stderr, "ERROR: logger: Failed to remove file: `%s`\n", dst);
-                }
-            }
-            if (isFileExist(src)) {
-                if (rename(src, dst) != 0) {
-                    fprintf(stderr, "ERROR: logger: Failed to rename file: `%s` -> `%s`\n", src, dst);
-                }
-            }
+/* Add a record before the text put in the place returned by getScopeText() */
+static void addScopeRecord(struct Scope* scope, const struct LogTime* time, const char* file, int line,
+        enum LogLevel level, size_t len)
+{
+    struct ScopeRecord record;
+
+    record.time = *time;
+    record.file = file;
+    record.line = line;
+    record.level = level;
+    record.len = len;
+    memcpy(&scope->buffer[scope->len], &record, sizeof(record));
+    scope->len += sizeof(record) + len;
+}
+
+/* Capture a message with the context of the thread, leaving the header to the commit */
+static void captureMessage(enum LogLevel level, const char* file, int line, const char* fmt, va_list arg)
+{
+    struct Scope* scope = t_scope;
+    struct LogTime now;
+    char buf[kMaxLineLen];
+    char* text;
+    char* end;
+    char* out;
+
+    getTime(&now);
+    if (scope->size - scope->len >= sizeof(struct ScopeRecord) + kMaxLineLen) {
+        text = &scope->buffer[scope->len + sizeof(struct ScopeRecord)]; /* in place */
+        end = text + kMaxLineLen - 1; /* formatText() needs a following byte */
+        out = appendField(text, end, "", 0, t_context, t_contextLen, 0, 0);
+        out = formatText(out, end, fmt, arg);
+    } else {
+        end = buf + sizeof(buf) - 1;
+        out = appendField(buf, end, "", 0, t_context, t_contextLen, 0, 0);
+        out = formatText(out, end, fmt, arg);
+        if ((text = getScopeText(scope, out - buf)) == NULL) {
+            return;
         }
-        free(src);
-        free(dst);
+        memcpy(text, buf, out - buf);
+        out = text + (out - buf);
     }
-    s_flog.output = fopen(s_flog.filename, "a");
-    if (s_flog.output == NULL) {
-        fprintf(stderr, "ERROR: logger: Failed to open file: `%s`\n", s_flog.filename);
+    addScopeRecord(scope, &now, file, line, level, out - text);
+}
+
+/* Capture formatted lines, returning 0 if the thread has no scope */
+static int captureLines(enum LogLevel level, const char* buf, size_t len, int lines)
+{
+    struct LogTime time;
+    char* text;
+
+    if (!isScoped()) {
         return 0;
     }
-    s_flog.currentFileSize = getFileSize(s_flog.filename);
+    if ((text = getScopeText(t_scope, len)) != NULL) {
+        memcpy(text, buf, len);
+        memset(&time, 0, sizeof(time));
+        addScopeRecord(t_scope, &time, NULL, lines, level, len);
+    }
     return 1;
 }
 
-static long vflog(FILE* fp, char levelc, const char* timestamp, long threadID,
-        const char* file, int line, const char* fmt, va_list arg,
-        long currentTime, long* flushedTime)
+/* Write formatted lines of a level to be logged */
+static void writeLoggedLine(enum LogLevel level, const char* buf, size_t len, int lines, long currentTime)
 {
-    int size;
-    long totalsize = 0;
-
-    if ((size = fprintf(fp, "%c %s %ld %s:%d: ", levelc, timestamp, threadID, file, line)) > 0) {
-        totalsize += size;
+    if (hasFlag(s_logger, kShardLogger)) {
+        if (level >= LogLevel_ERROR && s_recorder.ring.buffer != NULL) {
+            lock();
+            dumpFlightRecorder();
+            unlock();
+        }
+        if (lines > 1) {
+            writeEachLine(writeShard, buf, len, currentTime); /* a sequence number for each line */
+        } else {
+            writeShard(buf, len, currentTime);
+        }
+        if ((s_logger & ~kShardLogger) == 0) {
+            return; /* no lock shared between threads */
+        }
     }
-    if ((size = vfprintf(fp, fmt, arg)) > 0) {
-        totalsize += size;
+    if (s_combining.enabled && s_sinks.blocking == 0) {
+        writeCombining(level, buf, len, lines, currentTime);
+        return;
     }
-    if ((size = fprintf(fp, "\n")) > 0) {
-        totalsize += size;
+    lock();
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (s_sinks.blocking > 0) {
+        waitConsoleSinks(level, len, lines);
     }
-    if (s_flushInterval > 0) {
-        if (currentTime - *flushedTime > s_flushInterval) {
-            fflush(fp);
-            *flushedTime = currentTime;
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    writeOutputs(level, buf, len, lines, currentTime);
+    if (hasFlag(s_logger, kSinkLogger)) {
+        autoFlushSinks(currentTime);
+    }
+    unlock();
+}
+
+/*
+ * Write formatted lines to the loggers, or to the scope of the thread or the flight recorder
+ * if they are below the log level.
+ * The lines are written at once, except to the loggers that need each line separately.
+ */
+static void writeLine(enum LogLevel level, const char* buf, size_t len, int lines, long currentTime)
+{
+    emitMetricsIfDue(currentTime);
+    if (!isLogged(level)) {
+        if (captureLines(level, buf, len, lines)) {
+            return;
         }
+        lock();
+        writeRing(&s_recorder.ring, buf, len);
+        unlock();
+        return;
     }
-    return totalsize;
+    writeLoggedLine(level, buf, len, lines, currentTime);
 }
 
 void logger_log(enum LogLevel level, const char* file, int line, const char* fmt, ...)
 {
-    struct timeval now;
+    struct LogTime now;
     long currentTime; /* milliseconds */
     char levelc;
     char timestamp[32];
     long threadID;
-    va_list carg, farg;
+    va_list arg;
+    char buf[kMaxLineLen];
+    size_t len;
 
     if (s_logger == 0 || !s_initialized) {
         assert(0 && "logger is not initialized");
@@ -352,26 +4787,348 @@ void logger_log(enum LogLevel level, const char* file, int line, const char* fmt
     if (!logger_isEnabled(level)) {
         return;
     }
-    gettimeofday(&now, NULL);
-    currentTime = now.tv_sec * 1000 + now.tv_usec / 1000;
+    if (!isLogged(level) && isScoped()) {
+        va_start(arg, fmt);
+        captureMessage(level, file, line, fmt, arg);
+        va_end(arg);
+        return;
+    }
+    getTime(&now);
+    currentTime = (long) now.sec * 1000 + now.nsec / 1000000;
     levelc = getLevelChar(level);
     getTimestamp(&now, timestamp, sizeof(timestamp));
     threadID = getCurrentThreadID();
-    lock();
-    if (hasFlag(s_logger, kConsoleLogger)) {
-        va_start(carg, fmt);
-        vflog(s_clog.output, levelc, timestamp, threadID,
-                file, line, fmt, carg, currentTime, &s_clog.flushedTime);
-        va_end(carg);
+    va_start(arg, fmt);
+    len = formatLine(buf, sizeof(buf), levelc, timestamp, threadID, file, line, fmt, arg);
+    va_end(arg);
+    profileSite(level, file, line, len, currentTime);
+    writeLine(level, buf, len, 1, currentTime);
+}
+
+void logger_logMessage(enum LogLevel level, const char* file, int line, const char* message, size_t len)
+{
+    struct LogTime now;
+    long currentTime; /* milliseconds */
+    char timestamp[32];
+    char buf[kMaxLineLen];
+    const char* end = buf + sizeof(buf) - 1; /* reserve a byte for LF */
+    char* out;
+
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
     }
-    if (hasFlag(s_logger, kFileLogger)) {
-        if (rotateLogFiles()) {
-            va_start(farg, fmt);
-            s_flog.currentFileSize += vflog(s_flog.output, levelc, timestamp, threadID,
-                    file, line, fmt, farg, currentTime, &s_flog.flushedTime);
-            va_end(farg);
+
+    if (!logger_isEnabled(level)) {
+        return;
+    }
+    getTime(&now);
+    currentTime = (long) now.sec * 1000 + now.nsec / 1000000;
+    getTimestamp(&now, timestamp, sizeof(timestamp));
+    out = formatHeader(buf, end, getLevelChar(level), timestamp, getCurrentThreadID(), file, line);
+    out = appendField(out, end, "", 0, message, len, 0, 0);
+    *out++ = '\n';
+    profileSite(level, file, line, out - buf, currentTime);
+    writeLine(level, buf, out - buf, 1, currentTime);
+}
+
+void logger_setHexFormat(int columns, size_t maxBytes)
+{
+    s_hexColumns = columns & (LogHex_OFFSET | LogHex_ASCII);
+    s_hexMaxBytes = maxBytes;
+}
+
+/* Mark the bytes left out with the total number of bytes */
+static char* appendHexMarker(char* out, const char* end, size_t len)
+{
+    char digits[24];
+    char* digitsEnd = &digits[sizeof(digits)];
+    const char* body;
+
+    body = formatDecimal(digitsEnd, (unsigned long long) len);
+    out = appendField(out, end, "... (", 5, body, digitsEnd - body, 0, 0);
+    return appendField(out, end, " bytes)", 7, "", 0, 0, 0);
+}
+
+void logger_logHex(enum LogLevel level, const char* file, int line, const void* data, size_t len,
+        const char* fmt, ...)
+{
+    struct LogTime now;
+    long currentTime; /* milliseconds */
+    char timestamp[32];
+    char buf[kMaxHexDumpLen];
+    const char* end = buf + kMaxLineLen - 1; /* reserve a byte for LF */
+    const unsigned char* bytes = (const unsigned char*) data;
+    int columns = s_hexColumns;
+    size_t maxBytes = s_hexMaxBytes;
+    size_t headerLen;
+    size_t shown;
+    size_t room;
+    size_t i;
+    int lines = 1;
+    char* out;
+    char* message;
+    va_list arg;
+
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    if (!logger_isEnabled(level)) {
+        return;
+    }
+    getTime(&now);
+    currentTime = (long) now.sec * 1000 + now.nsec / 1000000;
+    getTimestamp(&now, timestamp, sizeof(timestamp));
+    message = formatHeader(buf, end, getLevelChar(level), timestamp, getCurrentThreadID(), file, line);
+    headerLen = message - buf;
+    va_start(arg, fmt);
+    out = formatText(message, end, fmt, arg);
+    va_end(arg);
+    shown = (maxBytes > 0 && maxBytes < len) ? maxBytes : len;
+
+    if (columns == 0) {
+        if (out > message && len > 0) {
+            out = appendField(out, end, ": ", 2, "", 0, 0, 0);
+        }
+        room = (size_t) (end - out) / 2;
+        if (shown < len || shown > room) {
+            room = ((size_t) (end - out) > kHexMarkerLen) ? (end - out - kHexMarkerLen) / 2 : 0;
+            shown = (shown < room) ? shown : room;
+        }
+        out = encodeHex(out, bytes, shown);
+    } else {
+        /* a line for each row with the header of the message line */
+        end = buf + sizeof(buf) - 1;
+        for (i = 0; i < shown; i += kHexRowBytes) {
+            if ((size_t) (end - out) < 2 * (1 + headerLen) + kMaxHexRowLen + kHexMarkerLen) {
+                break; /* room for the marker line */
+            }
+            *out++ = '\n';
+            memcpy(out, buf, headerLen);
+            out = formatHexRow(out + headerLen, &bytes[i], (shown - i < kHexRowBytes) ? shown - i : kHexRowBytes,
+                    i, columns);
+            lines++;
+        }
+        if (i < shown) {
+            shown = i;
+        }
+        if (shown < len) {
+            *out++ = '\n';
+            memcpy(out, buf, headerLen);
+            out += headerLen;
+            lines++;
         }
     }
-    unlock();
+    if (shown < len) {
+        out = appendHexMarker(out, end, len);
+    }
+    *out++ = '\n';
+    profileSite(level, file, line, out - buf, currentTime);
+    writeLine(level, buf, out - buf, lines, currentTime);
+}
+
+void logger_batchBegin(struct LogBatch* batch, char* buffer, size_t size)
+{
+    struct LogTime now;
+
+    if (batch == NULL || buffer == NULL) {
+        assert(0 && "batch and buffer must not be NULL");
+        return;
+    }
+    batch->buffer = buffer;
+    batch->size = size;
+    batch->len = 0;
+    batch->lines = 0;
+    batch->level = LogLevel_TRACE;
+    getTime(&now);
+    batch->time = (long) now.sec * 1000 + now.nsec / 1000000;
+    getTimestamp(&now, batch->timestamp, sizeof(batch->timestamp));
+    batch->threadID = getCurrentThreadID();
+}
+
+void logger_batchAdd(struct LogBatch* batch, enum LogLevel level, const char* file, int line, const char* fmt, ...)
+{
+    va_list arg;
+    char buf[kMaxLineLen];
+    char* out = &batch->buffer[batch->len];
+    size_t len;
+
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    if (!isLogged(level)) {
+        return;
+    }
+    va_start(arg, fmt);
+    if (batch->size - batch->len >= kMaxLineLen) {
+        len = formatLine(out, kMaxLineLen, getLevelChar(level), batch->timestamp, batch->threadID,
+                file, line, fmt, arg);
+    } else {
+        len = formatLine(buf, sizeof(buf), getLevelChar(level), batch->timestamp, batch->threadID,
+                file, line, fmt, arg);
+        if (batch->size - batch->len < len) {
+            logger_batchCommit(batch);
+        }
+        if (batch->size < len) {
+            va_end(arg);
+            profileSite(level, file, line, len, batch->time);
+            writeLine(level, buf, len, 1, batch->time); /* larger than the buffer */
+            return;
+        }
+        memcpy(&batch->buffer[batch->len], buf, len);
+    }
+    va_end(arg);
+    profileSite(level, file, line, len, batch->time);
+    batch->len += len;
+    batch->lines++;
+    if (batch->level < level) {
+        batch->level = level;
+    }
+}
+
+void logger_batchCommit(struct LogBatch* batch)
+{
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return;
+    }
+
+    if (batch->len > 0) {
+        writeLine(batch->level, batch->buffer, batch->len, batch->lines, batch->time);
+    }
+    batch->len = 0;
+    batch->lines = 0;
+    batch->level = LogLevel_TRACE;
+}
+
+void logger_setScopeSize(size_t size)
+{
+    if (size == 0) {
+        size = kDefaultScopeSize;
+    }
+    s_scopes.size = (size > kMinScopeSize) ? size : kMinScopeSize;
+}
+
+int logger_scopeBegin(void)
+{
+    struct Scope* scope = t_scope;
+    size_t size = s_scopes.size;
+
+    if (s_logger == 0 || !s_initialized) {
+        assert(0 && "logger is not initialized");
+        return 0;
+    }
+    if (scope != NULL && scope->active) {
+        assert(0 && "a scope has already begun in this thread");
+        return 0;
+    }
+
+    if (scope == NULL || scope->size != size) {
+        free(scope);
+        t_scope = NULL;
+        if ((scope = (struct Scope*) malloc(offsetof(struct Scope, buffer) + size)) == NULL) {
+            fprintf(stderr, "ERROR: logger: Out of memory\n");
+            return 0;
+        }
+        scope->size = size;
+#if !defined(_WIN32) && !defined(_WIN64)
+        pthread_setspecific(s_scopes.key, scope);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+        t_scope = scope;
+    }
+    scope->len = 0;
+    scope->dropped = 0;
+    scope->active = 1; /* true */
+    t_levelCache.lowest = 0;
+    return 1;
+}
+
+/* Format the captured message after the header and return the end of the line */
+static char* formatScopeRecord(char* buf, const struct ScopeRecord* record, const char* text, size_t len,
+        long threadID)
+{
+    const char* end = buf + kMaxLineLen - 1; /* reserve a byte for LF */
+    char timestamp[32];
+    char* out;
+
+    getTimestamp(&record->time, timestamp, sizeof(timestamp));
+    out = formatPrefix(buf, end, getLevelChar(record->level), timestamp, threadID, record->file, record->line);
+    out = appendField(out, end, ": ", 2, text, len, 0, 0);
+    *out++ = '\n';
+    return out;
+}
+
+void logger_scopeCommit(void)
+{
+    struct Scope* scope = t_scope;
+    struct ScopeRecord record;
+    struct LogTime now;
+    long currentTime; /* milliseconds */
+    long threadID;
+    char chunk[kScopeChunkLen];
+    char marker[64];
+    const char* text;
+    enum LogLevel level = LogLevel_TRACE;
+    size_t offset;
+    size_t len = 0;
+    int lines = 0;
+
+    if (scope == NULL || !scope->active) {
+        assert(0 && "no scope has begun in this thread");
+        return;
+    }
+    scope->active = 0; /* false */
+    t_levelCache.lowest = 0;
+
+    getTime(&now);
+    currentTime = (long) now.sec * 1000 + now.nsec / 1000000;
+    threadID = getCurrentThreadID();
+    for (offset = 0; offset < scope->len; offset += sizeof(record) + record.len) {
+        memcpy(&record, &scope->buffer[offset], sizeof(record));
+        text = &scope->buffer[offset + sizeof(record)];
+        if (len > 0 && (record.file == NULL || sizeof(chunk) - len < 2 * kMaxLineLen)) {
+            writeLoggedLine(level, chunk, len, lines, currentTime);
+            len = 0;
+            lines = 0;
+            level = LogLevel_TRACE;
+        }
+        if (record.file == NULL) {
+            writeLoggedLine(record.level, text, record.len, record.line, currentTime);
+            continue;
+        }
+        if (offset == 0 && scope->dropped > 0) {
+            /* with the header of the oldest message kept */
+            sprintf(marker, "... %lu earlier messages dropped", scope->dropped);
+            len = formatScopeRecord(chunk, &record, marker, strlen(marker), threadID) - chunk;
+            lines++;
+        }
+        len = formatScopeRecord(&chunk[len], &record, text, record.len, threadID) - chunk;
+        lines++;
+        if (level < record.level) {
+            level = record.level;
+        }
+    }
+    if (len > 0) {
+        writeLoggedLine(level, chunk, len, lines, currentTime);
+    }
+    scope->len = 0;
+    scope->dropped = 0;
 }
 
+void logger_scopeDiscard(void)
+{
+    struct Scope* scope = t_scope;
+
+    if (scope == NULL || !scope->active) {
+        assert(0 && "no scope has begun in this thread");
+        return;
+    }
+    scope->active = 0; /* false */
+    t_levelCache.lowest = 0;
+    scope->len = 0;
+    scope->dropped = 0;
+}
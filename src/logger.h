@@ -7,6 +7,9 @@ extern "C" {
 
 #include <stdio.h>
 #include <string.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+ #include <sys/uio.h>
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
 
 #if defined(_WIN32) || defined(_WIN64)
  #define __FILENAME__ (strrchr(__FILE__, '\\') ? strrchr(__FILE__, '\\') + 1 : __FILE__)
@@ -21,6 +24,26 @@ extern "C" {
 #define LOG_ERROR(fmt, ...) logger_log(LogLevel_ERROR, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
 #define LOG_FATAL(fmt, ...) logger_log(LogLevel_FATAL, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
 
+#define LOG_BATCH(batch, level, fmt, ...) logger_batchAdd(batch, level, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__)
+
+#define LOG_COUNT(name) do { static int logger_metricID_; \
+        logger_addMetric(&logger_metricID_, name, 0, 1, __FILENAME__, __LINE__); } while (0)
+#define LOG_HIST(name, value) do { static int logger_metricID_; \
+        logger_addMetric(&logger_metricID_, name, 1, value, __FILENAME__, __LINE__); } while (0)
+
+#define LOG_HEX(level, ptr, len, fmt, ...) (logger_isEnabled(level) \
+        ? logger_logHex(level, __FILENAME__, __LINE__, ptr, len, fmt, ##__VA_ARGS__) : (void) 0)
+
+#define LOGGER_CONCAT_(a, b) LOGGER_CONCAT2_(a, b)
+#define LOGGER_CONCAT2_(a, b) a##b
+
+#if defined(__GNUC__) && !defined(__cplusplus) /* see logger.hpp for C++ */
+#define LOG_SCOPE_TIMER(level, name) LOG_SCOPE_TIMER_SLOW(level, name, 0)
+#define LOG_SCOPE_TIMER_SLOW(level, name, thresholdUs) \
+        struct LogScopeTimer LOGGER_CONCAT_(logger_scopeTimer_, __LINE__) __attribute__((cleanup(logger_timerEnd))) \
+        = logger_timerBegin(level, name, thresholdUs, __FILENAME__, __LINE__)
+#endif /* defined(__GNUC__) && !defined(__cplusplus) */
+
 enum LogLevel
 {
     LogLevel_TRACE,
@@ -31,9 +54,106 @@ enum LogLevel
     LogLevel_FATAL,
 };
 
+enum LogHexColumn
+{
+    LogHex_OFFSET = 1 << 0,
+    LogHex_ASCII = 1 << 1,
+};
+
+enum LogClock
+{
+    LogClock_REALTIME,
+    LogClock_REALTIME_COARSE,
+    LogClock_TSC,
+};
+
+enum LogIoUring
+{
+    LogIoUring_OFF,
+    LogIoUring_ON,
+    LogIoUring_SQPOLL,
+};
+
+#if defined(_WIN32) || defined(_WIN64)
+struct iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+#endif /* defined(_WIN32) || defined(_WIN64) */
+
+/* A custom destination of log lines. See logger_addSink(). */
+struct LogSink
+{
+    void (*writeBatch)(void* context, const struct iovec* lines, int n);
+    void (*flush)(void* context); /* may be NULL */
+    void (*close)(void* context); /* may be NULL */
+    void* context;
+};
+
+/* A file that gets the lines of a range of levels. See logger_addFileSink(). */
+struct LogFileSink
+{
+    const char* filename;
+    long maxFileSize; /* bytes, 1 MB if 0 */
+    unsigned char maxBackupFiles;
+    enum LogLevel minLevel;
+    enum LogLevel maxLevel;
+    size_t bufferSize; /* bytes, 8 KB if 0 */
+    long flushInterval; /* msec, 0 writes each line and a negative value only full buffers */
+    int sync; /* non-zero to call fsync() after each write */
+    enum LogIoUring ioUring; /* write through io_uring on Linux */
+};
+
+/* What a console sink does with a line when its queue is full */
+enum LogOverflow
+{
+    LogOverflow_DROP_NEWEST,
+    LogOverflow_DROP_OLDEST,
+    LogOverflow_BLOCK, /* waits up to the timeout and then drops the line */
+};
+
+/* A console written by a thread of its own. See logger_addConsoleSink(). */
+struct LogConsoleSink
+{
+    FILE* output; /* stdout if NULL */
+    enum LogLevel minLevel;
+    enum LogLevel maxLevel;
+    size_t queueSize; /* bytes, 64 KB if 0 */
+    enum LogOverflow overflow;
+    long blockTimeout; /* msec to wait with LogOverflow_BLOCK */
+};
+
+/* Log lines built in a buffer owned by the caller. See logger_batchBegin(). */
+struct LogBatch
+{
+    char* buffer;
+    size_t size;
+    size_t len;
+    int lines;
+    enum LogLevel level; /* the highest level added */
+    long time; /* milliseconds */
+    char timestamp[32];
+    long threadID;
+};
+
+/* The start of a scope timed by LOG_SCOPE_TIMER() */
+struct LogScopeTimer
+{
+    unsigned long long start; /* ticks of the clock, 0 if the level is disabled */
+    int tsc; /* whether the ticks are those of the timestamp counter */
+    enum LogLevel level;
+    long threshold; /* usec */
+    const char* name;
+    const char* file;
+    int line;
+};
+
 /**
  * Initialize the logger as a console logger.
- * If the file pointer is NULL, stdout will be used.
+ * If the file pointer is NULL, stdout will be used. The lines are written
+ * through stdio, which allocates the buffer of the stream on its first
+ * output unless it is set with setvbuf(); nothing is allocated after that.
  *
  * @param[in] output A file pointer. Make sure to set stdout or stderr.
  * @return Non-zero value upon success or 0 on error
@@ -51,6 +171,189 @@ int logger_initConsoleLogger(FILE* output);
  */
 int logger_initFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles);
 
+/**
+ * Initialize the logger as a sharded file logger.
+ * Each thread writes to its own file named `<filename>.<threadid>` with its
+ * own buffer and rotation, so threads do not contend for a lock.
+ * Each line is prefixed with a sequence number global to the process, and
+ * logger-merge merges the files back into one stream ordered by time.
+ * Shards for 64 threads, or as many as logger_setShardPoolSize() sets, are
+ * allocated here and reused after threads exit. Nothing is allocated while
+ * logging, so the lines of threads beyond the pool are dropped.
+ *
+ * @param[in] filename The base name of the output files
+ * @param[in] maxFileSize The maximum number of bytes to write to any one file
+ * @param[in] maxBackupFiles The maximum number of files for backup per thread
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initShardedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles);
+
+/**
+ * Set the number of threads that can log at once with the sharded file
+ * logger. It takes effect on the next logger_initShardedFileLogger(), which
+ * allocates more shards if needed but does not free any.
+ *
+ * @param[in] threads The number of threads, 64 if 0
+ */
+void logger_setShardPoolSize(int threads);
+
+/**
+ * Initialize the logger as a compressed file logger.
+ * Log lines are collected into 64 KB blocks, and a background thread
+ * compresses each block with zlib into an independent frame appended to
+ * the file, so a crash loses at most the block in memory.
+ * maxFileSize counts compressed bytes. logger-cat decompresses the file.
+ * It needs the library built with zlib and is not supported on Windows.
+ *
+ * @param[in] filename The name of the output file
+ * @param[in] maxFileSize The maximum number of compressed bytes to write to any one file
+ * @param[in] maxBackupFiles The maximum number of files for backup
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initCompressedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles);
+
+/**
+ * Initialize the logger as a file logger shared with other processes.
+ * Several processes can log to the same file: each line is appended with a
+ * single write, and rotation is coordinated through an advisory lock on
+ * `<filename>.lock` so that only one process renames the files.
+ * Lines are not buffered in this mode.
+ * This is not supported on Windows.
+ *
+ * @param[in] filename The name of the output file
+ * @param[in] maxFileSize The maximum number of bytes to write to any one file
+ * @param[in] maxBackupFiles The maximum number of files for backup
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initSharedFileLogger(const char* filename, long maxFileSize, unsigned char maxBackupFiles);
+
+/**
+ * Initialize the logger as a shared memory logger.
+ * Messages are appended to a ring buffer in a memory-mapped file shared by
+ * all processes that use the same filename (e.g. a file under /dev/shm),
+ * and are written out by a collector such as logger-collector.
+ * The file is created with the given size if it does not exist.
+ * Messages are dropped if the ring buffer is full.
+ * This is not supported on Windows.
+ *
+ * @param[in] filename The name of the shared memory file
+ * @param[in] size The size of the ring buffer in bytes (4 MB if 0)
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initShmLogger(const char* filename, size_t size);
+
+/**
+ * Move messages written by shared memory loggers to the file logger.
+ * The file is attached on the first call and created if it does not exist.
+ * Make sure to call logger_initFileLogger() before collecting.
+ *
+ * @param[in] filename The name of the shared memory file
+ * @param[in] size The size of the ring buffer in bytes (4 MB if 0)
+ * @return The number of bytes moved or -1 on error
+ */
+long logger_collectShmLogger(const char* filename, size_t size);
+
+/**
+ * Add a custom sink, which can be used alone or with the other loggers.
+ * Lines at or above the log level and from minLevel to maxLevel are
+ * collected and delivered to writeBatch() in vectors of up to 256 lines or
+ * 8 KB, each line ending with LF. They are delivered when the vector is
+ * full, on logger_flush() and at the auto flush interval, and then flush()
+ * is called. writeBatch() and flush() are called under the lock of the
+ * logger, so they must not log. Up to 8 sinks can be added.
+ *
+ * @param[in] sink The callbacks and the context passed to them, which are copied
+ * @param[in] minLevel The lowest level to deliver to the sink
+ * @param[in] maxLevel The highest level to deliver to the sink
+ * @return The ID of the sink upon success or 0 on error
+ */
+int logger_addSink(const struct LogSink* sink, enum LogLevel minLevel, enum LogLevel maxLevel);
+
+/**
+ * Add a sink that writes the lines from minLevel to maxLevel to a file.
+ * Each file sink has its own buffer, flush interval and rotation, so that
+ * e.g. errors are written at once while other lines are buffered heavily.
+ * A line is formatted once and copied to each sink whose range it is in.
+ * The buffered lines are written with one writev() and the file size is
+ * checked for rotation once for them. It is removed with logger_removeSink().
+ *
+ * With ioUring, the lines are copied to one of 8 buffers registered to an
+ * io_uring and submitted without waiting, so the writer blocks only when all
+ * the buffers are in flight, on rotation and on logger_flush(). sync links
+ * an fdatasync to each write. SQPOLL lets a kernel thread take the writes
+ * without a system call where the process is permitted to. The writes
+ * append at the end of the file as with writev(), so other processes may
+ * append to the same file. If the kernel has no io_uring or is older than
+ * 5.6, the file is written with writev() as without ioUring.
+ *
+ * @param[in] config The file name and the settings of the sink
+ * @return The ID of the sink upon success or 0 on error
+ */
+int logger_addFileSink(const struct LogFileSink* config);
+
+/**
+ * Add a sink that writes the lines from minLevel to maxLevel to a console,
+ * such as a pipe to a slow reader, without blocking the other loggers.
+ * The lines are copied to a bounded queue, which a thread of the sink
+ * writes to the console. When the queue is full, a line is dropped, or the
+ * oldest lines are dropped for it, or the logging thread waits for space up
+ * to blockTimeout. A waiting thread does not hold the lock of the logger, so
+ * only the threads whose lines go to the sink wait, while the others keep
+ * logging; the lines of those threads may be written in a different order
+ * than the lines of the threads that do not wait. After a timeout, lines are
+ * dropped without waiting until the writer thread makes progress. Combining
+ * (see logger_setCombining()) is not used while such a sink is added.
+ * logger_flush() waits until the queue is written.
+ * It is not supported on Windows.
+ *
+ * @param[in] config The console and the settings of the sink
+ * @return The ID of the sink upon success or 0 on error
+ */
+int logger_addConsoleSink(const struct LogConsoleSink* config);
+
+/**
+ * Get the number of lines a console sink has dropped.
+ *
+ * @param[in] id The ID of the sink returned by logger_addConsoleSink()
+ * @return The number of lines, or 0 if the sink is not a console sink
+ */
+unsigned long logger_getDroppedLines(int id);
+
+/**
+ * Deliver the collected lines to a sink, and then remove it and call its close().
+ * close() is called without the lock of the logger, so other threads keep
+ * logging while e.g. a console sink writes the rest of its queue.
+ *
+ * @param[in] id The ID of the sink returned by logger_addSink()
+ */
+void logger_removeSink(int id);
+
+/**
+ * Write a sparse time index beside the file of the file logger.
+ * Every `interval` bytes, a line of the timestamp and the byte offset of the
+ * next log line is added to `<filename>.idx`, which is rotated together with
+ * the file. logger-query uses it to seek to a time range.
+ * The index is not written by the shared file logger.
+ * It is off by default.
+ *
+ * @param[in] interval The number of bytes between index entries. Switch off if 0 or a negative integer.
+ */
+void logger_setFileIndex(long interval);
+
+/**
+ * Set the clock used for timestamps.
+ * REALTIME reads the wall clock, and REALTIME_COARSE reads it at the
+ * resolution of the system tick at a lower cost.
+ * TSC reads the timestamp counter of the CPU (x86-64 and arm64), which is
+ * calibrated against the wall clock for about 10 ms here and anchored to it
+ * again every second. Timestamps then have nanoseconds.
+ * The default clock is REALTIME.
+ *
+ * @param[in] clock A clock
+ * @return Non-zero value upon success or 0 if the clock is not supported, in which case REALTIME is used
+ */
+int logger_setClock(enum LogClock clock);
+
 /**
  * Set the log level.
  * Message levels lower than this value will be discarded.
@@ -68,13 +371,116 @@ void logger_setLevel(enum LogLevel level);
  */
 enum LogLevel logger_getLevel(void);
 
+/**
+ * Set the log level of the current thread.
+ * Messages are logged at the lower of this level and the log level, so it
+ * enables DEBUG or TRACE for one thread, e.g. while it serves a request.
+ * The default thread level is FATAL, which does not lower the log level.
+ *
+ * @param[in] level A log level
+ */
+void logger_setThreadLevel(enum LogLevel level);
+
+/**
+ * Get the log level of the current thread that has been set.
+ *
+ * @return The log level of the current thread
+ */
+enum LogLevel logger_getThreadLevel(void);
+
+/**
+ * Set the log level of the current thread until logger_popThreadLevel() is called.
+ * Up to 16 levels can be pushed at a time.
+ *
+ * @param[in] level A log level
+ * @return Non-zero value upon success or 0 if too many levels are pushed
+ */
+int logger_pushThreadLevel(enum LogLevel level);
+
+/**
+ * Restore the log level of the current thread set before the last logger_pushThreadLevel().
+ */
+void logger_popThreadLevel(void);
+
+/**
+ * Get the ID of a named logger, which is added on the first call.
+ * The lines logged by a thread using a named logger are filtered with the
+ * level of the logger and delivered to the sinks attached to it, and to the
+ * sinks not attached to any logger. The console and file loggers get the
+ * lines of all the loggers. The root logger, whose ID is 0, is used by
+ * default and has the log level. Up to 15 loggers can be named.
+ *
+ * @param[in] name The name of the logger, "root" for the root logger
+ * @return The ID of the logger or -1 on error
+ */
+int logger_getLogger(const char* name);
+
+/**
+ * Log from the current thread with a named logger.
+ *
+ * @param[in] id The ID of the logger returned by logger_getLogger()
+ * @return The ID of the logger the thread used before
+ */
+int logger_useLogger(int id);
+
+/**
+ * Set the level of a named logger, which follows the log level until it is set.
+ *
+ * @param[in] id The ID of the logger returned by logger_getLogger()
+ * @param[in] level A log level
+ */
+void logger_setLoggerLevel(int id, enum LogLevel level);
+
+/**
+ * Deliver the lines of a named logger to a sink. A sink attached to any
+ * logger gets the lines of the loggers it is attached to only.
+ *
+ * @param[in] id The ID of the logger returned by logger_getLogger()
+ * @param[in] sinkID The ID of the sink returned by logger_addSink() and the like
+ * @return Non-zero value upon success or 0 if there is no such sink
+ */
+int logger_attachSink(int id, int sinkID);
+
+/**
+ * Add a key and a value to the context of the current thread.
+ * The context is written before the message of every line the thread logs,
+ * as in `file:line: [req=42 tenant=acme] message`. It is rendered here,
+ * so logging only copies it. The value is written as it is.
+ * Up to 16 entries and 512 bytes can be pushed at a time.
+ *
+ * @param[in] key A key
+ * @param[in] value A value
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_ctxPush(const char* key, const char* value);
+
+/**
+ * Remove the entry added last to the context of the current thread.
+ */
+void logger_ctxPop(void);
+
 /**
  * Check if a message of the level would actually be logged.
+ * Levels kept by the flight recorder are also enabled, and so are all
+ * levels while a scope of the thread captures messages.
  *
  * @return Non-zero value if the log level is enabled
  */
 int logger_isEnabled(enum LogLevel level);
 
+/**
+ * Write the lines of other threads while holding the lock.
+ * A thread publishes its line and tries to take the lock. The thread that
+ * takes it writes the lines published by all threads, and flushes the
+ * sinks once for them, while the others wait for their lines to be
+ * written without taking the lock. A line has been written when the log
+ * function returns either way. This raises the throughput when many
+ * threads log at once. It is off in default.
+ *
+ * @param[in] enabled Non-zero value to switch on, or 0 to switch off
+ */
+void logger_setCombining(int enabled);
+
 /**
  * Flush automatically.
  * Auto flush is off in default.
@@ -88,12 +494,61 @@ void logger_autoFlush(long interval);
  */
 void logger_flush(void);
 
+/**
+ * Initialize the flight recorder.
+ * Messages at or above the given level but below the log level are kept in
+ * an in-memory ring buffer instead of being discarded. When an ERROR or FATAL
+ * message is logged or logger_dumpFlightRecorder() is called, the buffered
+ * messages are written to the file logger (or the console logger if there is
+ * no file logger). The oldest messages are overwritten when the ring is full.
+ * The ring is shared by all threads, so the dump has the lines of every
+ * thread in the order they were logged.
+ * If the size is 0, the flight recorder is switched off.
+ *
+ * @param[in] size The size of the ring buffer in bytes
+ * @param[in] level The lowest level to record
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initFlightRecorder(size_t size, enum LogLevel level);
+
+/**
+ * Write the messages kept by the flight recorder and empty it.
+ */
+void logger_dumpFlightRecorder(void);
+
+/**
+ * Initialize the call site profile.
+ * The messages and bytes logged from each `file:line` are counted without
+ * a lock, so that the sites producing the most output can be found.
+ * Messages kept by the flight recorder are not counted.
+ * Messages from more sites than maxSites are counted as dropped.
+ * Call this before logging from other threads.
+ * If maxSites is 0, the profile is switched off.
+ *
+ * @param[in] maxSites The maximum number of call sites to count
+ * @param[in] topN The number of sites printed by a dump
+ * @param[in] dumpInterval An interval in milliseconds to dump to stderr. Switch off if 0 or a negative integer.
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_initSiteProfile(size_t maxSites, int topN, long dumpInterval);
+
+/**
+ * Print the top sites by bytes, with the messages and bytes logged from
+ * them and their rates since the previous dump.
+ * If the file pointer is NULL, stderr will be used.
+ *
+ * @param[in] output A file pointer
+ */
+void logger_dumpSiteProfile(FILE* output);
+
 /**
  * Log a message.
  * Make sure to call one of the following initialize functions before starting logging.
  * - logger_initConsoleLogger()
  * - logger_initFileLogger()
  *
+ * A line longer than 4 KB is truncated.
+ *
  * @param[in] level A log level
  * @param[in] file A file name string
  * @param[in] line A line number
@@ -102,6 +557,180 @@ void logger_flush(void);
  */
 void logger_log(enum LogLevel level, const char* file, int line, const char* fmt, ...);
 
+/**
+ * Log a message that has already been formatted.
+ *
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] message A message, which need not be null-terminated
+ * @param[in] len The length of the message
+ */
+void logger_logMessage(enum LogLevel level, const char* file, int line, const char* message, size_t len);
+
+/**
+ * Set the format of the bytes logged with LOG_HEX().
+ * Without columns, the bytes follow the message on its line as hex digits.
+ * With columns, the message is followed by a line for each 16 bytes, which
+ * has the header of the message line, the offset of the first byte, the
+ * bytes in hex and the bytes as ASCII characters.
+ * Bytes beyond maxBytes, or beyond what fits in 4 KB without columns and
+ * in 16 KB with columns, are left out and marked with `...` and the total
+ * number of bytes.
+ * The default is no columns and no maximum.
+ *
+ * @param[in] columns LogHex_OFFSET and LogHex_ASCII combined with `|`, or 0
+ * @param[in] maxBytes The maximum number of bytes to log. No maximum if 0.
+ */
+void logger_setHexFormat(int columns, size_t maxBytes);
+
+/**
+ * Log a message followed by bytes in hex, see logger_setHexFormat().
+ * The bytes are encoded straight into the line buffer. LOG_HEX() checks
+ * the level before the arguments are evaluated.
+ *
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] data The bytes
+ * @param[in] len The number of bytes
+ * @param[in] fmt A format string
+ * @param[in] ... Additional arguments
+ */
+void logger_logHex(enum LogLevel level, const char* file, int line, const void* data, size_t len,
+        const char* fmt, ...);
+
+/**
+ * Start timing a scope. Use LOG_SCOPE_TIMER() or LOG_SCOPE_TIMER_SLOW()
+ * instead, which log the elapsed time as `name: 12.345 us` when the scope
+ * exits, or only if it is not shorter than the threshold.
+ * The time is taken from the monotonic clock, or from the timestamp counter
+ * if it is the clock set by logger_setClock(). If the level is disabled,
+ * the clock is not read and nothing is logged.
+ * In C, the macros need GCC or Clang for the cleanup attribute.
+ *
+ * @param[in] level A log level
+ * @param[in] name The name of the scope, which must outlive it
+ * @param[in] threshold The shortest time to log in microseconds
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @return The start of the scope, which is passed to logger_timerEnd()
+ */
+struct LogScopeTimer logger_timerBegin(enum LogLevel level, const char* name, long threshold,
+        const char* file, int line);
+
+/**
+ * Log the time elapsed since logger_timerBegin().
+ *
+ * @param[in] timer The start of the scope
+ */
+void logger_timerEnd(struct LogScopeTimer* timer);
+
+/**
+ * Begin a batch of log lines.
+ * The lines added to a batch are formatted into the buffer and written at
+ * once by logger_batchCommit(), which takes the lock and checks the file
+ * size for rotation once for the whole batch. All lines of the batch have
+ * the time and the thread ID taken here. The batch is committed
+ * automatically when the buffer is full, and a buffer of 64 KB or so suits
+ * most bursts. A batch is used by one thread at a time.
+ *
+ * @param[in] batch A batch
+ * @param[in] buffer A buffer for the formatted lines
+ * @param[in] size The size of the buffer in bytes
+ */
+void logger_batchBegin(struct LogBatch* batch, char* buffer, size_t size);
+
+/**
+ * Add a message to a batch.
+ * Messages that would not be logged are discarded, even if the flight
+ * recorder would keep them.
+ *
+ * @param[in] batch A batch
+ * @param[in] level A log level
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ * @param[in] fmt A format string
+ * @param[in] ... Additional arguments
+ */
+void logger_batchAdd(struct LogBatch* batch, enum LogLevel level, const char* file, int line, const char* fmt, ...);
+
+/**
+ * Write the lines of a batch to the loggers.
+ * The batch can be used again until the next logger_batchBegin().
+ *
+ * @param[in] batch A batch
+ */
+void logger_batchCommit(struct LogBatch* batch);
+
+/**
+ * Aggregate the values of LOG_COUNT() and LOG_HIST() and write a line for
+ * each metric every interval instead of a line for each value.
+ * A line has the number of values and their rate, and for LOG_HIST() the
+ * minimum, the median, the 99th percentile and the maximum, where the
+ * percentiles are within 1/16 of the value. It is written with the level
+ * and the location of the first call of the metric, and is left out if
+ * nothing is added to the metric in the interval.
+ * Each thread adds to its own values without a lock. The lines are
+ * written by a thread that logs or adds to a metric after the interval,
+ * which checks the time every 256 additions, or by logger_emitMetrics().
+ * Up to 64 metrics with names shorter than 48 bytes can be used.
+ * If the interval is 0, the metrics are switched off, which is the default.
+ *
+ * @param[in] interval An interval in milliseconds
+ * @param[in] level The level of the lines
+ */
+void logger_initMetrics(long interval, enum LogLevel level);
+
+/**
+ * Write the lines of the metrics added to since the previous lines.
+ */
+void logger_emitMetrics(void);
+
+/**
+ * Add a value to a metric. Use LOG_COUNT() or LOG_HIST() instead.
+ *
+ * @param[in,out] id The ID of the metric cached for the call site, 0 at first
+ * @param[in] name The name of the metric
+ * @param[in] histogram Non-zero value for a histogram of the values
+ * @param[in] value A value
+ * @param[in] file A file name string
+ * @param[in] line A line number
+ */
+void logger_addMetric(int* id, const char* name, int histogram, long value, const char* file, int line);
+
+/**
+ * Set the size of the buffer of a scope, see logger_scopeBegin().
+ * A thread allocates its buffer on its first scope, and again when the
+ * size has been changed. The default size is 64 KB, and the minimum is 8 KB.
+ *
+ * @param[in] size The size of the buffer in bytes, the default if 0
+ */
+void logger_setScopeSize(size_t size);
+
+/**
+ * Begin to capture the messages of this thread below the log level, e.g.
+ * while a request is served, so that the details are logged only for a
+ * request that fails. A message is captured in a buffer of the thread
+ * with its time but without the header, which is formatted on commit.
+ * Messages of the log level and above are written as usual. When the
+ * buffer is full, the oldest messages are dropped, which is noted on
+ * commit. The messages of a batch are not captured.
+ *
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_scopeBegin(void);
+
+/**
+ * Write the messages captured since logger_scopeBegin() and end the scope.
+ */
+void logger_scopeCommit(void);
+
+/**
+ * Drop the messages captured since logger_scopeBegin() and end the scope.
+ */
+void logger_scopeDiscard(void);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
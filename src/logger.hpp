@@ -0,0 +1,339 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include "logger.h"
+
+/*
+ * Type-safe logging macros for C++11 or later.
+ * Each `{}` in the format string is replaced with the next argument, and
+ * `{{` and `}}` are written as `{` and `}`. The number of fields is checked
+ * against the number of arguments at compile time.
+ *
+ *   LOGI("x={} y={}", x, y);
+ */
+#define LOGT(fmt, ...) LOGGER_LOG_(LogLevel_TRACE, fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) LOGGER_LOG_(LogLevel_DEBUG, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...) LOGGER_LOG_(LogLevel_INFO , fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) LOGGER_LOG_(LogLevel_WARN , fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) LOGGER_LOG_(LogLevel_ERROR, fmt, ##__VA_ARGS__)
+#define LOGF(fmt, ...) LOGGER_LOG_(LogLevel_FATAL, fmt, ##__VA_ARGS__)
+
+#define LOGGER_LOG_(level, fmt, ...) do { \
+    static_assert(::logger::detail::countFields(fmt) >= 0, \
+            "unmatched '{' or '}' in the format string"); \
+    static_assert(::logger::detail::countFields(fmt) \
+            == decltype(::logger::detail::countArgs(__VA_ARGS__))::value, \
+            "the number of {} fields does not match the number of arguments"); \
+    if (logger_isEnabled(level)) { \
+        ::logger::detail::log(level, __FILENAME__, __LINE__, fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+
+/*
+ * Log the time elapsed in the current scope when it exits, or only if it is
+ * not shorter than the threshold in microseconds. See logger_timerBegin().
+ *
+ *   LOG_SCOPE_TIMER(LogLevel_DEBUG, "parse");
+ *   LOG_SCOPE_TIMER_SLOW(LogLevel_WARN, "query", 10000);
+ */
+#define LOG_SCOPE_TIMER(level, name) LOG_SCOPE_TIMER_SLOW(level, name, 0)
+#define LOG_SCOPE_TIMER_SLOW(level, name, thresholdUs) \
+    ::logger::ScopeTimer LOGGER_CONCAT_(logger_scopeTimer_, __LINE__)(level, name, thresholdUs, \
+            __FILENAME__, __LINE__)
+
+namespace logger {
+
+/*
+ * Lower the log level of the current thread while the object is alive.
+ *
+ *   logger::ThreadLevel trace(LogLevel_TRACE);
+ */
+class ThreadLevel
+{
+public:
+    explicit ThreadLevel(enum LogLevel level) : pushed_(logger_pushThreadLevel(level) != 0) {}
+    ~ThreadLevel()
+    {
+        if (pushed_) {
+            logger_popThreadLevel();
+        }
+    }
+    ThreadLevel(const ThreadLevel&) = delete;
+    ThreadLevel& operator=(const ThreadLevel&) = delete;
+
+private:
+    bool pushed_;
+};
+
+/*
+ * Add a key and a value to the context of the current thread while the object is alive.
+ *
+ *   logger::Context req("req", id);
+ */
+class Context
+{
+public:
+    Context(const char* key, const char* value) : pushed_(logger_ctxPush(key, value) != 0) {}
+    Context(const char* key, const std::string& value) : Context(key, value.c_str()) {}
+    ~Context()
+    {
+        if (pushed_) {
+            logger_ctxPop();
+        }
+    }
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+private:
+    bool pushed_;
+};
+
+/*
+ * Log from the current thread with a named logger while the object is alive.
+ *
+ *   logger::UseLogger net("net");
+ */
+class UseLogger
+{
+public:
+    explicit UseLogger(const char* name) : previous_(logger_useLogger(idOf(name))) {}
+    ~UseLogger()
+    {
+        logger_useLogger(previous_);
+    }
+    UseLogger(const UseLogger&) = delete;
+    UseLogger& operator=(const UseLogger&) = delete;
+
+private:
+    static int idOf(const char* name)
+    {
+        int id = logger_getLogger(name);
+        return (id < 0) ? 0 : id; /* the root logger if there are too many */
+    }
+
+    int previous_;
+};
+
+/*
+ * Log the time elapsed while the object is alive. Use LOG_SCOPE_TIMER() instead.
+ */
+class ScopeTimer
+{
+public:
+    ScopeTimer(enum LogLevel level, const char* name, long thresholdUs, const char* file, int line)
+        : timer_(logger_timerBegin(level, name, thresholdUs, file, line)) {}
+    ~ScopeTimer()
+    {
+        logger_timerEnd(&timer_);
+    }
+    ScopeTimer(const ScopeTimer&) = delete;
+    ScopeTimer& operator=(const ScopeTimer&) = delete;
+
+private:
+    struct LogScopeTimer timer_;
+};
+
+namespace detail {
+
+/* Return the number of `{}` fields, or -1 if a brace is unmatched */
+constexpr int countFields(const char* s, int n = 0)
+{
+    return (*s == '\0') ? n
+        : (s[0] == '{' && s[1] == '{') ? countFields(s + 2, n)
+        : (s[0] == '}' && s[1] == '}') ? countFields(s + 2, n)
+        : (s[0] == '{' && s[1] == '}') ? countFields(s + 2, n + 1)
+        : (s[0] == '{' || s[0] == '}') ? -1
+        : countFields(s + 1, n);
+}
+
+template <typename... Args>
+std::integral_constant<int, sizeof...(Args)> countArgs(const Args&...);
+
+class Writer
+{
+public:
+    Writer(char* buf, std::size_t size) : begin_(buf), out_(buf), end_(buf + size) {}
+
+    void append(const char* s, std::size_t n)
+    {
+        if (n > static_cast<std::size_t>(end_ - out_)) {
+            n = end_ - out_;
+        }
+        std::memcpy(out_, s, n);
+        out_ += n;
+    }
+
+    void append(char c)
+    {
+        if (out_ < end_) {
+            *out_++ = c;
+        }
+    }
+
+    const char* data() const { return begin_; }
+    std::size_t size() const { return out_ - begin_; }
+
+private:
+    char* begin_;
+    char* out_;
+    char* end_;
+};
+
+/* Copy the literal text up to the next field and return the position after it */
+inline const char* putLiteral(Writer& w, const char* fmt)
+{
+    const char* literal = fmt;
+
+    for (;;) {
+        if (*fmt == '\0') {
+            w.append(literal, fmt - literal);
+            return fmt;
+        }
+        if (fmt[0] == '{' || fmt[0] == '}') {
+            w.append(literal, fmt - literal);
+            if (fmt[0] == '{' && fmt[1] == '}') {
+                return fmt + 2;
+            }
+            w.append(fmt[0]); /* escaped brace */
+            fmt += 2;
+            literal = fmt;
+            continue;
+        }
+        fmt++;
+    }
+}
+
+inline void putUnsigned(Writer& w, unsigned long long value, bool negative)
+{
+    static const char kDigitPairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    char digits[24];
+    char* p = &digits[sizeof(digits)];
+
+    while (value >= 100) {
+        const char* pair = &kDigitPairs[(value % 100) * 2];
+        value /= 100;
+        *--p = pair[1];
+        *--p = pair[0];
+    }
+    if (value >= 10) {
+        *--p = kDigitPairs[value * 2 + 1];
+        *--p = kDigitPairs[value * 2];
+    } else {
+        *--p = static_cast<char>('0' + value);
+    }
+    if (negative) {
+        *--p = '-';
+    }
+    w.append(p, &digits[sizeof(digits)] - p);
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+put(Writer& w, T value)
+{
+    if (value < 0) {
+        putUnsigned(w, 0ULL - static_cast<unsigned long long>(value), true);
+    } else {
+        putUnsigned(w, static_cast<unsigned long long>(value), false);
+    }
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+put(Writer& w, T value)
+{
+    putUnsigned(w, value, false);
+}
+
+inline void put(Writer& w, char c) { w.append(c); }
+inline void put(Writer& w, bool b) { b ? w.append("true", 4) : w.append("false", 5); }
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+put(Writer& w, T value)
+{
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%g", static_cast<double>(value));
+    w.append(buf, (n > 0) ? n : 0);
+}
+
+inline void put(Writer& w, const char* s)
+{
+    if (s == NULL) {
+        w.append("(null)", 6);
+    } else {
+        w.append(s, std::strlen(s));
+    }
+}
+
+inline void put(Writer& w, const std::string& s) { w.append(s.data(), s.size()); }
+
+inline void putPointer(Writer& w, const void* p, std::true_type /* string */)
+{
+    put(w, static_cast<const char*>(p));
+}
+
+inline void putPointer(Writer& w, const void* p, std::false_type /* string */)
+{
+    static const char kHexDigits[] = "0123456789abcdef";
+    char digits[2 + sizeof(void*) * 2];
+    char* q = &digits[sizeof(digits)];
+    std::size_t value = reinterpret_cast<std::size_t>(p);
+
+    do {
+        *--q = kHexDigits[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    *--q = 'x';
+    *--q = '0';
+    w.append(q, &digits[sizeof(digits)] - q);
+}
+
+template <typename T>
+void put(Writer& w, T* p)
+{
+    putPointer(w, p, std::is_same<typename std::remove_cv<T>::type, char>());
+}
+
+inline void format(Writer& w, const char* fmt)
+{
+    putLiteral(w, fmt);
+}
+
+template <typename T, typename... Rest>
+void format(Writer& w, const char* fmt, const T& first, const Rest&... rest)
+{
+    fmt = putLiteral(w, fmt);
+    put(w, first);
+    format(w, fmt, rest...);
+}
+
+template <typename... Args>
+void log(enum LogLevel level, const char* file, int line, const char* fmt, const Args&... args)
+{
+    char buf[4096];
+    Writer w(buf, sizeof(buf));
+
+    format(w, fmt, args...);
+    logger_logMessage(level, file, line, w.data(), w.size());
+}
+
+} /* namespace detail */
+} /* namespace logger */
+
+#endif /* LOGGER_HPP */
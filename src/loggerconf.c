@@ -1,6 +1,12 @@
 #include "loggerconf.h"
+#if defined(_WIN32) || defined(_WIN64)
+ #include <windows.h>
+#else
+ #include <pthread.h>
+#endif /* defined(_WIN32) || defined(_WIN64) */
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,181 +18,735 @@ enum
     kConsoleLogger = 1 << 0,
     kFileLogger = 1 << 1,
 
+    /* Sink type */
+    kFileSink = 1,
+    kConsoleSink = 2,
+
     kMaxFileNameLen = 256,
-    kMaxLineLen = 512,
+    kMaxValueLen = 512,
+    kMaxSinks = 8,
+    kMaxLoggers = 15, /* named loggers besides the root logger */
+    kMaxNameLen = 32,
+    kMaxKeyParts = 4,
 };
 
-/* Console logger */
-static struct
+/* A part of the text, which is not terminated with NUL */
+struct Span
 {
-    FILE* output;
-}
-s_clog;
+    const char* s;
+    size_t len;
+};
 
-/* File logger */
-static struct
+/* A sink declared with `sink.<name>.<key>` or `logger.file.<name>.<key>` */
+struct SinkConf
 {
+    char name[kMaxNameLen];
+    int line; /* where it is declared */
+    int type;
+    int async; /* -1 if not set */
+    struct Span fileKey; /* the first key of a file sink only, checked against the type */
+    int fileKeyLine;
+    struct Span consoleKey; /* the first key of a console sink only */
+    int consoleKeyLine;
+    char filename[kMaxFileNameLen];
+    struct LogFileSink file;
+    struct LogConsoleSink console;
+};
+
+/* A named logger declared with `logger.<name>.<key>` */
+struct LoggerConf
+{
+    char name[kMaxNameLen];
+    int line; /* where it is declared */
+    int hasLevel;
+    enum LogLevel level;
+    int nsinks;
+    char sinks[kMaxSinks][kMaxNameLen];
+};
+
+/* What a configuration sets, which is applied only if it has no error */
+struct Config
+{
+    const char* source; /* the file name for errors */
+    int line;
+    int errors;
+    int logger;
+    int hasLevel;
+    enum LogLevel level;
+    int hasAutoFlush;
+    long autoFlush;
+    int hasClock;
+    enum LogClock clock;
+    int hasCombining;
+    int combining;
+    int hasFileIndex;
+    long fileIndex;
+    FILE* consoleOutput;
     char filename[kMaxFileNameLen];
     long maxFileSize;
     unsigned char maxBackupFiles;
-}
-s_flog;
+    int shared;
+    int nsinks;
+    struct SinkConf sinks[kMaxSinks];
+    int nloggers;
+    struct LoggerConf loggers[kMaxLoggers];
+};
 
-static int s_logger;
+static int s_sinkIDs[kMaxSinks]; /* added by the last configuration */
+#if defined(_WIN32) || defined(_WIN64)
+static SRWLOCK s_mutex = SRWLOCK_INIT; /* one configuration is applied at a time */
+#else
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER; /* one configuration is applied at a time */
+#endif /* defined(_WIN32) || defined(_WIN64) */
 
-static void reset(void);
-static void removeComments(char* s);
-static void trim(char* s);
-static void parseLine(char* line);
-static int hasFlag(int flags, int flag);
+static int configure(const char* text, size_t len, const char* source);
 
 int logger_configure(const char* filename)
 {
     FILE* fp;
-    char line[kMaxLineLen];
+    char* text;
+    long size;
+    int ok;
 
     if (filename == NULL) {
         assert(0 && "filename must not be NULL");
         return 0;
     }
 
-    reset();
-    if ((fp = fopen(filename, "r")) == NULL) {
+    if ((fp = fopen(filename, "rb")) == NULL) {
         fprintf(stderr, "ERROR: loggerconf: Failed to open file: `%s`\n", filename);
         return 0;
     }
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        removeComments(line);
-        trim(line);
-        if (line[0] == '\0') {
-            continue;
-        }
-        parseLine(line);
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "ERROR: loggerconf: Failed to read file: `%s`\n", filename);
+        fclose(fp);
+        return 0;
     }
+    if ((text = (char*) malloc((size_t) size + 1)) == NULL) {
+        fprintf(stderr, "ERROR: loggerconf: Out of memory\n");
+        fclose(fp);
+        return 0;
+    }
+    size = (long) fread(text, 1, (size_t) size, fp);
     fclose(fp);
+    ok = configure(text, (size_t) size, filename);
+    free(text);
+    return ok;
+}
 
-    if (hasFlag(s_logger, kConsoleLogger)) {
-        if (!logger_initConsoleLogger(s_clog.output)) {
-            return 0;
+int logger_configureText(const char* text)
+{
+    if (text == NULL) {
+        assert(0 && "text must not be NULL");
+        return 0;
+    }
+    return configure(text, strlen(text), "<text>");
+}
+
+static void reportError(struct Config* config, const char* message, struct Span text)
+{
+    fprintf(stderr, "ERROR: loggerconf: %s:%d: %s: `%.*s`\n",
+            config->source, config->line, message, (int) text.len, text.s);
+    config->errors++;
+}
+
+static struct Span makeSpan(const char* s)
+{
+    struct Span span;
+
+    span.s = s;
+    span.len = strlen(s);
+    return span;
+}
+
+static int isSpan(struct Span span, const char* s)
+{
+    return strncmp(span.s, s, span.len) == 0 && s[span.len] == '\0';
+}
+
+static struct Span trimSpan(const char* s, const char* end)
+{
+    struct Span span;
+
+    for (; s < end && isspace((unsigned char) *s); s++) {}
+    for (; end > s && isspace((unsigned char) end[-1]); end--) {}
+    span.s = s;
+    span.len = (size_t) (end - s);
+    return span;
+}
+
+/* Copy a span to a buffer with NUL, reporting an error if it does not fit */
+static int copySpan(struct Config* config, char* buf, size_t size, struct Span span)
+{
+    if (span.len >= size) {
+        reportError(config, "Too long", span);
+        return 0;
+    }
+    memcpy(buf, span.s, span.len);
+    buf[span.len] = '\0';
+    return 1;
+}
+
+static int parseLevel(struct Config* config, struct Span val, enum LogLevel* level)
+{
+    static const char* const kLevels[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+    int i;
+
+    for (i = 0; i < (int) (sizeof(kLevels) / sizeof(kLevels[0])); i++) {
+        if (isSpan(val, kLevels[i])) {
+            *level = (enum LogLevel) i;
+            return 1;
         }
     }
-    if (hasFlag(s_logger, kFileLogger)) {
-        if (!logger_initFileLogger(s_flog.filename, s_flog.maxFileSize, s_flog.maxBackupFiles)) {
-            return 0;
+    reportError(config, "Invalid level", val);
+    return 0;
+}
+
+static int parseLong(struct Config* config, struct Span val, long* n)
+{
+    char buf[32];
+    char* end;
+
+    if (val.len < sizeof(buf)) {
+        memcpy(buf, val.s, val.len);
+        buf[val.len] = '\0';
+        errno = 0;
+        *n = strtol(buf, &end, 10);
+        if (end != buf && *end == '\0' && errno == 0) {
+            return 1;
         }
     }
-    if (s_logger == 0) {
+    reportError(config, "Invalid number", val);
+    return 0;
+}
+
+static int parseBool(struct Config* config, struct Span val, int* b)
+{
+    if (isSpan(val, "1") || isSpan(val, "on") || isSpan(val, "true")) {
+        *b = 1; /* true */
+    } else if (isSpan(val, "0") || isSpan(val, "off") || isSpan(val, "false")) {
+        *b = 0; /* false */
+    } else {
+        reportError(config, "Invalid boolean", val);
         return 0;
     }
     return 1;
 }
 
-static void reset(void)
+static int parseOutput(struct Config* config, struct Span val, FILE** output)
 {
-    s_logger = 0;
-    memset(&s_clog, 0, sizeof(s_clog));
-    memset(&s_flog, 0, sizeof(s_flog));
+    if (isSpan(val, "stdout")) {
+        *output = stdout;
+    } else if (isSpan(val, "stderr")) {
+        *output = stderr;
+    } else {
+        reportError(config, "Invalid output", val);
+        return 0;
+    }
+    return 1;
 }
 
-static void removeComments(char* s)
+/* Check a name of a sink or a logger, which is any text but dots up to 31 bytes */
+static int isValidName(struct Config* config, struct Span name)
 {
+    if (name.len == 0 || name.len >= kMaxNameLen) {
+        reportError(config, "Invalid name", name);
+        return 0;
+    }
+    return 1;
+}
+
+/* Find the sink of the name or add it, returning NULL if there are too many */
+static struct SinkConf* getSink(struct Config* config, struct Span name)
+{
+    struct SinkConf* sink;
     int i;
 
-    for (i = 0; s[i] != '\0'; i++) {
-        if (s[i] == '#') {
-            s[i] = '\0';
+    for (i = 0; i < config->nsinks; i++) {
+        if (isSpan(name, config->sinks[i].name)) {
+            return &config->sinks[i];
         }
     }
+    if (!isValidName(config, name)) {
+        return NULL;
+    }
+    if (config->nsinks == kMaxSinks) {
+        reportError(config, "Too many sinks", name);
+        return NULL;
+    }
+    sink = &config->sinks[config->nsinks++];
+    memcpy(sink->name, name.s, name.len);
+    sink->line = config->line;
+    sink->async = -1;
+    sink->file.minLevel = sink->console.minLevel = LogLevel_TRACE;
+    sink->file.maxLevel = sink->console.maxLevel = LogLevel_FATAL;
+    return sink;
 }
 
-static void trim(char* s)
+/* Find the logger of the name or add it, returning NULL if there are too many */
+static struct LoggerConf* getLogger(struct Config* config, struct Span name)
 {
-    size_t len;
+    struct LoggerConf* logger;
     int i;
 
-    if (s == NULL) {
-        return;
+    for (i = 0; i < config->nloggers; i++) {
+        if (isSpan(name, config->loggers[i].name)) {
+            return &config->loggers[i];
+        }
     }
-    len = strlen(s);
-    if (len == 0) {
-        return;
+    if (!isValidName(config, name)) {
+        return NULL;
+    }
+    if (config->nloggers == kMaxLoggers) {
+        reportError(config, "Too many loggers", name);
+        return NULL;
     }
-    /* trim right */
-    for (i = len - 1; i >= 0 && isspace(s[i]); i--) {}
-    s[i + 1] = '\0';
-    /* trim left */
-    for (i = 0; s[i] != '\0' && isspace(s[i]); i++) {}
-    memmove(s, &s[i], len - i);
-    s[len - i] = '\0';
+    logger = &config->loggers[config->nloggers++];
+    memcpy(logger->name, name.s, name.len);
+    logger->line = config->line;
+    return logger;
 }
 
-static enum LogLevel parseLevel(const char* s);
+/* Parse a key of a sink, `sink.<name>.<key>` or `logger.file.<name>.<key>` */
+/* Keep the first key that only a sink of one type has, as the type may be declared later */
+static void markSinkKey(struct Config* config, struct Span* first, int* line, struct Span key)
+{
+    if (first->s == NULL) {
+        *first = key;
+        *line = config->line;
+    }
+}
+
+static void parseSink(struct Config* config, struct SinkConf* sink, struct Span key, struct Span val)
+{
+    long n;
+    int b;
+
+    if (isSpan(key, "filename") || isSpan(key, "maxFileSize") || isSpan(key, "maxBackupFiles")
+            || isSpan(key, "bufferSize") || isSpan(key, "flushInterval") || isSpan(key, "sync")
+            || isSpan(key, "ioUring")) {
+        markSinkKey(config, &sink->fileKey, &sink->fileKeyLine, key);
+    } else if (isSpan(key, "output") || isSpan(key, "queueSize") || isSpan(key, "overflow")
+            || isSpan(key, "blockTimeout")) {
+        markSinkKey(config, &sink->consoleKey, &sink->consoleKeyLine, key);
+    }
+    if (isSpan(key, "type")) {
+        if (isSpan(val, "file")) {
+            sink->type = kFileSink;
+        } else if (isSpan(val, "console")) {
+            sink->type = kConsoleSink;
+        } else {
+            reportError(config, "Invalid sink type", val);
+        }
+    } else if (isSpan(key, "filename")) {
+        copySpan(config, sink->filename, sizeof(sink->filename), val);
+    } else if (isSpan(key, "output")) {
+        parseOutput(config, val, &sink->console.output);
+    } else if (isSpan(key, "minLevel")) {
+        if (parseLevel(config, val, &sink->file.minLevel)) {
+            sink->console.minLevel = sink->file.minLevel;
+        }
+    } else if (isSpan(key, "maxLevel")) {
+        if (parseLevel(config, val, &sink->file.maxLevel)) {
+            sink->console.maxLevel = sink->file.maxLevel;
+        }
+    } else if (isSpan(key, "maxFileSize")) {
+        parseLong(config, val, &sink->file.maxFileSize);
+    } else if (isSpan(key, "maxBackupFiles")) {
+        if (parseLong(config, val, &n)) {
+            if (n < 0 || n > 255) {
+                reportError(config, "Invalid number of backup files", val);
+            }
+            sink->file.maxBackupFiles = (unsigned char) n;
+        }
+    } else if (isSpan(key, "bufferSize")) {
+        if (parseLong(config, val, &n)) {
+            sink->file.bufferSize = (n > 0) ? (size_t) n : 0;
+        }
+    } else if (isSpan(key, "flushInterval")) {
+        parseLong(config, val, &sink->file.flushInterval);
+    } else if (isSpan(key, "sync")) {
+        parseBool(config, val, &sink->file.sync);
+    } else if (isSpan(key, "async")) {
+        parseBool(config, val, &sink->async);
+    } else if (isSpan(key, "ioUring")) {
+        if (isSpan(val, "SQPOLL")) {
+            sink->file.ioUring = LogIoUring_SQPOLL;
+        } else if (parseBool(config, val, &b)) {
+            sink->file.ioUring = b ? LogIoUring_ON : LogIoUring_OFF;
+        }
+    } else if (isSpan(key, "queueSize")) {
+        if (parseLong(config, val, &n)) {
+            sink->console.queueSize = (n > 0) ? (size_t) n : 0;
+        }
+    } else if (isSpan(key, "overflow")) {
+        if (isSpan(val, "DROP_NEWEST")) {
+            sink->console.overflow = LogOverflow_DROP_NEWEST;
+        } else if (isSpan(val, "DROP_OLDEST")) {
+            sink->console.overflow = LogOverflow_DROP_OLDEST;
+        } else if (isSpan(val, "BLOCK")) {
+            sink->console.overflow = LogOverflow_BLOCK;
+        } else {
+            reportError(config, "Invalid overflow", val);
+        }
+    } else if (isSpan(key, "blockTimeout")) {
+        parseLong(config, val, &sink->console.blockTimeout);
+    } else {
+        reportError(config, "Invalid key", key);
+    }
+}
 
-static void parseLine(char* line)
+/* Parse a key of a named logger, `logger.<name>.<key>` */
+static void parseLogger(struct Config* config, struct LoggerConf* logger, struct Span key, struct Span val)
 {
-    char *key, *val;
-    int nfiles;
+    const char* end = val.s + val.len;
+    const char* comma;
+    struct Span name;
 
-    key = strtok(line, "=");
-    val = strtok(NULL, "=");
+    if (isSpan(key, "level")) {
+        logger->hasLevel = parseLevel(config, val, &logger->level);
+    } else if (isSpan(key, "sinks")) {
+        logger->nsinks = 0;
+        for (; val.s <= end; val.s = comma + 1) {
+            if ((comma = (const char*) memchr(val.s, ',', end - val.s)) == NULL) {
+                comma = end;
+            }
+            name = trimSpan(val.s, comma);
+            if (!isValidName(config, name)) {
+                continue;
+            }
+            if (logger->nsinks == kMaxSinks) {
+                reportError(config, "Too many sinks", name);
+                break;
+            }
+            memcpy(logger->sinks[logger->nsinks], name.s, name.len);
+            logger->sinks[logger->nsinks][name.len] = '\0';
+            logger->nsinks++;
+        }
+    } else {
+        reportError(config, "Invalid key", key);
+    }
+}
 
-    if (strcmp(key, "level") == 0) {
-        logger_setLevel(parseLevel(val));
-    } else if (strcmp(key, "autoFlush") == 0) {
-        logger_autoFlush(atol(val));
-    } else if (strcmp(key, "logger") == 0) {
-        if (strcmp(val, "console") == 0) {
-            s_logger |= kConsoleLogger;
-        } else if (strcmp(val, "file") == 0) {
-            s_logger |= kFileLogger;
+/* Parse the keys of the console and file loggers, `logger.console.<key>` and `logger.file.<key>` */
+static void parseOutputLogger(struct Config* config, struct Span logger, struct Span key, struct Span val)
+{
+    long n;
+
+    if (isSpan(logger, "console") && isSpan(key, "output")) {
+        parseOutput(config, val, &config->consoleOutput);
+    } else if (isSpan(logger, "console")) {
+        reportError(config, "Invalid key", key);
+    } else if (isSpan(key, "filename")) {
+        copySpan(config, config->filename, sizeof(config->filename), val);
+    } else if (isSpan(key, "maxFileSize")) {
+        parseLong(config, val, &config->maxFileSize);
+    } else if (isSpan(key, "maxBackupFiles")) {
+        if (parseLong(config, val, &n)) {
+            if (n < 0 || n > 255) {
+                reportError(config, "Invalid number of backup files", val);
+            }
+            config->maxBackupFiles = (unsigned char) n;
+        }
+    } else if (isSpan(key, "shared")) {
+        parseBool(config, val, &config->shared);
+    } else if (isSpan(key, "index")) {
+        config->hasFileIndex = parseLong(config, val, &config->fileIndex);
+    } else {
+        reportError(config, "Invalid key", key);
+    }
+}
+
+static void parseLine(struct Config* config, struct Span key, struct Span val)
+{
+    struct Span parts[kMaxKeyParts];
+    const char* end = key.s + key.len;
+    const char* s;
+    const char* dot;
+    struct SinkConf* sink;
+    struct LoggerConf* logger;
+    int nparts = 0;
+
+    /* split the key at dots */
+    for (s = key.s; nparts < kMaxKeyParts; s = dot + 1) {
+        if ((dot = (const char*) memchr(s, '.', end - s)) == NULL) {
+            dot = end;
+        }
+        parts[nparts].s = s;
+        parts[nparts].len = (size_t) (dot - s);
+        nparts++;
+        if (dot == end) {
+            break;
+        }
+    }
+    if (dot != end) {
+        reportError(config, "Invalid key", key);
+        return;
+    }
+
+    if (nparts == 1 && isSpan(key, "level")) {
+        config->hasLevel = parseLevel(config, val, &config->level);
+    } else if (nparts == 1 && isSpan(key, "autoFlush")) {
+        config->hasAutoFlush = parseLong(config, val, &config->autoFlush);
+    } else if (nparts == 1 && isSpan(key, "combining")) {
+        config->hasCombining = parseBool(config, val, &config->combining);
+    } else if (nparts == 1 && isSpan(key, "clock")) {
+        config->hasClock = 1; /* true */
+        if (isSpan(val, "REALTIME")) {
+            config->clock = LogClock_REALTIME;
+        } else if (isSpan(val, "REALTIME_COARSE")) {
+            config->clock = LogClock_REALTIME_COARSE;
+        } else if (isSpan(val, "TSC")) {
+            config->clock = LogClock_TSC;
         } else {
-            fprintf(stderr, "ERROR: loggerconf: Invalid logger: `%s`\n", val);
-            s_logger = 0;
-        }
-    } else if (strcmp(key, "logger.console.output") == 0) {
-        if (strcmp(val, "stdout") == 0) {
-            s_clog.output = stdout;
-        } else if (strcmp(val, "stderr") == 0) {
-            s_clog.output = stderr;
+            reportError(config, "Invalid clock", val);
+        }
+    } else if (nparts == 1 && isSpan(key, "logger")) {
+        if (isSpan(val, "console")) {
+            config->logger |= kConsoleLogger;
+        } else if (isSpan(val, "file")) {
+            config->logger |= kFileLogger;
         } else {
-            fprintf(stderr, "ERROR: loggerconf: Invalid logger.console.output: `%s`\n", val);
-            s_clog.output = NULL;
-        }
-    } else if (strcmp(key, "logger.file.filename") == 0) {
-        strncpy(s_flog.filename, val, sizeof(s_flog.filename));
-    } else if (strcmp(key, "logger.file.maxFileSize") == 0) {
-        s_flog.maxFileSize = atol(val);
-    } else if (strcmp(key, "logger.file.maxBackupFiles") == 0) {
-        nfiles = atoi(val);
-        if (nfiles < 0) {
-            fprintf(stderr, "ERROR: loggerconf: Invalid logger.file.maxBackupFiles: `%s`\n", val);
-            nfiles = 0;
-        }
-        s_flog.maxBackupFiles = nfiles;
-    }
-}
-
-static enum LogLevel parseLevel(const char* s)
-{
-    if (strcmp(s, "TRACE") == 0) {
-        return LogLevel_TRACE;
-    } else if (strcmp(s, "DEBUG") == 0) {
-        return LogLevel_DEBUG;
-    } else if (strcmp(s, "INFO") == 0) {
-        return LogLevel_INFO;
-    } else if (strcmp(s, "WARN") == 0) {
-        return LogLevel_WARN;
-    } else if (strcmp(s, "ERROR") == 0) {
-        return LogLevel_ERROR;
-    } else if (strcmp(s, "FATAL") == 0) {
-        return LogLevel_FATAL;
+            reportError(config, "Invalid logger", val);
+        }
+    } else if (nparts == 3 && isSpan(parts[0], "sink")) {
+        if ((sink = getSink(config, parts[1])) != NULL) {
+            parseSink(config, sink, parts[2], val);
+        }
+    } else if (nparts == 4 && isSpan(parts[0], "logger") && isSpan(parts[1], "file")) {
+        if ((sink = getSink(config, parts[2])) != NULL) {
+            sink->type = kFileSink;
+            parseSink(config, sink, parts[3], val);
+        }
+    } else if (nparts == 3 && isSpan(parts[0], "logger")
+            && (isSpan(parts[1], "console") || isSpan(parts[1], "file"))) {
+        parseOutputLogger(config, parts[1], parts[2], val);
+    } else if (nparts == 3 && isSpan(parts[0], "logger")) {
+        if ((logger = getLogger(config, parts[1])) != NULL) {
+            parseLogger(config, logger, parts[2], val);
+        }
     } else {
-        fprintf(stderr, "ERROR: loggerconf: Invalid level: `%s`\n", s);
-        return logger_getLevel();
+        reportError(config, "Invalid key", key);
     }
 }
 
-static int hasFlag(int flags, int flag)
+/* Parse the text line by line without copying or modifying it */
+static void parseText(struct Config* config, const char* text, size_t len)
 {
-    return (flags & flag) == flag;
+    const char* end = text + len;
+    const char* eol;
+    const char* comment;
+    const char* eq;
+    struct Span line, key, val;
+
+    for (; text < end; text = eol + 1) {
+        config->line++;
+        if ((eol = (const char*) memchr(text, '\n', end - text)) == NULL) {
+            eol = end;
+        }
+        if ((comment = (const char*) memchr(text, '#', eol - text)) == NULL) {
+            comment = eol;
+        }
+        line = trimSpan(text, comment);
+        if (line.len == 0) {
+            continue;
+        }
+        if ((eq = (const char*) memchr(line.s, '=', line.len)) == NULL) {
+            reportError(config, "No `=`", line);
+            continue;
+        }
+        key = trimSpan(line.s, eq);
+        val = trimSpan(eq + 1, line.s + line.len);
+        if (key.len == 0) {
+            reportError(config, "No key", line);
+        } else if (val.len == 0) {
+            reportError(config, "No value", line);
+        } else if (val.len >= kMaxValueLen) {
+            reportError(config, "Too long value", key);
+        } else {
+            parseLine(config, key, val);
+        }
+    }
+}
+
+static struct SinkConf* findSink(struct Config* config, const char* name)
+{
+    int i;
+
+    for (i = 0; i < config->nsinks; i++) {
+        if (strcmp(config->sinks[i].name, name) == 0) {
+            return &config->sinks[i];
+        }
+    }
+    return NULL;
+}
+
+/* Check what cannot be checked line by line */
+static void validate(struct Config* config)
+{
+    struct SinkConf* sink;
+    struct LoggerConf* logger;
+    int i, j;
+
+    for (i = 0; i < config->nsinks; i++) {
+        sink = &config->sinks[i];
+        config->line = sink->line;
+        if (sink->type == 0) {
+            reportError(config, "No type for sink", makeSpan(sink->name));
+        } else if (sink->type == kFileSink && sink->filename[0] == '\0') {
+            reportError(config, "No filename for sink", makeSpan(sink->name));
+        } else if (sink->type == kFileSink && sink->consoleKey.s != NULL) {
+            config->line = sink->consoleKeyLine;
+            reportError(config, "Key not valid for a file sink", sink->consoleKey);
+        } else if (sink->type == kConsoleSink && sink->fileKey.s != NULL) {
+            config->line = sink->fileKeyLine;
+            reportError(config, "Key not valid for a console sink", sink->fileKey);
+        }
+    }
+    for (i = 0; i < config->nloggers; i++) {
+        logger = &config->loggers[i];
+        config->line = logger->line;
+        for (j = 0; j < logger->nsinks; j++) {
+            if (findSink(config, logger->sinks[j]) == NULL) {
+                reportError(config, "Unknown sink", makeSpan(logger->sinks[j]));
+            }
+        }
+    }
+}
+
+/* Write the lines of a console sink in the logging thread */
+static void writeConsole(void* context, const struct iovec* lines, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        fwrite(lines[i].iov_base, 1, lines[i].iov_len, (FILE*) context);
+    }
+}
+
+static void flushConsole(void* context)
+{
+    fflush((FILE*) context);
+}
+
+static int addSink(struct SinkConf* sink)
+{
+    struct LogSink console;
+
+    if (sink->type == kFileSink) {
+        sink->file.filename = sink->filename;
+        if (sink->async == 1 && sink->file.ioUring == LogIoUring_OFF) {
+            sink->file.ioUring = LogIoUring_ON;
+        } else if (sink->async == 0) {
+            sink->file.ioUring = LogIoUring_OFF;
+        }
+        return logger_addFileSink(&sink->file);
+    }
+    if (sink->async != 0) {
+        return logger_addConsoleSink(&sink->console);
+    }
+    console.writeBatch = writeConsole;
+    console.flush = flushConsole;
+    console.close = NULL;
+    console.context = (sink->console.output != NULL) ? sink->console.output : stdout;
+    return logger_addSink(&console, sink->console.minLevel, sink->console.maxLevel);
+}
+
+/* Replace the loggers and the sinks of the previous configuration */
+static int apply(struct Config* config)
+{
+    struct LoggerConf* logger;
+    struct SinkConf* sink;
+    int id;
+    int i, j;
+
+    if (config->hasLevel) {
+        logger_setLevel(config->level);
+    }
+    if (config->hasAutoFlush) {
+        logger_autoFlush(config->autoFlush);
+    }
+    if (config->hasClock) {
+        logger_setClock(config->clock);
+    }
+    if (config->hasCombining) {
+        logger_setCombining(config->combining);
+    }
+    if (config->hasFileIndex) {
+        logger_setFileIndex(config->fileIndex);
+    }
+    if (config->logger & kConsoleLogger) {
+        if (!logger_initConsoleLogger(config->consoleOutput)) {
+            return 0;
+        }
+    }
+    if (config->logger & kFileLogger) {
+        if (config->shared) {
+            if (!logger_initSharedFileLogger(config->filename, config->maxFileSize, config->maxBackupFiles)) {
+                return 0;
+            }
+        } else {
+            if (!logger_initFileLogger(config->filename, config->maxFileSize, config->maxBackupFiles)) {
+                return 0;
+            }
+        }
+    }
+    for (i = 0; i < kMaxSinks; i++) {
+        if (s_sinkIDs[i] != 0) {
+            logger_removeSink(s_sinkIDs[i]);
+            s_sinkIDs[i] = 0;
+        }
+    }
+    for (i = 0; i < config->nsinks; i++) {
+        if ((s_sinkIDs[i] = addSink(&config->sinks[i])) == 0) {
+            return 0;
+        }
+    }
+    for (i = 0; i < config->nloggers; i++) {
+        logger = &config->loggers[i];
+        if ((id = logger_getLogger(logger->name)) < 0) {
+            return 0;
+        }
+        if (logger->hasLevel) {
+            logger_setLoggerLevel(id, logger->level);
+        }
+        for (j = 0; j < logger->nsinks; j++) {
+            sink = findSink(config, logger->sinks[j]);
+            logger_attachSink(id, s_sinkIDs[sink - config->sinks]);
+        }
+    }
+    return config->logger != 0 || config->nsinks != 0;
+}
+
+static int applyLocked(struct Config* config)
+{
+    int ok;
+
+#if defined(_WIN32) || defined(_WIN64)
+    AcquireSRWLockExclusive(&s_mutex);
+    ok = apply(config);
+    ReleaseSRWLockExclusive(&s_mutex);
+#else
+    pthread_mutex_lock(&s_mutex);
+    ok = apply(config);
+    pthread_mutex_unlock(&s_mutex);
+#endif /* defined(_WIN32) || defined(_WIN64) */
+    return ok;
+}
+
+static int configure(const char* text, size_t len, const char* source)
+{
+    struct Config config;
+
+    memset(&config, 0, sizeof(config));
+    config.source = source;
+    parseText(&config, text, len);
+    if (config.errors == 0) {
+        validate(&config);
+    }
+    if (config.errors > 0) {
+        fprintf(stderr, "ERROR: loggerconf: %s: Nothing is configured for %d error(s)\n", source, config.errors);
+        return 0;
+    }
+    return applyLocked(&config);
 }
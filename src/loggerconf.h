@@ -7,24 +7,72 @@ extern "C" {
 
 /**
  * Configure the logger with a configuration file.
- * If the filename is NULL, return without doing anything.
+ * Each line is a key and a value joined with `=`, and `#` starts a comment.
+ * The whole file is checked first, and nothing is configured if a line has
+ * an error, which is reported to stderr with the line number.
+ * Configurations from several threads are applied one at a time.
  *
  * The following is the configurable key/value list.
  * |key                        |value                                        |
  * |:--------------------------|:--------------------------------------------|
  * |level                      |TRACE, DEBUG, INFO, WARN, ERROR or FATAL     |
  * |autoFlush                  |A flush interval [ms] (off if interval <= 0) |
+ * |clock                      |REALTIME, REALTIME_COARSE or TSC             |
+ * |combining                  |1 to write the lines of other threads        |
  * |logger                     |console or file                              |
  * |logger.console.output      |stdout or stderr                             |
  * |logger.file.filename       |A output filename (max length is 255 bytes)  |
  * |logger.file.maxFileSize    |1-LONG_MAX [bytes] (1 MB if size <= 0)       |
  * |logger.file.maxBackupFiles |0-255                                        |
+ * |logger.file.shared         |1 if other processes log to the same file    |
+ * |logger.file.index          |Bytes between index entries (off if <= 0)    |
+ *
+ * The following keys add a sink named <name> in addition to the loggers
+ * above. The sinks replace those added by the previous configuration.
+ * Up to 8 sinks can be declared.
+ * |key                        |value                                        |
+ * |:--------------------------|:--------------------------------------------|
+ * |sink.<name>.type           |file or console                              |
+ * |sink.<name>.minLevel       |The lowest level (default: TRACE)            |
+ * |sink.<name>.maxLevel       |The highest level (default: FATAL)           |
+ * |sink.<name>.async          |1 or 0 (default: 1 for console, 0 for file)  |
+ * |sink.<name>.filename       |A output filename of a file sink             |
+ * |sink.<name>.maxFileSize    |1-LONG_MAX [bytes] (1 MB if size <= 0)       |
+ * |sink.<name>.maxBackupFiles |0-255                                        |
+ * |sink.<name>.bufferSize     |A buffer size [bytes] (8 KB if <= 0)         |
+ * |sink.<name>.flushInterval  |[ms] (each line if 0, when full if < 0)      |
+ * |sink.<name>.sync           |1 to call fsync() after each write           |
+ * |sink.<name>.ioUring        |1 or SQPOLL to write through io_uring        |
+ * |sink.<name>.output         |stdout or stderr of a console sink           |
+ * |sink.<name>.queueSize      |A queue size [bytes] (64 KB if <= 0)         |
+ * |sink.<name>.overflow       |DROP_NEWEST, DROP_OLDEST or BLOCK            |
+ * |sink.<name>.blockTimeout   |[ms] to wait when the queue is full          |
+ * A key of the other type of sink is an error.
+ * A file sink is added with logger_addFileSink(), asynchronous with
+ * io_uring. An asynchronous console sink is added with
+ * logger_addConsoleSink(), and the others write in the logging thread.
+ * `logger.file.<name>.<key>` is the same as `sink.<name>.<key>` of a file sink.
+ *
+ * The following keys set a named logger, see logger_getLogger(). The names
+ * console and file are taken by the loggers above, and root is the root logger.
+ * |key                        |value                                        |
+ * |:--------------------------|:--------------------------------------------|
+ * |logger.<name>.level        |TRACE, DEBUG, INFO, WARN, ERROR or FATAL     |
+ * |logger.<name>.sinks        |The names of the sinks separated with `,`    |
  *
  * @param[in] filename The name of the configuration file
  * @return Non-zero value upon success or 0 on error
  */
 int logger_configure(const char* filename);
 
+/**
+ * Configure the logger with the text of a configuration file.
+ *
+ * @param[in] text The keys and the values, see logger_configure()
+ * @return Non-zero value upon success or 0 on error
+ */
+int logger_configureText(const char* text);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif /* __cplusplus */
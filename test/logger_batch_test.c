@@ -0,0 +1,111 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "batch.log";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+/* Count the lines of the file, returning -1 if they are not numbered from 0 in order */
+static int countLines(const char* filename)
+{
+    FILE* fp;
+    char line[8192];
+    const char* message;
+    int index;
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        message = strstr(line, ": line ");
+        if (line[strlen(line) - 1] != '\n' || message == NULL
+                || sscanf(message, ": line %d", &index) != 1 || index != count) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_batch(void)
+{
+    struct LogBatch batch;
+    char buffer[65536];
+    int result;
+    int i;
+
+    /* setup: */
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+
+    /* when: add lines to a batch */
+    logger_batchBegin(&batch, buffer, sizeof(buffer));
+    for (i = 0; i < 100; i++) {
+        LOG_BATCH(&batch, LogLevel_INFO, "line %d", i);
+    }
+    LOG_BATCH(&batch, LogLevel_DEBUG, "below the log level");
+    logger_flush();
+
+    /* then: nothing is written before commit */
+    nu_assert_eq_int(0, countLines(kOutputFileName));
+
+    /* when: commit */
+    logger_batchCommit(&batch);
+    logger_flush();
+
+    /* then: the lines are written in order */
+    nu_assert_eq_int(100, countLines(kOutputFileName));
+    return 0;
+}
+
+static int test_smallBuffer(void)
+{
+    struct LogBatch batch;
+    char buffer[256];
+    char text[600];
+    int result;
+    int i;
+
+    /* setup: */
+    remove(kOutputFileName);
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    /* when: add more lines than the buffer holds and a line larger than the buffer */
+    logger_batchBegin(&batch, buffer, sizeof(buffer));
+    for (i = 0; i < 50; i++) {
+        LOG_BATCH(&batch, LogLevel_INFO, "line %d", i);
+    }
+    LOG_BATCH(&batch, LogLevel_INFO, "line %d %s", i++, text);
+    LOG_BATCH(&batch, LogLevel_INFO, "line %d", i++);
+    logger_batchCommit(&batch);
+    logger_flush();
+
+    /* then: the batch is committed when it is full, and the lines are kept in order */
+    nu_assert_eq_int(52, countLines(kOutputFileName));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_batch);
+    nu_run_test(test_smallBuffer);
+    cleanup();
+    nu_report();
+}
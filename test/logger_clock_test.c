@@ -0,0 +1,89 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "clock.log";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+}
+
+/* Return the number of digits after the seconds of the last line, or -1 if it is broken */
+static int readLastTimestamp(char* timestamp, size_t size)
+{
+    FILE* fp;
+    char line[256];
+    const char* fraction;
+    int digits = -1;
+
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] != 'I' || line[19] != '.') {
+            digits = -1;
+            continue;
+        }
+        for (fraction = &line[20]; *fraction >= '0' && *fraction <= '9'; fraction++) {}
+        digits = (int) (fraction - &line[20]);
+        memcpy(timestamp, &line[2], size - 1);
+        timestamp[size - 1] = '\0';
+    }
+    fclose(fp);
+    return digits;
+}
+
+static int test_clocks(void)
+{
+    enum LogClock clocks[3];
+    char expected[32];
+    char timestamp[18];
+    time_t now;
+    int digits;
+    int result;
+    int i;
+
+    clocks[0] = LogClock_REALTIME;
+    clocks[1] = LogClock_REALTIME_COARSE;
+    clocks[2] = LogClock_TSC;
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    for (i = 0; i < 3; i++) {
+        /* when: set the clock */
+        result = logger_setClock(clocks[i]);
+        if (!result) {
+            nu_assert_eq_int(LogClock_TSC, clocks[i]); /* may be unsupported on this CPU */
+            continue;
+        }
+
+        /* and: output to the file */
+        now = time(NULL);
+        LOG_INFO("message");
+        logger_flush();
+
+        /* then: the timestamp is the current time with microseconds or nanoseconds */
+        digits = (clocks[i] == LogClock_TSC) ? 9 : 6;
+        nu_assert_eq_int(digits, readLastTimestamp(timestamp, sizeof(timestamp)));
+        strftime(expected, sizeof(expected), "%y-%m-%d %H:%M", localtime(&now));
+        nu_assert_eq_int(0, strncmp(expected, timestamp, strlen(expected)));
+    }
+
+    /* cleanup: restore the default clock */
+    logger_setClock(LogClock_REALTIME);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_clocks);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,204 @@
+#include "logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "combining.log";
+static const char kSinkFileName[] = "combining_sink.log";
+#define kThreads 16
+static const int kLines = 2000;
+
+/* A sink that counts the lines of the thread numbers it gets */
+struct Counter
+{
+    int lines[kThreads];
+};
+
+static struct Counter s_counter;
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+    remove(kSinkFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+    remove(kSinkFileName);
+}
+
+static void writeCounter(void* context, const struct iovec* lines, int n)
+{
+    struct Counter* counter = (struct Counter*) context;
+    const char* thread;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ((thread = strstr((const char*) lines[i].iov_base, "thread ")) != NULL) {
+            counter->lines[atoi(thread + 7)]++;
+        }
+    }
+}
+
+static void* logLines(void* arg)
+{
+    int thread = *(int*) arg;
+    int i;
+
+    if (thread % 2 == 0) {
+        logger_useLogger(logger_getLogger("even"));
+    }
+    for (i = 0; i < kLines; i++) {
+        LOG_INFO("thread %d line %d", thread, i);
+    }
+    return NULL;
+}
+
+/* Count the lines of each thread, returning -1 if a line is broken or out of order */
+static int countLines(int* seen)
+{
+    FILE* fp;
+    char line[256];
+    int thread, number;
+    int count = 0;
+
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(strstr(line, "thread "), "thread %d line %d", &thread, &number) != 2
+                || thread < 0 || thread >= kThreads || number != seen[thread]) {
+            count = -1;
+            break;
+        }
+        seen[thread]++;
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_threads(void)
+{
+    struct LogSink sink;
+    pthread_t threads[kThreads];
+    int args[kThreads];
+    int seen[kThreads];
+    int sinkID;
+    int expected;
+    int i;
+
+    /* setup: a sink for the even threads */
+    memset(&s_counter, 0, sizeof(s_counter));
+    memset(&sink, 0, sizeof(sink));
+    sink.writeBatch = writeCounter;
+    sink.context = &s_counter;
+    sinkID = logger_addSink(&sink, LogLevel_INFO, LogLevel_FATAL);
+    nu_assert(logger_attachSink(logger_getLogger("even"), sinkID));
+
+    /* when: the threads log at once */
+    for (i = 0; i < kThreads; i++) {
+        args[i] = i;
+        pthread_create(&threads[i], NULL, logLines, &args[i]);
+    }
+    for (i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    logger_flush();
+
+    /* then: the lines of each thread are whole and in order */
+    memset(seen, 0, sizeof(seen));
+    nu_assert_eq_int(kThreads * kLines, countLines(seen));
+    for (i = 0; i < kThreads; i++) {
+        nu_assert_eq_int(kLines, seen[i]);
+    }
+
+    /* then: the sink got the lines of the threads that logged with its logger */
+    for (i = 0; i < kThreads; i++) {
+        expected = (i % 2 == 0) ? kLines : 0;
+        nu_assert_eq_int(expected, s_counter.lines[i]);
+    }
+    logger_removeSink(sinkID);
+    return 0;
+}
+
+static int test_writtenOnReturn(void)
+{
+    struct LogFileSink config;
+    FILE* fp;
+    char line[256];
+    int id;
+    int i;
+
+    /* setup: a file sink written for each line */
+    memset(&config, 0, sizeof(config));
+    config.filename = kSinkFileName;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    id = logger_addFileSink(&config);
+    nu_assert(id != 0);
+    nu_assert((fp = fopen(kSinkFileName, "r")) != NULL);
+
+    for (i = 0; i < 10; i++) {
+        /* when: log a line */
+        LOG_INFO("line %d", i);
+
+        /* then: it is in the file when the call returns */
+        nu_assert(fgets(line, sizeof(line), fp) != NULL);
+        nu_assert_eq_int(i, atoi(strrchr(line, ' ') + 1));
+    }
+    fclose(fp);
+    logger_removeSink(id);
+    return 0;
+}
+
+static volatile int s_step;
+
+static void* checkLevel(void* arg)
+{
+    int* enabled = (int*) arg;
+
+    enabled[0] = logger_isEnabled(LogLevel_DEBUG);
+    s_step = 1;
+    while (s_step != 2) {
+    }
+    enabled[1] = logger_isEnabled(LogLevel_DEBUG);
+    return NULL;
+}
+
+static int test_levelOfOtherThread(void)
+{
+    pthread_t thread;
+    int enabled[2];
+
+    /* when: the level is lowered while a thread keeps its check */
+    s_step = 0;
+    pthread_create(&thread, NULL, checkLevel, enabled);
+    while (s_step != 1) {
+    }
+    logger_setLevel(LogLevel_DEBUG);
+    s_step = 2;
+    pthread_join(thread, NULL);
+    logger_setLevel(LogLevel_INFO);
+
+    /* then: the thread sees the new level */
+    nu_assert(!enabled[0]);
+    nu_assert(enabled[1]);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    logger_initFileLogger(kOutputFileName, 64 * 1024 * 1024, 0);
+    logger_setLevel(LogLevel_INFO);
+    logger_setCombining(1);
+    nu_run_test(test_threads);
+    nu_run_test(test_writtenOnReturn);
+    nu_run_test(test_levelOfOtherThread);
+    cleanup();
+    nu_report();
+}
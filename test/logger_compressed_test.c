@@ -0,0 +1,141 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "compressed.log";
+static const int kLines = 5000;
+
+static void removeFiles(void)
+{
+    char filename[64];
+    int i;
+
+    remove(kOutputFileName);
+    for (i = 1; i < 256; i++) {
+        sprintf(filename, "%s.%d", kOutputFileName, i);
+        remove(filename);
+    }
+}
+
+static void setup(void)
+{
+    removeFiles();
+}
+
+static void cleanup(void)
+{
+    removeFiles();
+}
+
+static unsigned long getUint32(const unsigned char* p)
+{
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16)
+        | ((unsigned long) p[2] << 8) | (unsigned long) p[3];
+}
+
+/* Decompress the frames of the file and count the lines, returning -1 if a frame is broken */
+static int countLines(const char* filename, int* seen, int* frames)
+{
+    FILE* fp;
+    unsigned char header[12];
+    unsigned char* compressed;
+    char* data;
+    char* line;
+    char* lf;
+    const char* message;
+    unsigned long compressedLen, len;
+    uLongf dataLen;
+    int index;
+    int count = 0;
+
+    if ((fp = fopen(filename, "rb")) == NULL) {
+        return 0;
+    }
+    while (fread(header, 1, sizeof(header), fp) == sizeof(header)) {
+        compressedLen = getUint32(&header[4]);
+        len = getUint32(&header[8]);
+        compressed = (unsigned char*) malloc(compressedLen);
+        data = (char*) malloc(len + 1);
+        dataLen = len;
+        if (memcmp(header, "CLZ1", 4) != 0
+                || fread(compressed, 1, compressedLen, fp) != compressedLen
+                || uncompress((Bytef*) data, &dataLen, compressed, compressedLen) != Z_OK
+                || dataLen != len || data[len - 1] != '\n') {
+            count = -1;
+        } else {
+            /* every frame holds whole lines */
+            data[len] = '\0';
+            for (line = data; (lf = strchr(line, '\n')) != NULL; line = lf + 1) {
+                *lf = '\0';
+                message = strstr(line, ": line ");
+                if (line[0] != 'I' || message == NULL || sscanf(message, ": line %d", &index) != 1
+                        || index < 0 || index >= kLines) {
+                    count = -1;
+                    break;
+                }
+                seen[index]++;
+                count++;
+            }
+        }
+        free(compressed);
+        free(data);
+        if (count < 0) {
+            break;
+        }
+        (*frames)++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_compressedFileLogger(void)
+{
+    int seen[5000];
+    char filename[64];
+    int frames = 0;
+    int count = 0;
+    int n;
+    int result;
+    int i;
+
+    /* when: initialize compressed file logger rotated after every frame */
+    result = logger_initCompressedFileLogger(kOutputFileName, 1, 255);
+
+    /* then: ok */
+    nu_assert_eq_int(1, result);
+
+    /* when: output lines across several blocks */
+    for (i = 0; i < kLines; i++) {
+        LOG_INFO("line %d", i);
+    }
+    logger_flush();
+
+    /* then: every line is written exactly once in whole frames across the files */
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < 256; i++) {
+        if (i == 0) {
+            sprintf(filename, "%s", kOutputFileName);
+        } else {
+            sprintf(filename, "%s.%d", kOutputFileName, i);
+        }
+        nu_assert((n = countLines(filename, seen, &frames)) >= 0);
+        count += n;
+    }
+    nu_assert_eq_int(kLines, count);
+    nu_assert(frames > 1);
+    for (i = 0; i < kLines; i++) {
+        nu_assert_eq_int(1, seen[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_compressedFileLogger);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,382 @@
+#define _POSIX_C_SOURCE 200112L /* fdopen() */
+#include "logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "nanounit.h"
+
+static const char kFileName[] = "consolesink.log";
+
+/* The read end of a pipe and what has been read from it */
+struct Reader
+{
+    int fd;
+    char* data; /* ends with NUL */
+    size_t size;
+    size_t len;
+};
+
+static void* readAll(void* context)
+{
+    struct Reader* reader = (struct Reader*) context;
+    ssize_t n;
+
+    while ((n = read(reader->fd, &reader->data[reader->len], reader->size - 1 - reader->len)) > 0) {
+        reader->len += (size_t) n;
+    }
+    reader->data[reader->len] = '\0';
+    return NULL;
+}
+
+/* Check that the lines are whole and in order, and return the number of the first line or -1 */
+static int checkLines(const char* data, size_t len, int* count)
+{
+    const char* end = data + len;
+    const char* lf;
+    const char* sp;
+    int first = -1, prev = -1, number;
+
+    *count = 0;
+    for (; data < end; data = lf + 1) {
+        if ((lf = (const char*) memchr(data, '\n', end - data)) == NULL) {
+            return -1;
+        }
+        for (sp = lf; sp > data && *sp != ' '; sp--) {
+        }
+        number = atoi(sp + 1);
+        if (number <= prev || strncmp(sp - 4, "line", 4) != 0) {
+            return -1;
+        }
+        first = (first < 0) ? number : first;
+        prev = number;
+        (*count)++;
+    }
+    return first;
+}
+
+/* Log lines to a console sink nobody reads until the end, and return the dropped lines */
+static unsigned long logToStuckPipe(enum LogOverflow overflow, long blockTimeout, int nlines,
+        struct Reader* reader)
+{
+    struct LogConsoleSink config;
+    FILE* output;
+    pthread_t thread;
+    int fds[2];
+    unsigned long dropped;
+    int id;
+    int i;
+
+    if (pipe(fds) != 0 || (output = fdopen(fds[1], "w")) == NULL) {
+        return 0;
+    }
+    memset(&config, 0, sizeof(config));
+    config.output = output;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.queueSize = 16 * 1024;
+    config.overflow = overflow;
+    config.blockTimeout = blockTimeout;
+    id = logger_addConsoleSink(&config);
+
+    /* the pipe and the queue fill up without blocking the logger */
+    for (i = 0; i < nlines; i++) {
+        LOG_INFO("line %d", i);
+    }
+    dropped = logger_getDroppedLines(id);
+
+    /* read what is left */
+    reader->fd = fds[0];
+    reader->size = nlines * 128;
+    reader->data = (char*) malloc(reader->size);
+    reader->len = 0;
+    pthread_create(&thread, NULL, readAll, reader);
+    logger_removeSink(id);
+    fclose(output);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    return dropped;
+}
+
+static int test_dropNewest(void)
+{
+    struct Reader reader;
+    unsigned long dropped;
+    int count;
+
+    /* when: log more lines than the pipe and the queue hold */
+    dropped = logToStuckPipe(LogOverflow_DROP_NEWEST, 0, 20000, &reader);
+
+    /* then: the first lines are written and the others are dropped */
+    nu_assert(dropped > 0);
+    nu_assert_eq_int(0, checkLines(reader.data, reader.len, &count));
+    nu_assert_eq_int(20000, count + (int) dropped);
+    free(reader.data);
+    return 0;
+}
+
+static int test_dropOldest(void)
+{
+    struct Reader reader;
+    unsigned long dropped;
+    int count;
+
+    /* when: log more lines than the pipe and the queue hold */
+    dropped = logToStuckPipe(LogOverflow_DROP_OLDEST, 0, 20000, &reader);
+
+    /* then: the last line is written, after the lines the writer thread has taken */
+    nu_assert(dropped > 0);
+    nu_assert(checkLines(reader.data, reader.len, &count) >= 0);
+    nu_assert_eq_int(20000, count + (int) dropped);
+    nu_assert(strstr(reader.data, "line 19999\n") != NULL);
+    free(reader.data);
+    return 0;
+}
+
+static int test_blockWithTimeout(void)
+{
+    struct Reader reader;
+    unsigned long dropped;
+    time_t start;
+    int count;
+
+    /* when: log more lines than the pipe and the queue hold */
+    start = time(NULL);
+    dropped = logToStuckPipe(LogOverflow_BLOCK, 50, 20000, &reader);
+
+    /* then: the logger waits once and then drops without waiting */
+    nu_assert(time(NULL) - start < 5);
+    nu_assert(dropped > 0);
+    nu_assert_eq_int(0, checkLines(reader.data, reader.len, &count));
+    nu_assert_eq_int(20000, count + (int) dropped);
+    free(reader.data);
+    return 0;
+}
+
+static int test_fileSinkWhileConsoleIsStuck(void)
+{
+    struct LogFileSink file;
+    struct Reader reader;
+    FILE* fp;
+    char line[256];
+    int fileID;
+    int count = 0;
+
+    /* setup: a file sink beside the console sink */
+    remove(kFileName);
+    memset(&file, 0, sizeof(file));
+    file.filename = kFileName;
+    file.minLevel = LogLevel_INFO;
+    file.maxLevel = LogLevel_FATAL;
+    fileID = logger_addFileSink(&file);
+    nu_assert(fileID != 0);
+
+    /* when: the console is stuck */
+    logToStuckPipe(LogOverflow_DROP_NEWEST, 0, 20000, &reader);
+    logger_removeSink(fileID);
+
+    /* then: the file has every line */
+    if ((fp = fopen(kFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        count++;
+    }
+    fclose(fp);
+    nu_assert_eq_int(20000, count);
+    free(reader.data);
+    remove(kFileName);
+    return 0;
+}
+
+static void* logToStuckLogger(void* arg)
+{
+    int i;
+
+    logger_useLogger(logger_getLogger("stuck"));
+    for (i = 0; i < 20000; i++) {
+        LOG_INFO("line %d", i);
+    }
+    *(int*) arg = 1; /* done */
+    return NULL;
+}
+
+static int test_otherThreadsWhileBlocked(void)
+{
+    struct LogConsoleSink config;
+    struct LogFileSink file;
+    struct Reader reader;
+    FILE* output;
+    pthread_t blocked, thread;
+    struct timespec ts = {0, 200000000};
+    time_t start;
+    int fds[2];
+    int consoleID, fileID;
+    int done = 0;
+    int i;
+
+    /* setup: a console sink that blocks for long, for a logger of its own */
+    nu_assert(pipe(fds) == 0 && (output = fdopen(fds[1], "w")) != NULL);
+    memset(&config, 0, sizeof(config));
+    config.output = output;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.queueSize = 16 * 1024;
+    config.overflow = LogOverflow_BLOCK;
+    config.blockTimeout = 60 * 1000;
+    consoleID = logger_addConsoleSink(&config);
+    nu_assert(logger_attachSink(logger_getLogger("stuck"), consoleID));
+    remove(kFileName);
+    memset(&file, 0, sizeof(file));
+    file.filename = kFileName;
+    file.minLevel = LogLevel_INFO;
+    file.maxLevel = LogLevel_FATAL;
+    fileID = logger_addFileSink(&file);
+
+    /* when: a thread waits for the console nobody reads */
+    pthread_create(&blocked, NULL, logToStuckLogger, &done);
+    nanosleep(&ts, NULL);
+
+    /* then: the other threads log without waiting for it */
+    start = time(NULL);
+    for (i = 0; i < 20000; i++) {
+        LOG_INFO("line %d", i);
+    }
+    nu_assert(time(NULL) - start < 10);
+    nu_assert(!done);
+
+    /* cleanup: read the pipe, which lets the thread finish */
+    reader.fd = fds[0];
+    reader.size = 20000 * 128;
+    reader.data = (char*) malloc(reader.size);
+    reader.len = 0;
+    pthread_create(&thread, NULL, readAll, &reader);
+    pthread_join(blocked, NULL);
+    nu_assert_eq_int(0, (int) logger_getDroppedLines(consoleID));
+    logger_removeSink(consoleID);
+    logger_removeSink(fileID);
+    fclose(output);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    free(reader.data);
+    remove(kFileName);
+    return 0;
+}
+
+/* A thread that flushes or removes a console sink */
+struct Closer
+{
+    int id;
+    int flush; /* true to flush, false to remove */
+    volatile int done;
+};
+
+static void* closeStuckConsole(void* context)
+{
+    struct Closer* closer = (struct Closer*) context;
+
+    if (closer->flush) {
+        logger_flush();
+    } else {
+        logger_removeSink(closer->id);
+    }
+    closer->done = 1; /* true */
+    return NULL;
+}
+
+/* Check that a thread logging to a file sink only is not blocked while a stuck console is flushed or removed */
+static int logWhileClosingStuckConsole(int flush)
+{
+    struct LogConsoleSink config;
+    struct LogFileSink file;
+    struct Reader reader;
+    struct Closer closer;
+    FILE* output;
+    pthread_t closing, thread;
+    struct timespec ts = {0, 200000000};
+    time_t start;
+    int fds[2];
+    int fileID;
+    int previous;
+    int i;
+
+    /* setup: a console sink of a logger of its own, with the pipe and the queue full */
+    nu_assert(pipe(fds) == 0 && (output = fdopen(fds[1], "w")) != NULL);
+    memset(&config, 0, sizeof(config));
+    config.output = output;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.queueSize = 16 * 1024;
+    closer.id = logger_addConsoleSink(&config);
+    closer.flush = flush;
+    closer.done = 0; /* false */
+    nu_assert(logger_attachSink(logger_getLogger("stuck"), closer.id));
+    previous = logger_useLogger(logger_getLogger("stuck"));
+    for (i = 0; i < 20000; i++) {
+        LOG_INFO("line %d", i);
+    }
+    logger_useLogger(previous);
+    remove(kFileName);
+    memset(&file, 0, sizeof(file));
+    file.filename = kFileName;
+    file.minLevel = LogLevel_INFO;
+    file.maxLevel = LogLevel_FATAL;
+    fileID = logger_addFileSink(&file);
+
+    /* when: a thread waits for the console nobody reads */
+    pthread_create(&closing, NULL, closeStuckConsole, &closer);
+    nanosleep(&ts, NULL);
+
+    /* then: a thread logging to the file sink only does not wait for it */
+    start = time(NULL);
+    for (i = 0; i < 20000; i++) {
+        LOG_INFO("line %d", i);
+    }
+    nu_assert(time(NULL) - start < 10);
+    nu_assert(!closer.done);
+
+    /* cleanup: read the pipe, which lets the thread finish */
+    reader.fd = fds[0];
+    reader.size = 20000 * 128;
+    reader.data = (char*) malloc(reader.size);
+    reader.len = 0;
+    pthread_create(&thread, NULL, readAll, &reader);
+    pthread_join(closing, NULL);
+    if (flush) {
+        logger_removeSink(closer.id);
+    }
+    logger_removeSink(fileID);
+    fclose(output);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    free(reader.data);
+    remove(kFileName);
+    return 0;
+}
+
+static int test_otherThreadsWhileFlushing(void)
+{
+    nu_assert_eq_int(0, logWhileClosingStuckConsole(1));
+    return 0;
+}
+
+static int test_otherThreadsWhileRemoving(void)
+{
+    nu_assert_eq_int(0, logWhileClosingStuckConsole(0));
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    logger_setLevel(LogLevel_INFO);
+    nu_run_test(test_dropNewest);
+    nu_run_test(test_dropOldest);
+    nu_run_test(test_blockWithTimeout);
+    nu_run_test(test_fileSinkWhileConsoleIsStuck);
+    nu_run_test(test_otherThreadsWhileBlocked);
+    nu_run_test(test_otherThreadsWhileFlushing);
+    nu_run_test(test_otherThreadsWhileRemoving);
+    nu_report();
+}
@@ -0,0 +1,104 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "context.log";
+static FILE* s_input;
+static char s_line[1024];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_context_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static int test_initialize(void)
+{
+    int result;
+
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    s_input = fopen(kOutputFileName, "r");
+    nu_assert(s_input != NULL);
+    return 0;
+}
+
+static int test_pushAndPop(void)
+{
+    LOG_INFO("no context");
+    nu_assert_eq_str("no context", readMessage());
+
+    /* when: push entries */
+    nu_assert_eq_int(1, logger_ctxPush("req", "42"));
+    LOG_INFO("one %d", 1);
+    nu_assert_eq_str("[req=42] one 1", readMessage());
+    nu_assert_eq_int(1, logger_ctxPush("tenant", "acme"));
+    LOG_INFO("two");
+    nu_assert_eq_str("[req=42 tenant=acme] two", readMessage());
+
+    /* when: pop entries */
+    logger_ctxPop();
+    logger_logMessage(LogLevel_INFO, __FILENAME__, __LINE__, "one", 3);
+    nu_assert_eq_str("[req=42] one", readMessage());
+    nu_assert_eq_int(1, logger_ctxPush("user", "x"));
+    LOG_INFO("again");
+    nu_assert_eq_str("[req=42 user=x] again", readMessage());
+    logger_ctxPop();
+    logger_ctxPop();
+    LOG_INFO("none");
+    nu_assert_eq_str("none", readMessage());
+    return 0;
+}
+
+static int test_tooLong(void)
+{
+    char value[600];
+
+    /* when: push a value longer than the context */
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    nu_assert_eq_int(1, logger_ctxPush("req", "42"));
+
+    /* then: it is not pushed */
+    nu_assert_eq_int(0, logger_ctxPush("long", value));
+    LOG_INFO("short");
+    nu_assert_eq_str("[req=42] short", readMessage());
+    logger_ctxPop();
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_pushAndPop);
+    nu_run_test(test_tooLong);
+    cleanup();
+    nu_report();
+}
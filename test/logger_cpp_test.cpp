@@ -0,0 +1,160 @@
+#include "logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "cpp.log";
+static FILE* s_input;
+static char s_line[256];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_cpp_test.cpp:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static int test_initialize(void)
+{
+    int result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    s_input = fopen(kOutputFileName, "r");
+    nu_assert(s_input != NULL);
+    return 0;
+}
+
+static int test_format(void)
+{
+    std::string s("string");
+    char buf[] = "buffer";
+    char text[64];
+    int local;
+
+    LOGI("no fields");
+    nu_assert_eq_str("no fields", readMessage());
+
+    LOGI("x={} y={}", 1, "two");
+    nu_assert_eq_str("x=1 y=two", readMessage());
+
+    LOGI("{} {} {} {}", -2147483647 - 1, 18446744073709551615ULL, (short) -5, (unsigned char) 200);
+    nu_assert_eq_str("-2147483648 18446744073709551615 -5 200", readMessage());
+
+    LOGI("{}{}{} {} {}", 'a', true, false, s, buf);
+    nu_assert_eq_str("atruefalse string buffer", readMessage());
+
+    LOGI("{} {}", 0.5, 1e100);
+    nu_assert_eq_str("0.5 1e+100", readMessage());
+
+    LOGI("{{}} {{{}}} }}{{", 42);
+    nu_assert_eq_str("{} {42} }{", readMessage());
+
+    LOGI("{}", (void*) &local);
+    sprintf(text, "%p", (void*) &local);
+    nu_assert_eq_str(text, readMessage());
+    return 0;
+}
+
+static int test_disabledLevel(void)
+{
+    LOGD("{}", "debug");
+    LOGW("{}", "warn");
+    nu_assert_eq_str("warn", readMessage());
+    nu_assert_eq_int('W', s_line[0]);
+    return 0;
+}
+
+static int test_threadLevel(void)
+{
+    {
+        logger::ThreadLevel debug(LogLevel_DEBUG);
+        LOGD("{}", "debug");
+        nu_assert_eq_str("debug", readMessage());
+        nu_assert_eq_int('D', s_line[0]);
+    }
+    LOGD("{}", "debug");
+    LOGW("{}", "warn");
+    nu_assert_eq_str("warn", readMessage());
+    return 0;
+}
+
+static int test_context(void)
+{
+    {
+        logger::Context req("req", std::string("42"));
+        LOGI("{}", "in");
+        nu_assert_eq_str("[req=42] in", readMessage());
+    }
+    LOGI("{}", "out");
+    nu_assert_eq_str("out", readMessage());
+    return 0;
+}
+
+static int test_useLogger(void)
+{
+    logger_setLoggerLevel(logger_getLogger("quiet"), LogLevel_ERROR);
+    {
+        logger::UseLogger quiet("quiet");
+        LOGW("{}", "below the level of quiet");
+        LOGE("{}", "error");
+        nu_assert_eq_str("error", readMessage());
+    }
+    LOGW("{}", "warn");
+    nu_assert_eq_str("warn", readMessage());
+    return 0;
+}
+
+static int test_scopeTimer(void)
+{
+    unsigned long us;
+
+    {
+        LOG_SCOPE_TIMER(LogLevel_INFO, "sleep");
+        LOG_SCOPE_TIMER(LogLevel_DEBUG, "disabled");
+        LOG_SCOPE_TIMER_SLOW(LogLevel_INFO, "fast", 1000000);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    nu_assert(sscanf(readMessage(), "sleep: %lu.%*u us", &us) == 1);
+    nu_assert(us >= 2000);
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_format);
+    nu_run_test(test_disabledLevel);
+    nu_run_test(test_threadLevel);
+    nu_run_test(test_context);
+    nu_run_test(test_useLogger);
+    nu_run_test(test_scopeTimer);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,77 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "fileindex.log";
+static const char kIndexFileName[] = "fileindex.log.idx";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+    remove(kIndexFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+    remove(kIndexFileName);
+}
+
+static int test_fileIndex(void)
+{
+    FILE* index;
+    FILE* fp;
+    char timestamp[25];
+    char line[256];
+    long offset, previous = -1;
+    int count = 0;
+    int result;
+    int i;
+
+    /* when: initialize file logger with an index entry every 512 bytes */
+    logger_setFileIndex(512);
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+
+    /* then: ok */
+    nu_assert_eq_int(1, result);
+
+    /* when: output lines to the file */
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("line %d", i);
+    }
+    logger_flush();
+
+    /* then: every entry points to the start of a line with its timestamp */
+    if ((index = fopen(kIndexFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    if ((fp = fopen(kOutputFileName, "r")) == NULL) {
+        nu_fail();
+    }
+    while (fscanf(index, "%24c %ld\n", timestamp, &offset) == 2) {
+        timestamp[24] = '\0';
+        nu_assert(offset == 0 || offset - previous >= 512);
+        nu_assert_eq_int(0, fseek(fp, offset, SEEK_SET));
+        nu_assert(fgets(line, sizeof(line), fp) != NULL);
+        nu_assert_eq_int('I', line[0]);
+        nu_assert_eq_int(0, strncmp(timestamp, &line[2], 24));
+        previous = offset;
+        count++;
+    }
+    nu_assert(count > 1);
+
+    /* cleanup: close resources */
+    logger_setFileIndex(0);
+    fclose(fp);
+    fclose(index);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_fileIndex);
+    cleanup();
+    nu_report();
+}
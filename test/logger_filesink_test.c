@@ -0,0 +1,216 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "filesink.log";
+static const char kBackupFileName[] = "filesink.log.1";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+    remove(kBackupFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+    remove(kBackupFileName);
+}
+
+/* Read the numbers at the end of the lines, returning the number of lines or -1 if one is out of order */
+static int readNumbers(const char* filename, int first)
+{
+    FILE* fp;
+    char line[4096];
+    const char* sp;
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if ((sp = strrchr(line, ' ')) == NULL || atoi(sp + 1) != first + count) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+/* Log the lines through a file sink and check that the file has all of them in order */
+static int logThroughSink(enum LogIoUring ioUring, int sync, long flushInterval)
+{
+    struct LogFileSink config;
+    int id;
+    int i;
+
+    setup();
+    memset(&config, 0, sizeof(config));
+    config.filename = kOutputFileName;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.bufferSize = 1024; /* many writes in flight */
+    config.flushInterval = flushInterval;
+    config.sync = sync;
+    config.ioUring = ioUring;
+    id = logger_addFileSink(&config);
+    nu_assert(id != 0);
+
+    for (i = 0; i < 3000; i++) {
+        LOG_INFO("line %d", i);
+    }
+    logger_flush();
+    nu_assert_eq_int(3000, readNumbers(kOutputFileName, 0));
+
+    logger_removeSink(id);
+    return 0;
+}
+
+static int test_writev(void)
+{
+    nu_assert_eq_int(0, logThroughSink(LogIoUring_OFF, 0, -1));
+    return 0;
+}
+
+static int test_ioUring(void)
+{
+    /* the file is written with writev() without io_uring, with the same result */
+    nu_assert_eq_int(0, logThroughSink(LogIoUring_ON, 0, -1));
+    nu_assert_eq_int(0, logThroughSink(LogIoUring_ON, 0, 0));
+    nu_assert_eq_int(0, logThroughSink(LogIoUring_ON, 1, 100));
+    nu_assert_eq_int(0, logThroughSink(LogIoUring_SQPOLL, 0, -1));
+    return 0;
+}
+
+static int test_ioUringRotation(void)
+{
+    struct LogFileSink config;
+    int id;
+    int backup;
+    int i;
+
+    /* setup: a small file with a backup */
+    setup();
+    memset(&config, 0, sizeof(config));
+    config.filename = kOutputFileName;
+    config.maxFileSize = 16 * 1024;
+    config.maxBackupFiles = 1;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.bufferSize = 1024;
+    config.flushInterval = -1;
+    config.ioUring = LogIoUring_ON;
+    id = logger_addFileSink(&config);
+    nu_assert(id != 0);
+
+    /* when: log more than a file holds */
+    for (i = 0; i < 300; i++) {
+        LOG_INFO("line %d", i);
+    }
+    logger_removeSink(id);
+
+    /* then: the backup is followed by the current file without a gap */
+    backup = readNumbers(kBackupFileName, 0);
+    nu_assert(backup > 0);
+    nu_assert_eq_int(300 - backup, readNumbers(kOutputFileName, backup));
+    return 0;
+}
+
+static int test_ioUringWithOtherWriter(void)
+{
+    struct LogFileSink config;
+    FILE* fp;
+    FILE* other;
+    char line[4096];
+    const char* sp;
+    int lines = 0;
+    int others = 0;
+    int id;
+    int i;
+
+    /* setup: */
+    setup();
+    memset(&config, 0, sizeof(config));
+    config.filename = kOutputFileName;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.bufferSize = 1024;
+    config.flushInterval = -1;
+    config.ioUring = LogIoUring_ON;
+    id = logger_addFileSink(&config);
+    nu_assert(id != 0);
+    nu_assert((other = fopen(kOutputFileName, "a")) != NULL);
+
+    /* when: another writer appends to the file in between */
+    for (i = 0; i < 3000; i++) {
+        LOG_INFO("line %d", i);
+        if (i % 100 == 0) {
+            fputs("other\n", other);
+            fflush(other);
+        }
+    }
+    logger_removeSink(id);
+    fclose(other);
+
+    /* then: no line overwrites another */
+    nu_assert((fp = fopen(kOutputFileName, "r")) != NULL);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strcmp(line, "other\n") == 0) {
+            others++;
+        } else if ((sp = strrchr(line, ' ')) != NULL && atoi(sp + 1) == lines) {
+            lines++;
+        }
+    }
+    fclose(fp);
+    nu_assert_eq_int(30, others);
+    nu_assert_eq_int(3000, lines);
+    return 0;
+}
+
+static int test_lineLongerThanBuffer(void)
+{
+    struct LogFileSink config;
+    char text[1500];
+    int id;
+
+    /* setup: buffers shorter than a line */
+    setup();
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    memset(&config, 0, sizeof(config));
+    config.filename = kOutputFileName;
+    config.minLevel = LogLevel_INFO;
+    config.maxLevel = LogLevel_FATAL;
+    config.bufferSize = 512;
+    config.flushInterval = -1;
+    config.ioUring = LogIoUring_ON;
+    id = logger_addFileSink(&config);
+    nu_assert(id != 0);
+
+    /* when: log the long line between short lines */
+    LOG_INFO("line %d", 0);
+    LOG_INFO("%s 1", text);
+    LOG_INFO("line %d", 2);
+    logger_flush();
+
+    /* then: they are in order */
+    nu_assert_eq_int(3, readNumbers(kOutputFileName, 0));
+    logger_removeSink(id);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    logger_setLevel(LogLevel_INFO);
+    nu_run_test(test_writev);
+    nu_run_test(test_ioUring);
+    nu_run_test(test_ioUringRotation);
+    nu_run_test(test_ioUringWithOtherWriter);
+    nu_run_test(test_lineLongerThanBuffer);
+    cleanup();
+    nu_report();
+}
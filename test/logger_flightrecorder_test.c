@@ -0,0 +1,199 @@
+#include "logger.h"
+#include <stdio.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "flightrecorder.log";
+static const char kLockFileName[] = "flightrecorder.log.lock"; /* of the shared file logger */
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+    remove(kLockFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+    remove(kLockFileName);
+}
+
+static int countLines(const char* filename, const char* levels)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strchr(levels, line[0]) == NULL || line[strlen(line) - 1] != '\n') {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_dumpOnError(void)
+{
+    int result;
+
+    /* setup: record DEBUG messages below the INFO level */
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    result = logger_initFlightRecorder(4096, LogLevel_DEBUG);
+    nu_assert_eq_int(1, result);
+
+    /* when: log messages below the log level */
+    LOG_TRACE("trace");
+    LOG_DEBUG("debug %d", 1);
+    LOG_DEBUG("debug %d", 2);
+    logger_flush();
+
+    /* then: nothing is written */
+    nu_assert_eq_int(0, countLines(kOutputFileName, "D"));
+
+    /* when: log an error */
+    LOG_ERROR("error");
+    logger_flush();
+
+    /* then: the recorded messages precede the error */
+    nu_assert_eq_int(3, countLines(kOutputFileName, "DE"));
+
+    /* when: dump the empty recorder */
+    logger_dumpFlightRecorder();
+    logger_flush();
+
+    /* then: nothing more is written */
+    nu_assert_eq_int(3, countLines(kOutputFileName, "DE"));
+    return 0;
+}
+
+static int test_dumpWrapped(void)
+{
+    int result;
+    int i;
+    int count;
+
+    /* setup: a ring smaller than the messages to be recorded */
+    remove(kOutputFileName);
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    result = logger_initFlightRecorder(300, LogLevel_DEBUG);
+    nu_assert_eq_int(1, result);
+
+    /* when: log more than the ring can hold and dump it */
+    for (i = 0; i < 100; i++) {
+        LOG_DEBUG("message %d", i);
+    }
+    logger_dumpFlightRecorder();
+    logger_flush();
+
+    /* then: only the newest whole lines are written */
+    count = countLines(kOutputFileName, "D");
+    nu_assert(count > 0);
+    nu_assert(count < 100);
+
+    /* cleanup: switch off */
+    result = logger_initFlightRecorder(0, LogLevel_DEBUG);
+    nu_assert_eq_int(1, result);
+    return 0;
+}
+
+static void logMessages(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        LOG_DEBUG("message %d", i); /* the same length for each */
+    }
+}
+
+/* Measure a recorded line */
+static size_t measureLine(void)
+{
+    FILE* fp;
+    char line[256];
+
+    remove(kOutputFileName);
+    logger_initFileLogger(kOutputFileName, 0, 0);
+    logger_initFlightRecorder(4096, LogLevel_DEBUG);
+    logMessages(1);
+    logger_dumpFlightRecorder();
+    logger_flush();
+    if ((fp = fopen(kOutputFileName, "r")) == NULL || fgets(line, sizeof(line), fp) == NULL) {
+        return 0;
+    }
+    fclose(fp);
+    return strlen(line);
+}
+
+static int test_dumpFull(void)
+{
+    size_t len;
+
+    /* setup: */
+    nu_assert((len = measureLine()) > 0);
+
+    /* when: lines that fill the ring exactly */
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert_eq_int(1, logger_initFlightRecorder(2 * len, LogLevel_DEBUG));
+    logMessages(2);
+    logger_dumpFlightRecorder();
+    logger_flush();
+
+    /* then: both are written */
+    nu_assert_eq_int(2, countLines(kOutputFileName, "D"));
+
+    /* cleanup: switch off */
+    nu_assert_eq_int(1, logger_initFlightRecorder(0, LogLevel_DEBUG));
+    return 0;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static int test_dumpWrappedToSharedFile(void)
+{
+    FILE* fp;
+    char line[256];
+    size_t len;
+
+    /* setup: a ring of 2.5 lines for a file shared with other processes */
+    nu_assert((len = measureLine()) > 0);
+    remove(kOutputFileName);
+    nu_assert_eq_int(1, logger_initSharedFileLogger(kOutputFileName, 0, 0));
+    nu_assert_eq_int(1, logger_initFlightRecorder(2 * len + len / 2, LogLevel_DEBUG));
+
+    /* when: the ring wraps in the middle of a line and is dumped */
+    logMessages(10);
+    logger_dumpFlightRecorder();
+    logger_flush();
+
+    /* then: the newest whole lines are written in order */
+    nu_assert_eq_int(2, countLines(kOutputFileName, "D"));
+    nu_assert((fp = fopen(kOutputFileName, "r")) != NULL);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL && strstr(line, "message 8\n") != NULL);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL && strstr(line, "message 9\n") != NULL);
+    fclose(fp);
+
+    /* cleanup: switch off */
+    nu_assert_eq_int(1, logger_initFlightRecorder(0, LogLevel_DEBUG));
+    return 0;
+}
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_dumpOnError);
+    nu_run_test(test_dumpWrapped);
+    nu_run_test(test_dumpFull);
+#if !defined(_WIN32) && !defined(_WIN64)
+    nu_run_test(test_dumpWrappedToSharedFile);
+#endif /* !defined(_WIN32) && !defined(_WIN64) */
+    cleanup();
+    nu_report();
+}
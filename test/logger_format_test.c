@@ -0,0 +1,143 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "format.log";
+static FILE* s_input;
+static char s_expected[256];
+static char s_line[256];
+
+#define assert_format(...) do { \
+    sprintf(s_expected, __VA_ARGS__); \
+    LOG_INFO(__VA_ARGS__); \
+    nu_assert_eq_str(s_expected, readMessage()); \
+} while (0)
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_format_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static double randomDouble(int i)
+{
+    double scale = 1;
+    int exponent = rand() % 40 - 20;
+    int j;
+
+    for (j = 0; j < exponent; j++) {
+        scale *= 10;
+    }
+    for (j = 0; j > exponent; j--) {
+        scale /= 10;
+    }
+    switch (i % 4) {
+        case 0: return (double) rand() / RAND_MAX * scale;
+        case 1: return -(double) rand() / RAND_MAX * scale;
+        case 2: return (rand() % 1000) / 8.0; /* exact ties */
+        default: return -(rand() % 100000) / 1024.0;
+    }
+}
+
+static int test_initialize(void)
+{
+    int result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    s_input = fopen(kOutputFileName, "r");
+    nu_assert(s_input != NULL);
+    return 0;
+}
+
+static int test_integers(void)
+{
+    assert_format("%d", 0);
+    assert_format("%d %i", 2147483647, -2147483647 - 1);
+    assert_format("%ld %lu", -1234567890L, 4294967295UL);
+    assert_format("%lld %llu", -9223372036854775807LL - 1, 18446744073709551615ULL);
+    assert_format("%u %x %X", 4294967295U, 0xdeadbeefU, 0xcafeU);
+    assert_format("%lx %llX", 0x123456789abcdefUL, 0xfedcba9876543210ULL);
+    assert_format("%zu %zx", (size_t) 1234567, sizeof(long));
+    assert_format("[%5d] [%-5d] [%05d] [%-5d]", 42, 42, -42, -42);
+    assert_format("[%2d] [%08x] [%-8X]", 12345, 0xbeefU, 0xbeefU);
+    return 0;
+}
+
+static int test_strings(void)
+{
+    const char* s = "string";
+    int local;
+
+    assert_format("%s", "");
+    assert_format("%s and %s", "this", "that");
+    assert_format("[%10s] [%-10s] [%.3s] [%8.2s] [%.10s]", s, s, s, s, s);
+    assert_format("%c%c%c [%3c] [%-3c]", 'a', 'b', 'c', 'x', 'y');
+    assert_format("%p %20p %-20p|", (void*) &local, (void*) s, (void*) s);
+    assert_format("100%% %d%%", 5);
+    return 0;
+}
+
+static int test_doubles(void)
+{
+    double value;
+    int i;
+
+    assert_format("%f %f %f", 0.0, -0.0, 1.0);
+    assert_format("%.0f %.0f %.0f %.0f", 0.5, 1.5, 2.5, -0.5);
+    assert_format("%.2f %.2f %.2f", 0.125, 0.375, 1.005);
+    assert_format("%.3f %10.4f %-10.1f| %010.2f", 3.14159, -2.71828, 1.25, -9.875);
+    assert_format("%f %.17f", 1e-300, 0.1);
+    assert_format("%f %f", 9007199254740993.0, 9223372036854775807.0);
+    assert_format("%f %.1f", 1e30, 4.9e-324);
+    for (i = 0; i < 2000; i++) {
+        value = randomDouble(i);
+        assert_format("%f|%.0f|%.1f|%.3f|%.9f|%12.5f", value, value, value, value, value, value);
+    }
+    return 0;
+}
+
+static int test_fallback(void)
+{
+    assert_format("%+d % d %#x %.5d %*d %hd", 1, 2, 255U, 42, 6, 7, (short) 8);
+    assert_format("%e %g %E %G", 12345.678, 0.0001, 1e100, 1e-100);
+    assert_format("[%s] [%p]", "null follows", (void*) NULL);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    srand(1);
+    nu_run_test(test_initialize);
+    nu_run_test(test_integers);
+    nu_run_test(test_strings);
+    nu_run_test(test_doubles);
+    nu_run_test(test_fallback);
+    cleanup();
+    nu_report();
+}
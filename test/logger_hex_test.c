@@ -0,0 +1,168 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "hex.log";
+static FILE* s_input;
+static char s_line[8192];
+static char s_expected[768];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_hex_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+/* Encode the bytes the way they were encoded before LOG_HEX() */
+static const char* sprintfHex(const unsigned char* data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sprintf(&s_expected[i * 2], "%02x", data[i]);
+    }
+    s_expected[len * 2] = '\0';
+    return s_expected;
+}
+
+static int count(int* calls)
+{
+    return ++*calls;
+}
+
+static int test_initialize(void)
+{
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert((s_input = fopen(kOutputFileName, "r")) != NULL);
+    return 0;
+}
+
+static int test_plain(void)
+{
+    unsigned char data[256];
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        data[i] = (unsigned char) i;
+    }
+    logger_setHexFormat(0, 0);
+
+    /* the bytes in all lengths around the 16 bytes encoded at a time */
+    for (i = 0; i <= 40; i++) {
+        LOG_HEX(LogLevel_INFO, &data[256 - 40], i, "%d bytes", i);
+        sprintf(s_line, "%d bytes: %s", i, sprintfHex(&data[256 - 40], i));
+        strcpy(s_expected, (i == 0) ? "0 bytes" : s_line);
+        nu_assert_eq_str(s_expected, readMessage());
+    }
+    LOG_HEX(LogLevel_INFO, data, sizeof(data), "");
+    nu_assert_eq_str(sprintfHex(data, sizeof(data)), readMessage());
+    LOG_HEX(LogLevel_INFO, &data[3], 37, "");
+    nu_assert_eq_str(sprintfHex(&data[3], 37), readMessage());
+    return 0;
+}
+
+static int test_maxBytes(void)
+{
+    unsigned char data[4000];
+    const char* message;
+
+    memset(data, 0xab, sizeof(data));
+
+    /* when: more bytes than the maximum */
+    logger_setHexFormat(0, 4);
+    LOG_HEX(LogLevel_INFO, data, 10, "packet");
+
+    /* then: they are left out */
+    nu_assert_eq_str("packet: abababab... (10 bytes)", readMessage());
+
+    /* when: more bytes than a line holds */
+    logger_setHexFormat(0, 0);
+    LOG_HEX(LogLevel_INFO, data, sizeof(data), "packet");
+
+    /* then: the line is not longer than 4 KB */
+    message = readMessage();
+    nu_assert(strlen(s_line) < 4096);
+    nu_assert(strstr(message, "abab... (4000 bytes)") != NULL);
+    return 0;
+}
+
+static int test_columns(void)
+{
+    const char data[] = "GET / HTTP/1.1\r\nHost: a\r\n";
+
+    /* when: the bytes in columns */
+    logger_setHexFormat(LogHex_OFFSET | LogHex_ASCII, 0);
+    LOG_HEX(LogLevel_INFO, data, strlen(data), "request %d", 1);
+
+    /* then: a line for each 16 bytes */
+    nu_assert_eq_str("request 1", readMessage());
+    nu_assert_eq_str("0000  47 45 54 20 2f 20 48 54  54 50 2f 31 2e 31 0d 0a  |GET / HTTP/1.1..|", readMessage());
+    nu_assert_eq_str("0010  48 6f 73 74 3a 20 61 0d  0a                       |Host: a..|", readMessage());
+
+    /* when: without the offset and the ASCII characters, up to 20 bytes */
+    logger_setHexFormat(LogHex_OFFSET, 20);
+    LOG_HEX(LogLevel_INFO, data, strlen(data), "request %d", 2);
+
+    /* then: the bytes left out are marked on a line of their own */
+    nu_assert_eq_str("request 2", readMessage());
+    nu_assert_eq_str("0000  47 45 54 20 2f 20 48 54  54 50 2f 31 2e 31 0d 0a", readMessage());
+    nu_assert_eq_str("0010  48 6f 73 74", readMessage());
+    nu_assert_eq_str("... (25 bytes)", readMessage());
+    logger_setHexFormat(0, 0);
+    return 0;
+}
+
+static int test_disabledLevel(void)
+{
+    char data[4] = {0};
+    int calls = 0;
+
+    /* when: the level is disabled */
+    logger_setLevel(LogLevel_INFO);
+    LOG_HEX(LogLevel_DEBUG, data + count(&calls), sizeof(data), "%d", count(&calls));
+
+    /* then: nothing is evaluated or written */
+    nu_assert_eq_int(0, calls);
+    LOG_HEX(LogLevel_INFO, data, sizeof(data), "enabled");
+    nu_assert_eq_str("enabled: 00000000", readMessage());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_plain);
+    nu_run_test(test_maxBytes);
+    nu_run_test(test_columns);
+    nu_run_test(test_disabledLevel);
+    cleanup();
+    nu_report();
+}
@@ -98,6 +98,80 @@ static int test_fatal(void)
     return 0;
 }
 
+static int test_threadLevel(void)
+{
+    /* when: lower the level of this thread */
+    logger_setLevel(LogLevel_INFO);
+    logger_setThreadLevel(LogLevel_DEBUG);
+
+    /* then: the lower level is enabled */
+    nu_assert_eq_int(LogLevel_INFO, logger_getLevel());
+    nu_assert_eq_int(LogLevel_DEBUG, logger_getThreadLevel());
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+    nu_assert(logger_isEnabled(LogLevel_DEBUG));
+    nu_assert(logger_isEnabled(LogLevel_INFO));
+
+    /* when: push a lower level and then a higher one */
+    nu_assert_eq_int(1, logger_pushThreadLevel(LogLevel_TRACE));
+    nu_assert(logger_isEnabled(LogLevel_TRACE));
+    nu_assert_eq_int(1, logger_pushThreadLevel(LogLevel_ERROR));
+
+    /* then: the thread level does not raise the log level */
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+    nu_assert(logger_isEnabled(LogLevel_INFO));
+
+    /* when: pop the levels */
+    logger_popThreadLevel();
+    nu_assert_eq_int(LogLevel_TRACE, logger_getThreadLevel());
+    logger_popThreadLevel();
+
+    /* then: the level set before is restored */
+    nu_assert_eq_int(LogLevel_DEBUG, logger_getThreadLevel());
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+
+    /* cleanup: reset the thread level */
+    logger_setThreadLevel(LogLevel_FATAL);
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+    return 0;
+}
+
+static int test_changedLevels(void)
+{
+    int id;
+
+    /* setup: the check of a disabled level is kept by the thread */
+    nu_assert(logger_initFileLogger("loglevel.log", 0, 0));
+    logger_setLevel(LogLevel_INFO);
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+
+    /* then: each change of a level is seen */
+    logger_setLevel(LogLevel_DEBUG);
+    nu_assert(logger_isEnabled(LogLevel_DEBUG));
+    logger_setLevel(LogLevel_INFO);
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+
+    id = logger_getLogger("verbose");
+    logger_setLoggerLevel(id, LogLevel_TRACE);
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+    logger_useLogger(id);
+    nu_assert(logger_isEnabled(LogLevel_TRACE));
+    logger_useLogger(0);
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+
+    nu_assert(logger_initFlightRecorder(4096, LogLevel_DEBUG));
+    nu_assert(logger_isEnabled(LogLevel_DEBUG));
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+    nu_assert(logger_initFlightRecorder(0, LogLevel_DEBUG));
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+
+    nu_assert(logger_scopeBegin());
+    nu_assert(logger_isEnabled(LogLevel_TRACE));
+    logger_scopeDiscard();
+    nu_assert(!logger_isEnabled(LogLevel_TRACE));
+    remove("loglevel.log");
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     nu_run_test(test_trace);
@@ -106,5 +180,7 @@ int main(int argc, char* argv[])
     nu_run_test(test_warn);
     nu_run_test(test_error);
     nu_run_test(test_fatal);
+    nu_run_test(test_threadLevel);
+    nu_run_test(test_changedLevels);
     nu_report();
 }
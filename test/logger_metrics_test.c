@@ -0,0 +1,230 @@
+#include "logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "metrics.log";
+#define kThreads 8
+static const int kAdditions = 10000;
+static FILE* s_input;
+static char s_line[1024];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_metrics_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static int isWithin(long expected, long value)
+{
+    return labs(value - expected) <= expected / 16;
+}
+
+static int test_initialize(void)
+{
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert((s_input = fopen(kOutputFileName, "r")) != NULL);
+    logger_setLevel(LogLevel_INFO);
+    return 0;
+}
+
+static int test_off(void)
+{
+    /* when: the metrics are off */
+    LOG_COUNT("off");
+    logger_emitMetrics();
+
+    /* then: nothing is written */
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+static int test_count(void)
+{
+    char location[64];
+    int line;
+    int i;
+
+    /* when: */
+    logger_initMetrics(60 * 1000, LogLevel_INFO);
+    for (i = 0; i < 100; i++) {
+        line = __LINE__; LOG_COUNT("requests");
+    }
+    logger_emitMetrics();
+
+    /* then: a line with the count at the location of the call */
+    nu_assert(strncmp("requests: count=100 rate=", readMessage(), 25) == 0);
+    nu_assert(s_line[0] == 'I');
+    sprintf(location, " logger_metrics_test.c:%d: requests", line);
+    nu_assert(strstr(s_line, location) != NULL);
+    nu_assert_eq_str("", readMessage());
+
+    /* then: nothing is written for an interval without additions */
+    logger_emitMetrics();
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+static int test_histogram(void)
+{
+    long min, p50, p99, max;
+    unsigned long count;
+    int i;
+
+    /* when: */
+    for (i = 1000; i >= 1; i--) {
+        LOG_HIST("latency_us", i);
+    }
+    logger_emitMetrics();
+
+    /* then: the percentiles are within 1/16 */
+    nu_assert(sscanf(readMessage(), "latency_us: count=%lu rate=%*f/s min=%ld p50=%ld p99=%ld max=%ld",
+            &count, &min, &p50, &p99, &max) == 5);
+    nu_assert_eq_int(1000, (int) count);
+    nu_assert_eq_int(1, (int) min);
+    nu_assert(isWithin(500, p50));
+    nu_assert(isWithin(990, p99));
+    nu_assert_eq_int(1000, (int) max);
+    return 0;
+}
+
+static int test_level(void)
+{
+    /* when: the level of the metrics is not logged */
+    logger_initMetrics(60 * 1000, LogLevel_DEBUG);
+    LOG_COUNT("requests");
+    logger_emitMetrics();
+
+    /* then: */
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+static void* addValues(void* arg)
+{
+    int i;
+
+    for (i = 0; i < kAdditions; i++) {
+        LOG_HIST("size", 64);
+        if (i % 1000 == 0) {
+            LOG_INFO("thread %d", *(int*) arg); /* may emit the metrics in between */
+        }
+    }
+    return NULL;
+}
+
+static int test_threads(void)
+{
+    pthread_t threads[kThreads];
+    int args[kThreads];
+    const char* message;
+    unsigned long count;
+    unsigned long total = 0;
+    long p50;
+    int i;
+
+    /* when: the threads add to a metric emitted every millisecond */
+    logger_initMetrics(1, LogLevel_INFO);
+    for (i = 0; i < kThreads; i++) {
+        args[i] = i;
+        pthread_create(&threads[i], NULL, addValues, &args[i]);
+    }
+    for (i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    logger_emitMetrics();
+
+    /* then: no addition is lost across the emissions */
+    while (*(message = readMessage()) != '\0') {
+        if (sscanf(message, "size: count=%lu rate=%*f/s min=%*d p50=%ld", &count, &p50) == 2) {
+            nu_assert(isWithin(64, p50));
+            total += count;
+        }
+    }
+    nu_assert_eq_int(kThreads * kAdditions, (int) total);
+    logger_initMetrics(0, LogLevel_INFO);
+    return 0;
+}
+
+static pthread_key_t s_key;
+
+static void addAtExit(void* arg)
+{
+    LOG_COUNT("exit");
+    logger_emitMetrics(); /* frees the metrics of the exited thread */
+    LOG_COUNT("exit");
+}
+
+static void* setAddAtExit(void* arg)
+{
+    pthread_setspecific(s_key, arg);
+    LOG_COUNT("exit");
+    return NULL;
+}
+
+static int test_addAtThreadExit(void)
+{
+    pthread_t thread;
+    const char* message;
+    unsigned long count;
+    unsigned long total = 0;
+
+    /* when: a destructor of the thread adds after the logger has marked its metrics */
+    logger_initMetrics(60 * 1000, LogLevel_INFO);
+    pthread_key_create(&s_key, addAtExit);
+    pthread_create(&thread, NULL, setAddAtExit, &s_key);
+    pthread_join(thread, NULL);
+    logger_emitMetrics();
+
+    /* then: the additions are not lost */
+    while (*(message = readMessage()) != '\0') {
+        if (sscanf(message, "exit: count=%lu", &count) == 1) {
+            total += count;
+        }
+    }
+    nu_assert_eq_int(3, (int) total);
+    pthread_key_delete(s_key);
+    logger_initMetrics(0, LogLevel_INFO);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_off);
+    nu_run_test(test_count);
+    nu_run_test(test_histogram);
+    nu_run_test(test_level);
+    nu_run_test(test_threads);
+    nu_run_test(test_addAtThreadExit);
+    cleanup();
+    nu_report();
+}
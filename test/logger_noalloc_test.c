@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200112L /* pthread_barrier_t */
+#include "logger.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "nanounit.h"
+
+/* glibc's allocator, called by the interposed functions below */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static volatile int s_counting = 0; /* false */
+static volatile int s_allocations = 0;
+
+void* malloc(size_t size)
+{
+    if (s_counting) {
+        s_allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    if (s_counting) {
+        s_allocations++;
+    }
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (s_counting) {
+        s_allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    if (s_counting && ptr != NULL) {
+        s_allocations++;
+    }
+    __libc_free(ptr);
+}
+
+static const char kFileName[] = "noalloc.log";
+static const char kSharedFileName[] = "noalloc_shared.log";
+static const char kShardFileName[] = "noalloc_shard.log";
+static const char kCompressedFileName[] = "noalloc_compressed.log";
+static const char kConsoleFileName[] = "noalloc_console.log";
+static const char kFileSinkName[] = "noalloc_sink.log";
+static const char kUringSinkName[] = "noalloc_uring.log";
+static const char kConsoleSinkName[] = "noalloc_consolesink.log";
+
+/* Remove the log files, their backups and the files of the shards */
+static void removeAllFiles(void)
+{
+    DIR* dir;
+    struct dirent* entry;
+
+    if ((dir = opendir(".")) == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "noalloc", 7) == 0) {
+            remove(entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+static void setup(void)
+{
+    removeAllFiles();
+}
+
+static void cleanup(void)
+{
+    removeAllFiles();
+}
+
+/* Log enough lines to rotate the files several times */
+static void logLines(void)
+{
+    int i;
+
+    for (i = 0; i < 2000; i++) {
+        LOG_INFO("line %d %s %5.2f %x", i, "string", i / 3.0, i);
+        LOG_DEBUG("kept by the flight recorder %d", i);
+        if (i % 500 == 0) {
+            LOG_ERROR("dump the flight recorder %d", i);
+        }
+    }
+    logger_flush();
+}
+
+static int test_fileLoggers(void)
+{
+    /* setup: initialize the loggers, which may allocate */
+    nu_assert_eq_int(1, logger_initFlightRecorder(4096, LogLevel_DEBUG));
+    logger_setFileIndex(1024);
+    nu_assert_eq_int(1, logger_initSiteProfile(16, 3, 0));
+    nu_assert_eq_int(1, logger_initFileLogger(kFileName, 8192, 3));
+    logLines(); /* and: the lazy initialization in the C library */
+
+    /* when: log and rotate */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+
+    /* when: log and rotate as a shared file logger */
+    nu_assert_eq_int(1, logger_initSharedFileLogger(kSharedFileName, 8192, 3));
+    logLines();
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+    return 0;
+}
+
+static int test_shardedFileLogger(void)
+{
+    /* setup: initialize the logger and the shard of this thread */
+    nu_assert_eq_int(1, logger_initShardedFileLogger(kShardFileName, 8192, 3));
+    logLines();
+
+    /* when: log and rotate */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+    return 0;
+}
+
+#define kShardThreads 70 /* more than the default pool */
+static pthread_barrier_t s_barrier;
+
+static void* logShardLines(void* arg)
+{
+    int i;
+
+    pthread_barrier_wait(&s_barrier);
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("line %d %s", i, "string");
+    }
+    pthread_barrier_wait(&s_barrier);
+    return NULL;
+}
+
+static int test_shardsOfManyThreads(void)
+{
+    pthread_t threads[kShardThreads];
+    int i;
+
+    /* setup: a shard for each thread, and the threads */
+    logger_setShardPoolSize(kShardThreads + 1);
+    nu_assert_eq_int(1, logger_initShardedFileLogger(kShardFileName, 8192, 3));
+    pthread_barrier_init(&s_barrier, NULL, kShardThreads + 1);
+    for (i = 0; i < kShardThreads; i++) {
+        nu_assert_eq_int(0, pthread_create(&threads[i], NULL, logShardLines, NULL));
+    }
+
+    /* when: the threads log at once */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    pthread_barrier_wait(&s_barrier);
+    pthread_barrier_wait(&s_barrier);
+    s_counting = 0; /* false */
+    for (i = 0; i < kShardThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&s_barrier);
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+    return 0;
+}
+
+static int test_compressedFileLogger(void)
+{
+    /* setup: initialize the logger, which may be unavailable without zlib */
+    if (!logger_initCompressedFileLogger(kCompressedFileName, 1, 3)) {
+        return 0;
+    }
+    logLines();
+
+    /* when: log and rotate, including the compressor thread */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+    return 0;
+}
+
+static int test_consoleLogger(void)
+{
+    int fd, saved;
+
+    /* setup: stdout to a file, whose stdio buffer is allocated by the output so far */
+    fflush(stdout);
+    nu_assert((fd = open(kConsoleFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0);
+    saved = dup(1);
+    dup2(fd, 1);
+    close(fd);
+    nu_assert_eq_int(1, logger_initConsoleLogger(stdout));
+    logLines();
+
+    /* when: */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    nu_assert_eq_int(0, s_allocations);
+    return 0;
+}
+
+static void writeNothing(void* context, const struct iovec* lines, int n)
+{
+}
+
+static int test_sinks(void)
+{
+    struct LogFileSink file, uring;
+    struct LogConsoleSink console;
+    struct LogSink custom;
+    FILE* output;
+    int ids[4];
+    int i;
+
+    /* setup: a sink of each kind beside the file logger */
+    nu_assert_eq_int(1, logger_initFileLogger(kFileName, 8192, 3));
+    memset(&file, 0, sizeof(file));
+    file.filename = kFileSinkName;
+    file.maxFileSize = 8192;
+    file.maxBackupFiles = 3;
+    file.minLevel = LogLevel_TRACE;
+    file.maxLevel = LogLevel_FATAL;
+    uring = file;
+    uring.filename = kUringSinkName;
+    uring.ioUring = LogIoUring_ON;
+    memset(&console, 0, sizeof(console));
+    nu_assert((output = fopen(kConsoleSinkName, "w")) != NULL);
+    console.output = output;
+    console.minLevel = LogLevel_TRACE;
+    console.maxLevel = LogLevel_FATAL;
+    console.overflow = LogOverflow_BLOCK;
+    console.blockTimeout = 1000;
+    memset(&custom, 0, sizeof(custom));
+    custom.writeBatch = writeNothing;
+    nu_assert((ids[0] = logger_addFileSink(&file)) != 0);
+    nu_assert((ids[1] = logger_addFileSink(&uring)) != 0);
+    nu_assert((ids[2] = logger_addConsoleSink(&console)) != 0);
+    nu_assert((ids[3] = logger_addSink(&custom, LogLevel_TRACE, LogLevel_FATAL)) != 0);
+    logLines();
+
+    /* when: log and rotate, including the writer thread of the console sink */
+    s_allocations = 0;
+    s_counting = 1; /* true */
+    logLines();
+    s_counting = 0; /* false */
+
+    /* then: nothing is allocated */
+    nu_assert_eq_int(0, s_allocations);
+    for (i = 0; i < 4; i++) {
+        logger_removeSink(ids[i]);
+    }
+    fclose(output);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_fileLoggers);
+    nu_run_test(test_shardedFileLogger);
+    nu_run_test(test_shardsOfManyThreads);
+    nu_run_test(test_compressedFileLogger);
+    nu_run_test(test_sinks);
+    nu_run_test(test_consoleLogger); /* the last, as it stays on */
+    cleanup();
+    nu_report();
+}
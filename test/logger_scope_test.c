@@ -0,0 +1,150 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "scope.log";
+static FILE* s_input;
+static char s_line[1024];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_scope_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static int test_initialize(void)
+{
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert((s_input = fopen(kOutputFileName, "r")) != NULL);
+    logger_setLevel(LogLevel_INFO);
+    return 0;
+}
+
+static int test_commit(void)
+{
+    char data[2] = {0x0a, 0x0b};
+
+    /* when: log in a scope */
+    nu_assert(logger_scopeBegin());
+    nu_assert(logger_isEnabled(LogLevel_DEBUG));
+    logger_ctxPush("req", "1");
+    LOG_DEBUG("debug %d", 1);
+    logger_ctxPop();
+    LOG_INFO("info");
+    LOG_HEX(LogLevel_TRACE, data, sizeof(data), "trace");
+
+    /* then: the messages of the log level are written at once */
+    nu_assert_eq_str("info", readMessage());
+    nu_assert_eq_str("", readMessage());
+
+    /* when: commit */
+    logger_scopeCommit();
+
+    /* then: the others follow with their level, location and context */
+    nu_assert_eq_str("[req=1] debug 1", readMessage());
+    nu_assert(s_line[0] == 'D');
+    nu_assert_eq_str("trace: 0a0b", readMessage());
+    nu_assert(s_line[0] == 'T');
+    nu_assert_eq_str("", readMessage());
+    nu_assert(!logger_isEnabled(LogLevel_DEBUG));
+    return 0;
+}
+
+static int test_location(void)
+{
+    char location[64];
+    int line;
+
+    /* when: */
+    nu_assert(logger_scopeBegin());
+    line = __LINE__; LOG_DEBUG("here");
+    logger_scopeCommit();
+
+    /* then: the header is that of the message */
+    readMessage();
+    sprintf(location, " logger_scope_test.c:%d: here", line);
+    nu_assert(strstr(s_line, location) != NULL);
+    return 0;
+}
+
+static int test_discard(void)
+{
+    /* when: discard a scope */
+    nu_assert(logger_scopeBegin());
+    LOG_DEBUG("debug");
+    LOG_WARN("warn");
+    logger_scopeDiscard();
+
+    /* then: only the message of the log level is written */
+    nu_assert_eq_str("warn", readMessage());
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+static int test_dropOldest(void)
+{
+    const char* message;
+    int dropped;
+    int first;
+    int i;
+
+    /* when: more messages than the buffer holds */
+    logger_setScopeSize(8 * 1024);
+    nu_assert(logger_scopeBegin());
+    for (i = 0; i < 1000; i++) {
+        LOG_DEBUG("message %d of a request that fails in the end", i);
+    }
+    logger_scopeCommit();
+
+    /* then: the oldest are dropped, which is noted first */
+    message = readMessage();
+    nu_assert(sscanf(message, "... %d earlier messages dropped", &dropped) == 1);
+    nu_assert(dropped > 0);
+    for (i = dropped; i < 1000; i++) {
+        message = readMessage();
+        nu_assert(sscanf(message, "message %d", &first) == 1);
+        nu_assert_eq_int(i, first);
+    }
+    nu_assert_eq_str("", readMessage());
+    logger_setScopeSize(0);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_commit);
+    nu_run_test(test_location);
+    nu_run_test(test_discard);
+    nu_run_test(test_dropOldest);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200112L /* pthread_barrier_t */
+#include "logger.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "shard.log";
+static const int kThreads = 4;
+static const int kLines = 100;
+
+static int isShardFile(const char* name)
+{
+    size_t len = strlen(kOutputFileName);
+    return strncmp(name, kOutputFileName, len) == 0 && name[len] == '.';
+}
+
+static void removeFiles(void)
+{
+    DIR* dir;
+    struct dirent* entry;
+
+    if ((dir = opendir(".")) == NULL) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (isShardFile(entry->d_name)) {
+            remove(entry->d_name);
+        }
+    }
+    closedir(dir);
+}
+
+static void setup(void)
+{
+    removeFiles();
+}
+
+static void cleanup(void)
+{
+    removeFiles();
+}
+
+static void* logLines(void* arg)
+{
+    int thread = *(int*) arg;
+    int i;
+
+    for (i = 0; i < kLines; i++) {
+        LOG_INFO("thread %d line %d", thread, i);
+    }
+    return NULL;
+}
+
+/*
+ * Count the lines in the shard files, returning -1 if a line is broken,
+ * written by another thread or out of order in its file.
+ */
+static int countLines(int* seen, char* sequences, size_t maxSequence)
+{
+    DIR* dir;
+    struct dirent* entry;
+    FILE* fp;
+    char line[256];
+    unsigned long sequence, previous;
+    long fileThreadID, threadID;
+    int thread, index;
+    int count = 0;
+
+    if ((dir = opendir(".")) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (!isShardFile(entry->d_name)
+                || (fp = fopen(entry->d_name, "r")) == NULL) {
+            continue;
+        }
+        fileThreadID = atol(&entry->d_name[sizeof(kOutputFileName)]);
+        previous = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            /* "<seq> I yy-mm-dd hh:mm:ss.uuuuuu <tid> <file>:<line>: thread %d line %d" */
+            if (sscanf(line, "%lu I %*s %*s %ld %*s thread %d line %d\n",
+                        &sequence, &threadID, &thread, &index) != 4
+                    || threadID != fileThreadID || sequence >= maxSequence
+                    || (previous != 0 && sequence <= previous)
+                    || thread < 0 || thread >= kThreads || index < 0 || index >= kLines) {
+                fclose(fp);
+                closedir(dir);
+                return -1;
+            }
+            previous = sequence;
+            sequences[sequence]++;
+            seen[thread * kLines + index]++;
+            count++;
+        }
+        fclose(fp);
+    }
+    closedir(dir);
+    return count;
+}
+
+static int test_shardedFileLogger(void)
+{
+    pthread_t threads[4];
+    int ids[4];
+    int seen[4 * 100];
+    char sequences[4 * 100];
+    int result;
+    int i;
+
+    /* when: initialize sharded file logger */
+    result = logger_initShardedFileLogger(kOutputFileName, 2048, 255);
+
+    /* then: ok */
+    nu_assert_eq_int(1, result);
+
+    /* when: several threads log to their own small shards at once */
+    for (i = 0; i < kThreads; i++) {
+        ids[i] = i;
+        nu_assert_eq_int(0, pthread_create(&threads[i], NULL, logLines, &ids[i]));
+    }
+    for (i = 0; i < kThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* then: every line is written exactly once with a unique sequence number */
+    memset(seen, 0, sizeof(seen));
+    memset(sequences, 0, sizeof(sequences));
+    nu_assert_eq_int(kThreads * kLines, countLines(seen, sequences, sizeof(sequences)));
+    for (i = 0; i < kThreads * kLines; i++) {
+        nu_assert_eq_int(1, seen[i]);
+        nu_assert_eq_int(1, sequences[i]);
+    }
+    return 0;
+}
+
+#define kManyThreads 70 /* more than the default pool */
+static pthread_barrier_t s_barrier;
+
+static void* logLineAtOnce(void* arg)
+{
+    pthread_barrier_wait(&s_barrier); /* all threads are alive */
+    LOG_INFO("thread %d line 0", *(int*) arg);
+    pthread_barrier_wait(&s_barrier);
+    return NULL;
+}
+
+/* Log a line from each of the threads alive at once, and return the lines written */
+static int logFromManyThreads(void)
+{
+    pthread_t threads[kManyThreads];
+    int ids[kManyThreads];
+    DIR* dir;
+    struct dirent* entry;
+    FILE* fp;
+    char line[256];
+    int count = 0;
+    int i;
+
+    removeFiles();
+    logger_initShardedFileLogger(kOutputFileName, 2048, 255);
+    pthread_barrier_init(&s_barrier, NULL, kManyThreads);
+    for (i = 0; i < kManyThreads; i++) {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, logLineAtOnce, &ids[i]);
+    }
+    for (i = 0; i < kManyThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&s_barrier);
+    logger_flush();
+
+    if ((dir = opendir(".")) == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (isShardFile(entry->d_name) && (fp = fopen(entry->d_name, "r")) != NULL) {
+            while (fgets(line, sizeof(line), fp) != NULL) {
+                count++;
+            }
+            fclose(fp);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static int test_moreThreadsThanShards(void)
+{
+    /* when: more threads than the default pool log at once */
+    /* then: the lines of the threads beyond it are dropped */
+    nu_assert_eq_int(64, logFromManyThreads());
+
+    /* when: with a shard for each of them */
+    logger_setShardPoolSize(kManyThreads);
+
+    /* then: every line is written */
+    nu_assert_eq_int(kManyThreads, logFromManyThreads());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_shardedFileLogger);
+    nu_run_test(test_moreThreadsThanShards);
+    cleanup();
+    nu_report();
+}
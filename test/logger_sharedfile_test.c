@@ -0,0 +1,114 @@
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "sharedfile.log";
+static const int kProcesses = 4;
+static const int kLines = 200;
+
+static void removeFiles(void)
+{
+    char filename[64];
+    int i;
+
+    remove(kOutputFileName);
+    sprintf(filename, "%s.lock", kOutputFileName);
+    remove(filename);
+    for (i = 1; i < 256; i++) {
+        sprintf(filename, "%s.%d", kOutputFileName, i);
+        remove(filename);
+    }
+}
+
+static void setup(void)
+{
+    removeFiles();
+}
+
+static void cleanup(void)
+{
+    removeFiles();
+}
+
+/* Count the lines in the file and its backups, returning -1 if a line is broken */
+static int countLines(int* seen)
+{
+    FILE* fp;
+    char filename[64];
+    char line[256];
+    const char* message;
+    int process, index;
+    int count = 0;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        if (i == 0) {
+            sprintf(filename, "%s", kOutputFileName);
+        } else {
+            sprintf(filename, "%s.%d", kOutputFileName, i);
+        }
+        if ((fp = fopen(filename, "r")) == NULL) {
+            continue;
+        }
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            message = strstr(line, ": process ");
+            if (line[0] != 'I' || message == NULL
+                    || sscanf(message, ": process %d line %d\n", &process, &index) != 2
+                    || process < 0 || process >= kProcesses || index < 0 || index >= kLines) {
+                fclose(fp);
+                return -1;
+            }
+            seen[process * kLines + index]++;
+            count++;
+        }
+        fclose(fp);
+    }
+    return count;
+}
+
+static int test_sharedFileLogger(void)
+{
+    int seen[4 * 200];
+    pid_t pid;
+    int status;
+    int p, i;
+
+    /* when: several processes log to the same small file at once */
+    for (p = 0; p < kProcesses; p++) {
+        if ((pid = fork()) < 0) {
+            nu_fail();
+        }
+        if (pid == 0) {
+            if (!logger_initSharedFileLogger(kOutputFileName, 2048, 255)) {
+                _exit(1);
+            }
+            for (i = 0; i < kLines; i++) {
+                LOG_INFO("process %d line %d", p, i);
+            }
+            _exit(0);
+        }
+    }
+    for (p = 0; p < kProcesses; p++) {
+        wait(&status);
+        nu_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* then: every line is written exactly once across the rotated files */
+    memset(seen, 0, sizeof(seen));
+    nu_assert_eq_int(kProcesses * kLines, countLines(seen));
+    for (i = 0; i < kProcesses * kLines; i++) {
+        nu_assert_eq_int(1, seen[i]);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_sharedFileLogger);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,79 @@
+#include "logger.h"
+#include <stdio.h>
+#include "nanounit.h"
+
+static const char kShmFileName[] = "shm.shm";
+static const char kOutputFileName[] = "shm.log";
+
+static void setup(void)
+{
+    remove(kShmFileName);
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kShmFileName);
+    remove(kOutputFileName);
+}
+
+static int countLines(const char* filename)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[strlen(line) - 1] != '\n') {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
+}
+
+static int test_shmLogger(void)
+{
+    int result;
+    long size;
+    int i;
+
+    /* when: initialize shared memory logger with a small ring */
+    result = logger_initShmLogger(kShmFileName, 1024);
+
+    /* then: ok */
+    nu_assert_eq_int(1, result);
+
+    /* when: output more than the ring can hold */
+    for (i = 0; i < 100; i++) {
+        LOG_INFO("message %d", i);
+    }
+
+    /* and: collect into the file logger */
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    size = logger_collectShmLogger(kShmFileName, 0);
+    nu_assert(size > 0);
+    nu_assert(size <= 1024);
+    while (logger_collectShmLogger(kShmFileName, 0) > 0) {}
+    logger_flush();
+
+    /* then: whole lines and a warning about the dropped ones are written */
+    result = countLines(kOutputFileName);
+    nu_assert(result > 1);
+    nu_assert(result < 100);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_shmLogger);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,157 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+/* A sink that counts what is delivered to it */
+struct Counter
+{
+    int batches;
+    int lines;
+    int flushes;
+    int closes;
+    int broken; /* lines without LF at the end */
+    char levels[64]; /* the level characters of the first lines */
+};
+
+static void writeCounter(void* context, const struct iovec* lines, int n)
+{
+    struct Counter* counter = (struct Counter*) context;
+    const char* line;
+    int i;
+
+    counter->batches++;
+    for (i = 0; i < n; i++) {
+        line = (const char*) lines[i].iov_base;
+        if (lines[i].iov_len == 0 || line[lines[i].iov_len - 1] != '\n') {
+            counter->broken++;
+        }
+        if (counter->lines < (int) sizeof(counter->levels) - 1) {
+            counter->levels[counter->lines] = line[0];
+        }
+        counter->lines++;
+    }
+}
+
+static void flushCounter(void* context)
+{
+    ((struct Counter*) context)->flushes++;
+}
+
+static void closeCounter(void* context)
+{
+    ((struct Counter*) context)->closes++;
+}
+
+static int test_sinks(void)
+{
+    struct Counter all, warn;
+    struct LogSink sink;
+    struct LogBatch batch;
+    char buffer[1024];
+    int allID, warnID;
+    int i;
+
+    /* setup: a sink for every level and a sink for WARN and above */
+    memset(&all, 0, sizeof(all));
+    memset(&warn, 0, sizeof(warn));
+    sink.writeBatch = writeCounter;
+    sink.flush = flushCounter;
+    sink.close = closeCounter;
+    sink.context = &all;
+    allID = logger_addSink(&sink, LogLevel_TRACE, LogLevel_FATAL);
+    nu_assert(allID != 0);
+    sink.context = &warn;
+    warnID = logger_addSink(&sink, LogLevel_WARN, LogLevel_FATAL);
+    nu_assert(warnID != 0 && warnID != allID);
+
+    /* when: log lines */
+    for (i = 0; i < 10; i++) {
+        LOG_INFO("info %d", i);
+    }
+    LOG_DEBUG("below the log level");
+    LOG_WARN("warn");
+    logger_batchBegin(&batch, buffer, sizeof(buffer));
+    LOG_BATCH(&batch, LogLevel_INFO, "batched info");
+    LOG_BATCH(&batch, LogLevel_ERROR, "batched error");
+    logger_batchCommit(&batch);
+
+    /* then: nothing is delivered before flush */
+    nu_assert_eq_int(0, all.lines);
+
+    /* when: flush */
+    logger_flush();
+
+    /* then: the lines of each level are delivered in one vector */
+    nu_assert_eq_int(1, all.batches);
+    nu_assert_eq_int(13, all.lines);
+    nu_assert_eq_int(0, all.broken);
+    nu_assert_eq_str("IIIIIIIIIIWIE", all.levels);
+    nu_assert_eq_int(1, all.flushes);
+    nu_assert_eq_int(1, warn.batches);
+    nu_assert_eq_int(2, warn.lines);
+    nu_assert_eq_str("WE", warn.levels);
+
+    /* when: log more lines than a vector holds */
+    for (i = 0; i < 1000; i++) {
+        LOG_INFO("info %d", i);
+    }
+    logger_flush();
+
+    /* then: they are delivered in several vectors */
+    nu_assert_eq_int(1013, all.lines);
+    nu_assert(all.batches > 2 && all.batches < 100);
+    nu_assert_eq_int(0, all.broken);
+
+    /* when: remove the sinks */
+    LOG_WARN("delivered on removal");
+    logger_removeSink(allID);
+    logger_removeSink(warnID);
+
+    /* then: the lines left are delivered and the sinks are closed */
+    nu_assert_eq_int(1014, all.lines);
+    nu_assert_eq_int(1, all.closes);
+    nu_assert_eq_int(3, warn.lines);
+    nu_assert_eq_int(1, warn.closes);
+    return 0;
+}
+
+static int test_levelRange(void)
+{
+    struct Counter range;
+    struct LogSink sink;
+    struct LogBatch batch;
+    char buffer[1024];
+    int id;
+
+    /* setup: a sink from INFO to WARN */
+    memset(&range, 0, sizeof(range));
+    sink.writeBatch = writeCounter;
+    sink.flush = NULL;
+    sink.close = NULL;
+    sink.context = &range;
+    id = logger_addSink(&sink, LogLevel_INFO, LogLevel_WARN);
+    nu_assert(id != 0);
+
+    /* when: log lines of each level, alone and in a batch */
+    LOG_INFO("info");
+    LOG_WARN("warn");
+    LOG_ERROR("error");
+    logger_batchBegin(&batch, buffer, sizeof(buffer));
+    LOG_BATCH(&batch, LogLevel_ERROR, "batched error");
+    LOG_BATCH(&batch, LogLevel_INFO, "batched info");
+    logger_batchCommit(&batch);
+    logger_removeSink(id);
+
+    /* then: only the lines in the range are delivered */
+    nu_assert_eq_int(3, range.lines);
+    nu_assert_eq_str("IWI", range.levels);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    nu_run_test(test_sinks);
+    nu_run_test(test_levelRange);
+    nu_report();
+}
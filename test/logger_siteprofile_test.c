@@ -0,0 +1,96 @@
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "siteprofile.log";
+static const char kProfileFileName[] = "siteprofile.txt";
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+    remove(kProfileFileName);
+}
+
+static void cleanup(void)
+{
+    remove(kOutputFileName);
+    remove(kProfileFileName);
+}
+
+static void logFromSite(int i)
+{
+    LOG_INFO("a short line %d", i);
+}
+
+static int test_siteProfile(void)
+{
+    FILE* fp;
+    char line[256];
+    char site[64];
+    unsigned long sites, dropped, messages, bytes;
+    int result;
+    int i;
+
+    /* setup: profile 2 sites */
+    result = logger_initFileLogger(kOutputFileName, 0, 0);
+    nu_assert_eq_int(1, result);
+    result = logger_initSiteProfile(2, 1, 0);
+    nu_assert_eq_int(1, result);
+
+    /* when: log from 3 sites, the one with fewer messages with more bytes */
+    for (i = 0; i < 20; i++) {
+        logFromSite(i);
+    }
+    for (i = 0; i < 10; i++) {
+        LOG_INFO("a long line %d %0200d", i, 0);
+    }
+    for (i = 0; i < 1000; i++) {
+        LOG_DEBUG("below the log level %d", i);
+    }
+    fp = fopen(kProfileFileName, "w");
+    logger_dumpSiteProfile(fp);
+    fclose(fp);
+
+    /* then: 2 sites are counted with the long line at the top */
+    fp = fopen(kProfileFileName, "r");
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_int(2, sscanf(line, "site profile: %lu sites, %lu dropped", &sites, &dropped));
+    nu_assert_eq_int(2, (int) sites);
+    nu_assert_eq_int(0, (int) dropped);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_int(3, sscanf(line, "%lu %lu %*f %*f %63s", &messages, &bytes, site));
+    nu_assert_eq_int(10, (int) messages);
+    nu_assert(bytes > 2000);
+    nu_assert(strstr(site, "logger_siteprofile_test.c:") == site);
+    nu_assert(fgets(line, sizeof(line), fp) == NULL);
+    fclose(fp);
+
+    /* when: log from one more site than the profile holds */
+    LOG_INFO("a third site");
+    fp = fopen(kProfileFileName, "w");
+    logger_dumpSiteProfile(fp);
+    fclose(fp);
+
+    /* then: the message is dropped */
+    fp = fopen(kProfileFileName, "r");
+    nu_assert(fgets(line, sizeof(line), fp) != NULL);
+    nu_assert_eq_int(2, sscanf(line, "site profile: %lu sites, %lu dropped", &sites, &dropped));
+    nu_assert_eq_int(2, (int) sites);
+    nu_assert_eq_int(1, (int) dropped);
+    fclose(fp);
+
+    /* cleanup: switch off the profile */
+    result = logger_initSiteProfile(0, 0, 0);
+    nu_assert_eq_int(1, result);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_siteProfile);
+    cleanup();
+    nu_report();
+}
@@ -0,0 +1,151 @@
+#define _POSIX_C_SOURCE 200112L /* nanosleep() */
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nanounit.h"
+
+static const char kOutputFileName[] = "timer.log";
+static FILE* s_input;
+static char s_line[1024];
+
+static void setup(void)
+{
+    remove(kOutputFileName);
+}
+
+static void cleanup(void)
+{
+    if (s_input != NULL) {
+        fclose(s_input);
+    }
+    remove(kOutputFileName);
+}
+
+/* Read the message part of the next line written by the file logger */
+static const char* readMessage(void)
+{
+    char* message;
+
+    logger_flush();
+    clearerr(s_input);
+    if (fgets(s_line, sizeof(s_line), s_input) == NULL) {
+        return "";
+    }
+    s_line[strlen(s_line) - 1] = '\0'; /* remove LF */
+    if ((message = strstr(s_line, "logger_timer_test.c:")) == NULL
+            || (message = strstr(message, ": ")) == NULL) {
+        return "";
+    }
+    return message + 2;
+}
+
+static void sleep2ms(void)
+{
+    struct timespec ts = {0, 2000000};
+
+    nanosleep(&ts, NULL);
+}
+
+/* Sleep for 2 ms in a timed scope, returning the line of the timer */
+static int sleepTimed(void)
+{
+    LOG_SCOPE_TIMER(LogLevel_INFO, "sleep");
+
+    sleep2ms();
+    return __LINE__ - 3;
+}
+
+static int test_initialize(void)
+{
+    nu_assert(logger_initFileLogger(kOutputFileName, 0, 0));
+    nu_assert((s_input = fopen(kOutputFileName, "r")) != NULL);
+    logger_setLevel(LogLevel_INFO);
+    return 0;
+}
+
+static int test_elapsed(void)
+{
+    char location[64];
+    unsigned long us;
+    int line;
+
+    /* when: */
+    line = sleepTimed();
+
+    /* then: the time is logged at the location of the timer when the scope exits */
+    nu_assert(sscanf(readMessage(), "sleep: %lu.%*u us", &us) == 1);
+    nu_assert(us >= 2000 && us < 1000000);
+    sprintf(location, " logger_timer_test.c:%d: sleep", line);
+    nu_assert(strstr(s_line, location) != NULL);
+    return 0;
+}
+
+static int test_tsc(void)
+{
+    unsigned long us;
+
+    if (!logger_setClock(LogClock_TSC)) {
+        return 0; /* not supported */
+    }
+
+    /* when: */
+    sleepTimed();
+
+    /* then: the time is the same with the timestamp counter */
+    nu_assert(sscanf(readMessage(), "sleep: %lu.%*u us", &us) == 1);
+    nu_assert(us >= 2000 && us < 1000000);
+    logger_setClock(LogClock_REALTIME);
+    return 0;
+}
+
+static int test_threshold(void)
+{
+    int i;
+
+    /* when: scopes faster than the threshold */
+    for (i = 0; i < 10; i++) {
+        LOG_SCOPE_TIMER_SLOW(LogLevel_WARN, "fast", 1000000);
+    }
+
+    /* then: they are not logged */
+    nu_assert_eq_str("", readMessage());
+
+    /* when: a scope slower than the threshold */
+    {
+        LOG_SCOPE_TIMER_SLOW(LogLevel_WARN, "slow", 1000);
+        sleep2ms();
+    }
+
+    /* then: */
+    nu_assert(strncmp("slow: ", readMessage(), 6) == 0);
+    nu_assert(s_line[0] == 'W');
+    return 0;
+}
+
+static int test_disabledLevel(void)
+{
+    struct LogScopeTimer timer;
+
+    /* when: the level is disabled */
+    timer = logger_timerBegin(LogLevel_DEBUG, "debug", 0, __FILENAME__, __LINE__);
+    logger_timerEnd(&timer);
+
+    /* then: the clock is not read and nothing is logged */
+    nu_assert(timer.start == 0);
+    nu_assert_eq_str("", readMessage());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    setup();
+    nu_run_test(test_initialize);
+    nu_run_test(test_elapsed);
+    nu_run_test(test_tsc);
+    nu_run_test(test_threshold);
+    nu_run_test(test_disabledLevel);
+    cleanup();
+    nu_report();
+}
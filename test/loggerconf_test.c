@@ -5,6 +5,31 @@
 static void cleanup(void)
 {
     remove("conf.log");
+    remove("conf_errors.log");
+    remove("conf_bulk.log");
+    remove("conf_audit.log");
+    remove("conf_all.log");
+}
+
+/* Count the lines of the file that start with one of the level characters, or -1 if another one does */
+static int countLines(const char* filename, const char* levels)
+{
+    FILE* fp;
+    char line[256];
+    int count = 0;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strchr(levels, line[0]) == NULL) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    fclose(fp);
+    return count;
 }
 
 static int test_configure_empty(void)
@@ -30,11 +55,163 @@ static int test_configure_fileLogger(void)
     return 0;
 }
 
+static int test_configure_fileSinks(void)
+{
+    int result;
+
+    /* setup: */
+    cleanup();
+
+    /* when: */
+    result = logger_configure("res/filesinks.conf");
+
+    /* then: */
+    nu_assert_eq_int(1, result);
+
+    /* when: log a line of each level */
+    LOG_DEBUG("debug");
+    LOG_INFO("info");
+    LOG_WARN("warn");
+    LOG_ERROR("error");
+    LOG_FATAL("fatal");
+
+    /* then: the errors are written at once and the other lines are buffered */
+    nu_assert_eq_int(2, countLines("conf_errors.log", "EF"));
+    nu_assert_eq_int(0, countLines("conf_bulk.log", "DIW"));
+
+    /* when: */
+    logger_flush();
+
+    /* then: */
+    nu_assert_eq_int(3, countLines("conf_bulk.log", "DIW"));
+
+    /* cleanup: remove the sinks with an empty configuration */
+    logger_configure("res/empty.conf");
+    LOG_ERROR("not written");
+    nu_assert_eq_int(2, countLines("conf_errors.log", "EF"));
+    return 0;
+}
+
+static int test_configure_namedLoggers(void)
+{
+    int result;
+    int net;
+
+    /* setup: */
+    result = logger_configureText(
+            "level=INFO\n"
+            "sink.audit.type=file   # only the lines of net\n"
+            "sink.audit.filename=conf_audit.log\n"
+            "sink.all.type=file\n"
+            "sink.all.filename = conf_all.log\n"
+            "sink.all.async=on\n"
+            "logger.net.sinks=audit\n"
+            "logger.net.level=WARN\n");
+    nu_assert_eq_int(1, result);
+
+    /* when: log with the root logger and the net logger */
+    LOG_INFO("root");
+    net = logger_useLogger(logger_getLogger("net"));
+    LOG_INFO("below the level of net");
+    LOG_WARN("net");
+    logger_useLogger(net);
+    logger_flush();
+
+    /* then: */
+    nu_assert_eq_int(1, countLines("conf_audit.log", "W"));
+    nu_assert_eq_int(2, countLines("conf_all.log", "IW"));
+
+    /* cleanup: */
+    logger_configureText("");
+    return 0;
+}
+
+static int test_configure_malformed(void)
+{
+    static const char* const kTexts[] = {
+        "level",
+        "=INFO",
+        "level=",
+        "level=LOUD",
+        "levels=INFO",
+        "autoFlush=12x",
+        "autoFlush=99999999999999999999999",
+        "combining=maybe",
+        "logger=pipe",
+        "logger.console.output=stdin",
+        "logger.console.filename=x",
+        "logger.file.maxBackupFiles=300",
+        "logger.file.shared=maybe",
+        "sink.a.type=pipe",
+        "sink.a.filename=conf.log",
+        "sink.a.type=file",
+        "sink.a.type=file\nsink.a.filename=conf.log\nsink.a.bogus=1",
+        "sink..type=console",
+        "sink.a.b.type=console",
+        "sink.0123456789012345678901234567890123456789.type=console",
+        "sink.a.type=console\nsink.a.overflow=DROP_ALL",
+        "sink.a.type=console\nsink.a.bufferSize=1024",
+        "sink.a.flushInterval=100\nsink.a.type=console",
+        "sink.a.type=file\nsink.a.filename=conf.log\nsink.a.queueSize=1024",
+        "logger.file.a.filename=conf.log\nlogger.file.a.overflow=BLOCK",
+        "logger.net.sinks=nowhere",
+        "logger.net.sinks=,",
+        "logger.net.color=red",
+        "level=INFO\nsink.1.type=console\nsink.2.type=console\nsink.3.type=console\nsink.4.type=console\n"
+            "sink.5.type=console\nsink.6.type=console\nsink.7.type=console\nsink.8.type=console\n"
+            "sink.9.type=console",
+    };
+    char text[1024];
+    int i;
+
+    /* setup: */
+    logger_setLevel(LogLevel_INFO);
+
+    /* when: configure each malformed text after a valid line */
+    for (i = 0; i < (int) (sizeof(kTexts) / sizeof(kTexts[0])); i++) {
+        sprintf(text, "level=TRACE\n%s\n", kTexts[i]);
+
+        /* then: fail without configuring anything */
+        nu_assert_eq_int(0, logger_configureText(text));
+        nu_assert_eq_int(LogLevel_INFO, logger_getLevel());
+    }
+
+    /* when: a value is too long */
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    memcpy(text, "sink.a.filename=", 16);
+
+    /* then: */
+    nu_assert_eq_int(0, logger_configureText(text));
+    return 0;
+}
+
+static int test_configure_longLine(void)
+{
+    char text[2048];
+
+    /* setup: a line longer than a buffer of the previous parser */
+    strcpy(text, "level=DEBUG # ");
+    memset(&text[14], '-', 1500);
+    strcpy(&text[1514], "\r\nlogger=console\r\n");
+
+    /* when: */
+    nu_assert_eq_int(1, logger_configureText(text));
+
+    /* then: */
+    nu_assert_eq_int(LogLevel_DEBUG, logger_getLevel());
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
     nu_run_test(test_configure_empty);
     nu_run_test(test_configure_consoleLogger);
     nu_run_test(test_configure_fileLogger);
+    nu_run_test(test_configure_fileSinks);
+    nu_run_test(test_configure_namedLoggers);
+    nu_run_test(test_configure_malformed);
+    nu_run_test(test_configure_longLine);
     cleanup();
     nu_report();
 }
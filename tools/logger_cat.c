@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+enum
+{
+    kFrameHeaderSize = 12, /* magic, compressed size and uncompressed size */
+    kMaxFrameSize = 16777216 /* 16 MB, larger sizes are taken as corruption */
+};
+
+static const char kFrameMagic[4] = {'C', 'L', 'Z', '1'};
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: logger-cat file...\n"
+            "  Decompress files written by the compressed file logger to stdout.\n");
+}
+
+static unsigned long getUint32(const unsigned char* p)
+{
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16)
+        | ((unsigned long) p[2] << 8) | (unsigned long) p[3];
+}
+
+/* Decompress every frame of the file and return 0 if a frame is broken */
+static int catFile(const char* filename, FILE* fp, FILE* output)
+{
+    unsigned char header[kFrameHeaderSize];
+    unsigned char* compressed = NULL;
+    char* data = NULL;
+    unsigned long compressedLen, len;
+    uLongf dataLen;
+    size_t n;
+    int ok = 0; /* false */
+
+    while ((n = fread(header, 1, sizeof(header), fp)) == sizeof(header)) {
+        compressedLen = getUint32(&header[4]);
+        len = getUint32(&header[8]);
+        if (memcmp(header, kFrameMagic, sizeof(kFrameMagic)) != 0
+                || compressedLen > kMaxFrameSize || len > kMaxFrameSize) {
+            fprintf(stderr, "ERROR: logger-cat: Invalid frame: `%s`\n", filename);
+            goto cleanup;
+        }
+        free(compressed);
+        free(data);
+        compressed = (unsigned char*) malloc(compressedLen + 1);
+        data = (char*) malloc(len + 1);
+        if (compressed == NULL || data == NULL) {
+            fprintf(stderr, "ERROR: logger-cat: Out of memory\n");
+            goto cleanup;
+        }
+        if (fread(compressed, 1, compressedLen, fp) != compressedLen) {
+            fprintf(stderr, "ERROR: logger-cat: Truncated frame: `%s`\n", filename);
+            goto cleanup;
+        }
+        dataLen = (uLongf) len;
+        if (uncompress((Bytef*) data, &dataLen, compressed, (uLong) compressedLen) != Z_OK
+                || dataLen != len) {
+            fprintf(stderr, "ERROR: logger-cat: Failed to decompress a frame: `%s`\n", filename);
+            goto cleanup;
+        }
+        fwrite(data, 1, len, output);
+    }
+    if (n != 0) {
+        fprintf(stderr, "ERROR: logger-cat: Truncated frame: `%s`\n", filename);
+        goto cleanup;
+    }
+    ok = 1; /* true */
+cleanup:
+    free(compressed);
+    free(data);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* fp;
+    int result = 0;
+    int i;
+
+    if (argc < 2 || argv[1][0] == '-') {
+        usage();
+        return 2;
+    }
+    for (i = 1; i < argc; i++) {
+        if ((fp = fopen(argv[i], "rb")) == NULL) {
+            fprintf(stderr, "ERROR: logger-cat: Failed to open file: `%s`\n", argv[i]);
+            result = 1;
+            continue;
+        }
+        if (!catFile(argv[i], fp, stdout)) {
+            result = 1;
+        }
+        fclose(fp);
+    }
+    return result;
+}
@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "logger.h"
+
+static volatile sig_atomic_t s_running = 1; /* true */
+
+static void stop(int sig)
+{
+    s_running = 0; /* false */
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: logger-collector [-s size] [-i interval] shmfile logfile [maxFileSize [maxBackupFiles]]\n"
+            "  -s size      The size of the ring buffer in bytes if shmfile is created (default: 4 MB)\n"
+            "  -i interval  A polling interval in milliseconds when idle (default: 10)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* shmfile;
+    const char* logfile;
+    long maxFileSize = 0;
+    int maxBackupFiles = 0;
+    size_t size = 0;
+    long interval = 10;
+    struct timespec idle;
+    long n;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:i:h")) != -1) {
+        switch (opt) {
+            case 's': size = strtoul(optarg, NULL, 10); break;
+            case 'i': interval = atol(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+    if (argc - optind < 2) {
+        usage();
+        return 2;
+    }
+    shmfile = argv[optind];
+    logfile = argv[optind + 1];
+    if (argc - optind > 2) {
+        maxFileSize = atol(argv[optind + 2]);
+    }
+    if (argc - optind > 3) {
+        maxBackupFiles = atoi(argv[optind + 3]);
+        if (maxBackupFiles < 0 || maxBackupFiles > 255) {
+            fprintf(stderr, "ERROR: logger-collector: Invalid maxBackupFiles: `%s`\n", argv[optind + 3]);
+            return 2;
+        }
+    }
+    idle.tv_sec = interval / 1000;
+    idle.tv_nsec = (interval % 1000) * 1000000L;
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    if (!logger_initFileLogger(logfile, maxFileSize, (unsigned char) maxBackupFiles)) {
+        return 1;
+    }
+    while (s_running) {
+        if ((n = logger_collectShmLogger(shmfile, size)) < 0) {
+            return 1;
+        }
+        if (n == 0) {
+            logger_flush();
+            nanosleep(&idle, NULL);
+        }
+    }
+    /* drain what has been written before stopping */
+    while (logger_collectShmLogger(shmfile, size) > 0) {}
+    logger_flush();
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+    kMaxLineLen = 4096 + 32, /* a log line and its sequence number */
+    kTimestampLen = 24 /* yy-mm-dd hh:mm:ss.uuuuuu */
+};
+
+/* The next line of a shard file */
+struct Input
+{
+    FILE* fp;
+    const char* filename;
+    char line[kMaxLineLen];
+    unsigned long sequence;
+    const char* record; /* the line without the sequence number */
+};
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: logger-merge [-o logfile] shardfile...\n"
+            "  -o logfile  The file to write the merged lines to (default: stdout)\n");
+}
+
+/* Read the next line and return 0 at the end of the file */
+static int readInput(struct Input* input)
+{
+    char* p;
+
+    if (fgets(input->line, sizeof(input->line), input->fp) == NULL) {
+        return 0;
+    }
+    input->sequence = strtoul(input->line, &p, 10);
+    input->record = (p != input->line && *p == ' ') ? p + 1 : input->line;
+    return 1;
+}
+
+static const char* getTimestamp(const struct Input* input)
+{
+    /* "L yy-mm-dd hh:mm:ss.uuuuuu ..." */
+    if (strlen(input->record) < 2 + kTimestampLen) {
+        return "";
+    }
+    return &input->record[2];
+}
+
+static int compareInputs(const struct Input* a, const struct Input* b)
+{
+    const char* ta = getTimestamp(a);
+    const char* tb = getTimestamp(b);
+    int result = strncmp(ta, tb, kTimestampLen);
+
+    if (result != 0) {
+        return result;
+    }
+    return (a->sequence < b->sequence) ? -1 : (a->sequence > b->sequence) ? 1 : 0;
+}
+
+/* Move the input at the index down to restore the order of the min-heap */
+static void siftDown(struct Input** heap, size_t n, size_t i)
+{
+    struct Input* tmp;
+    size_t child;
+
+    while ((child = i * 2 + 1) < n) {
+        if (child + 1 < n && compareInputs(heap[child + 1], heap[child]) < 0) {
+            child++;
+        }
+        if (compareInputs(heap[i], heap[child]) <= 0) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* outfile = NULL;
+    FILE* output = stdout;
+    struct Input* inputs;
+    struct Input** heap;
+    size_t n = 0;
+    size_t i;
+    int argi = 1;
+    int result = 0;
+
+    if (argi + 1 < argc && strcmp(argv[argi], "-o") == 0) {
+        outfile = argv[argi + 1];
+        argi += 2;
+    }
+    if (argi >= argc || argv[argi][0] == '-') {
+        usage();
+        return 2;
+    }
+    inputs = (struct Input*) calloc(argc - argi, sizeof(struct Input));
+    heap = (struct Input**) calloc(argc - argi, sizeof(struct Input*));
+    if (inputs == NULL || heap == NULL) {
+        fprintf(stderr, "ERROR: logger-merge: Out of memory\n");
+        return 1;
+    }
+    for (i = 0; argi + i < (size_t) argc; i++) {
+        inputs[i].filename = argv[argi + i];
+        if ((inputs[i].fp = fopen(inputs[i].filename, "r")) == NULL) {
+            fprintf(stderr, "ERROR: logger-merge: Failed to open file: `%s`\n", inputs[i].filename);
+            result = 1;
+            continue;
+        }
+        if (readInput(&inputs[i])) {
+            heap[n++] = &inputs[i];
+        }
+    }
+    if (outfile != NULL && (output = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "ERROR: logger-merge: Failed to open file: `%s`\n", outfile);
+        return 1;
+    }
+    for (i = n / 2; i > 0; i--) {
+        siftDown(heap, n, i - 1);
+    }
+    while (n > 0) {
+        fputs(heap[0]->record, output);
+        if (!readInput(heap[0])) {
+            heap[0] = heap[--n];
+        }
+        siftDown(heap, n, 0);
+    }
+    for (i = 0; argi + i < (size_t) argc; i++) {
+        if (inputs[i].fp != NULL) {
+            fclose(inputs[i].fp);
+        }
+    }
+    if (output != stdout) {
+        fclose(output);
+    }
+    free(heap);
+    free(inputs);
+    return result;
+}
@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum
+{
+    kMaxFileNameLen = 256,
+    kMaxBackupFiles = 255,
+    kTimestampLen = 24 /* yy-mm-dd hh:mm:ss.uuuuuu */
+};
+
+static const char kLevelChars[] = "TDIWEF";
+
+/* A run of matched lines in the mapped file */
+struct Range
+{
+    const char* data;
+    size_t len;
+};
+
+/* A log file scanned by a thread */
+struct Scan
+{
+    char filename[kMaxFileNameLen + 4];
+    char indexname[kMaxFileNameLen + 8];
+    pthread_t thread;
+    int threaded;
+    char* map;
+    size_t mapSize;
+    struct Range* ranges;
+    size_t nranges;
+    size_t capacity;
+    int ok;
+};
+
+static const char* s_from = "";
+static const char* s_to = "";
+static int s_level = 0; /* index in kLevelChars */
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: logger-query [--from time] [--to time] [--level level] logfile\n"
+            "  --from time    The first time to print, e.g. \"26-10-18 21:00\" (default: the first line)\n"
+            "  --to time      The last time to print, compared up to its length (default: the last line)\n"
+            "  --level level  The minimum level to print: TRACE, DEBUG, INFO, WARN, ERROR or FATAL\n"
+            "The backup files logfile.N and the index files logfile.idx[.N] are read if they exist.\n");
+}
+
+/* Compare a timestamp with a time given on the command line, which may be a prefix */
+static int compareTime(const char* timestamp, const char* time)
+{
+    return strncmp(timestamp, time, strlen(time));
+}
+
+static int isMatched(const char* line, size_t len)
+{
+    const char* level;
+
+    if (len < 2 + kTimestampLen) {
+        return 0;
+    }
+    if (line[0] == '\0' || (level = strchr(kLevelChars, line[0])) == NULL
+            || level - kLevelChars < s_level) {
+        return 0;
+    }
+    return compareTime(&line[2], s_from) >= 0 && compareTime(&line[2], s_to) <= 0;
+}
+
+static int addRange(struct Scan* scan, const char* data, size_t len)
+{
+    struct Range* ranges;
+    struct Range* last;
+
+    if (scan->nranges > 0) {
+        last = &scan->ranges[scan->nranges - 1];
+        if (last->data + last->len == data) {
+            last->len += len; /* coalesce adjacent lines */
+            return 1;
+        }
+    }
+    if (scan->nranges == scan->capacity) {
+        scan->capacity = (scan->capacity > 0) ? scan->capacity * 2 : 64;
+        ranges = (struct Range*) realloc(scan->ranges, scan->capacity * sizeof(struct Range));
+        if (ranges == NULL) {
+            fprintf(stderr, "ERROR: logger-query: Out of memory\n");
+            return 0;
+        }
+        scan->ranges = ranges;
+    }
+    scan->ranges[scan->nranges].data = data;
+    scan->ranges[scan->nranges].len = len;
+    scan->nranges++;
+    return 1;
+}
+
+/*
+ * Narrow the byte range to scan with the index: start at the last entry
+ * before --from and stop at the first entry after --to.
+ */
+static void seekIndex(const struct Scan* scan, size_t* begin, size_t* end)
+{
+    FILE* fp;
+    char timestamp[kTimestampLen + 1];
+    long offset;
+
+    if ((fp = fopen(scan->indexname, "r")) == NULL) {
+        return;
+    }
+    while (fscanf(fp, "%24c %ld\n", timestamp, &offset) == 2) {
+        timestamp[kTimestampLen] = '\0';
+        if (offset < 0 || (size_t) offset > scan->mapSize) {
+            break; /* written for another file */
+        }
+        if (compareTime(timestamp, s_from) < 0) {
+            *begin = (size_t) offset;
+        } else if (s_to[0] != '\0' && compareTime(timestamp, s_to) > 0) {
+            *end = (size_t) offset;
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+static void* scanFile(void* arg)
+{
+    struct Scan* scan = (struct Scan*) arg;
+    size_t begin = 0, end;
+    const char* p;
+    const char* lf;
+    const char* last;
+    struct stat st;
+    int fd;
+
+    if ((fd = open(scan->filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "ERROR: logger-query: Failed to open file: `%s`\n", scan->filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    scan->mapSize = (size_t) st.st_size;
+    if (scan->mapSize == 0) {
+        close(fd);
+        scan->ok = 1;
+        return NULL;
+    }
+    scan->map = (char*) mmap(NULL, scan->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (scan->map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: logger-query: Failed to map file: `%s`\n", scan->filename);
+        scan->map = NULL;
+        return NULL;
+    }
+    madvise(scan->map, scan->mapSize, MADV_SEQUENTIAL);
+    end = scan->mapSize;
+    seekIndex(scan, &begin, &end);
+
+    /* memchr scans a word or a vector at a time */
+    last = scan->map + end;
+    for (p = scan->map + begin; p < last; p = lf + 1) {
+        if ((lf = (const char*) memchr(p, '\n', last - p)) == NULL) {
+            lf = last - 1; /* an unterminated last line */
+        }
+        if (isMatched(p, lf + 1 - p) && !addRange(scan, p, lf + 1 - p)) {
+            return NULL;
+        }
+    }
+    scan->ok = 1;
+    return NULL;
+}
+
+static int parseLevel(const char* s)
+{
+    const char* level = (s[0] != '\0') ? strchr(kLevelChars, s[0]) : NULL;
+    return (level != NULL) ? (int) (level - kLevelChars) : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option options[] = {
+        {"from", required_argument, NULL, 'f'},
+        {"to", required_argument, NULL, 't'},
+        {"level", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    struct Scan* scans;
+    const char* logfile;
+    struct stat st;
+    int nfiles = 0;
+    int result = 0;
+    int opt;
+    int i;
+    size_t j;
+
+    while ((opt = getopt_long(argc, argv, "f:t:l:h", options, NULL)) != -1) {
+        switch (opt) {
+            case 'f': s_from = optarg; break;
+            case 't': s_to = optarg; break;
+            case 'l':
+                if ((s_level = parseLevel(optarg)) < 0) {
+                    fprintf(stderr, "ERROR: logger-query: Invalid level: `%s`\n", optarg);
+                    return 2;
+                }
+                break;
+            default: usage(); return 2;
+        }
+    }
+    if (argc - optind != 1 || strlen(argv[optind]) >= kMaxFileNameLen) {
+        usage();
+        return 2;
+    }
+    logfile = argv[optind];
+    if ((scans = (struct Scan*) calloc(kMaxBackupFiles + 1, sizeof(struct Scan))) == NULL) {
+        fprintf(stderr, "ERROR: logger-query: Out of memory\n");
+        return 1;
+    }
+
+    /* the oldest backup first */
+    for (i = kMaxBackupFiles; i >= 0; i--) {
+        if (i == 0) {
+            sprintf(scans[nfiles].filename, "%s", logfile);
+            sprintf(scans[nfiles].indexname, "%s.idx", logfile);
+        } else {
+            sprintf(scans[nfiles].filename, "%s.%d", logfile, i);
+            sprintf(scans[nfiles].indexname, "%s.idx.%d", logfile, i);
+        }
+        if (stat(scans[nfiles].filename, &st) == 0) {
+            nfiles++;
+        }
+    }
+    if (nfiles == 0) {
+        fprintf(stderr, "ERROR: logger-query: Failed to open file: `%s`\n", logfile);
+        return 1;
+    }
+    for (i = 0; i < nfiles; i++) {
+        scans[i].threaded = pthread_create(&scans[i].thread, NULL, scanFile, &scans[i]) == 0;
+        if (!scans[i].threaded) {
+            scanFile(&scans[i]);
+        }
+    }
+    for (i = 0; i < nfiles; i++) {
+        if (scans[i].threaded) {
+            pthread_join(scans[i].thread, NULL);
+        }
+        if (!scans[i].ok) {
+            result = 1;
+        }
+        for (j = 0; j < scans[i].nranges; j++) {
+            fwrite(scans[i].ranges[j].data, 1, scans[i].ranges[j].len, stdout);
+        }
+        if (scans[i].map != NULL) {
+            munmap(scans[i].map, scans[i].mapSize);
+        }
+        free(scans[i].ranges);
+    }
+    free(scans);
+    return result;
+}